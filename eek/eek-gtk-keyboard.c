@@ -34,9 +34,16 @@
 #include "eek-gtk-keyboard.h"
 
 #include "eekboard/eekboard-context-service.h"
+#include "src/feedback.h"
+#include "src/latency.h"
 #include "src/layout.h"
 #include "src/popover.h"
+#include "src/recorder.h"
 #include "src/submission.h"
+#include "src/wayland.h"
+
+#include <gdk/gdkwayland.h>
+#include <time.h>
 
 #define LIBFEEDBACK_USE_UNSTABLE_API
 #include <libfeedback.h>
@@ -56,7 +63,13 @@ typedef struct _EekGtkKeyboardPrivate
     Layout *keyboard; // unowned reference; it's kept in server-context
 
     GdkEventSequence *sequence; // unowned reference
+    guint long_press_source;
+    guint32 long_press_due; // event time
     LfbEvent *event;
+    struct squeek_feedback *feedback; // owned
+    struct squeek_recorder *recorder; // owned, nullable
+    gboolean press_pending; // not drawn yet
+    guint32 press_time; // event time
 
     gulong kb_signal;
 } EekGtkKeyboardPrivate;
@@ -86,6 +99,92 @@ static void set_allocation_size(EekGtkKeyboard *gtk_keyboard,
         eek_gtk_keyboard_get_instance_private (gtk_keyboard);
     priv->render_geometry = eek_render_geometry_from_allocation_size(
         layout, width, height);
+    squeek_recorder_record(priv->recorder, SQUEEK_TOUCH_GEOMETRY, NULL,
+                           width, height, 0);
+}
+
+static void record(EekGtkKeyboard *self, enum squeek_touch_kind kind,
+                   GdkEventSequence *sequence,
+                   gdouble x, gdouble y, guint32 time)
+{
+    EekGtkKeyboardPrivate *priv = eek_gtk_keyboard_get_instance_private (self);
+    squeek_recorder_record(priv->recorder, kind, sequence, x, y, time);
+}
+
+static void
+presentation_handle_sync_output (void *data,
+                                 struct wp_presentation_feedback *feedback,
+                                 struct wl_output *output)
+{
+    (void)data;
+    (void)feedback;
+    (void)output;
+}
+
+static void
+presentation_handle_presented (void *data,
+                               struct wp_presentation_feedback *feedback,
+                               uint32_t tv_sec_hi, uint32_t tv_sec_lo,
+                               uint32_t tv_nsec, uint32_t refresh,
+                               uint32_t seq_hi, uint32_t seq_lo,
+                               uint32_t flags)
+{
+    (void)refresh;
+    (void)seq_hi;
+    (void)seq_lo;
+    (void)flags;
+    uint64_t sec = ((uint64_t)tv_sec_hi << 32) | tv_sec_lo;
+    // Event times are milliseconds, wrapped the same way
+    uint32_t presented = (uint32_t)(sec * 1000 + tv_nsec / 1000000);
+    squeek_latency_presented (GPOINTER_TO_UINT (data), presented);
+    wp_presentation_feedback_destroy (feedback);
+}
+
+static void
+presentation_handle_discarded (void *data,
+                               struct wp_presentation_feedback *feedback)
+{
+    (void)data;
+    squeek_latency_discarded ();
+    wp_presentation_feedback_destroy (feedback);
+}
+
+static const struct wp_presentation_feedback_listener presentation_feedback_listener = {
+    presentation_handle_sync_output,
+    presentation_handle_presented,
+    presentation_handle_discarded,
+};
+
+/// Asks when the frame being drawn reaches the screen.
+/// Only the first frame after a press is measured.
+static void
+request_presentation_feedback (EekGtkKeyboard *self)
+{
+    EekGtkKeyboardPrivate *priv = eek_gtk_keyboard_get_instance_private (self);
+    if (!priv->press_pending) {
+        return;
+    }
+    priv->press_pending = FALSE;
+
+    // Event times come from the monotonic clock, so presentation must too
+    if (!squeek_wayland || !squeek_wayland->presentation
+            || squeek_wayland->presentation_clock_id != CLOCK_MONOTONIC) {
+        return;
+    }
+    GdkWindow *window = gtk_widget_get_window (
+        gtk_widget_get_toplevel (GTK_WIDGET (self)));
+    if (!window || !GDK_IS_WAYLAND_WINDOW (window)) {
+        return;
+    }
+    struct wl_surface *surface = gdk_wayland_window_get_wl_surface (window);
+    if (!surface) {
+        return;
+    }
+    struct wp_presentation_feedback *feedback =
+        wp_presentation_feedback (squeek_wayland->presentation, surface);
+    wp_presentation_feedback_add_listener (feedback,
+                                           &presentation_feedback_listener,
+                                           GUINT_TO_POINTER (priv->press_time));
 }
 
 static gboolean
@@ -117,6 +216,7 @@ eek_gtk_keyboard_real_draw (GtkWidget *self,
 
     eek_renderer_render_keyboard (priv->renderer, priv->render_geometry,
         priv->submission, cr, priv->keyboard);
+    request_presentation_feedback (keyboard);
     return FALSE;
 }
 
@@ -137,18 +237,97 @@ eek_gtk_keyboard_real_size_allocate (GtkWidget     *self,
         size_allocate (self, allocation);
 }
 
+static void schedule_feedback (EekGtkKeyboard *self);
+
 static void
 on_event_triggered (LfbEvent      *event,
                     GAsyncResult  *res,
-                    gpointer      unused)
+                    gpointer      user_data)
 {
-    (void)unused;
+    EekGtkKeyboard *self = user_data;
+    EekGtkKeyboardPrivate *priv = eek_gtk_keyboard_get_instance_private (self);
     g_autoptr (GError) err = NULL;
+    gboolean success = lfb_event_trigger_feedback_finish (event, res, &err);
 
-    if (!lfb_event_trigger_feedback_finish (event, res, &err)) {
+    if (!success) {
         g_warning ("Failed to trigger feedback for '%s': %s",
                    lfb_event_get_event (event), err->message);
     }
+    if (squeek_feedback_finished (priv->feedback, success)) {
+        schedule_feedback (self);
+    }
+    g_object_unref (self);
+}
+
+static gboolean
+dispatch_feedback (gpointer user_data)
+{
+    EekGtkKeyboard *self = user_data;
+    EekGtkKeyboardPrivate *priv = eek_gtk_keyboard_get_instance_private (self);
+
+    if (squeek_feedback_dispatch (priv->feedback)) {
+        if (priv->event) {
+            lfb_event_trigger_feedback_async (priv->event,
+                                              NULL,
+                                              on_event_triggered,
+                                              g_object_ref (self));
+        } else {
+            squeek_feedback_finished (priv->feedback, FALSE);
+        }
+    }
+    return G_SOURCE_REMOVE;
+}
+
+// Runs after pending input is handled,
+// so that feedback never delays the touch handler.
+static void
+schedule_feedback (EekGtkKeyboard *self)
+{
+    g_idle_add_full (G_PRIORITY_LOW, dispatch_feedback,
+                     g_object_ref (self), g_object_unref);
+}
+
+static gboolean
+on_long_press (gpointer user_data)
+{
+    EekGtkKeyboard *self = user_data;
+    EekGtkKeyboardPrivate *priv = eek_gtk_keyboard_get_instance_private (self);
+
+    priv->long_press_source = 0;
+    if (priv->keyboard) {
+        squeek_layout_long_press (priv->keyboard->layout, self);
+    }
+    return G_SOURCE_REMOVE;
+}
+
+static void
+cancel_long_press (EekGtkKeyboardPrivate *priv)
+{
+    if (priv->long_press_source) {
+        g_source_remove (priv->long_press_source);
+        priv->long_press_source = 0;
+    }
+}
+
+// Keeps the timer in line with the button waiting for a long press.
+static void
+update_long_press (EekGtkKeyboard *self, guint32 time)
+{
+    EekGtkKeyboardPrivate *priv = eek_gtk_keyboard_get_instance_private (self);
+    uint32_t due = 0;
+    gboolean waiting = priv->keyboard
+        && squeek_layout_get_long_press_due (priv->keyboard->layout, &due);
+
+    if (waiting && priv->long_press_source && due == priv->long_press_due) {
+        return;
+    }
+    cancel_long_press (priv);
+    if (waiting) {
+        gint32 delay = (gint32)(due - time);
+        priv->long_press_due = due;
+        priv->long_press_source = g_timeout_add (MAX (delay, 0),
+                                                 on_long_press, self);
+    }
 }
 
 static void depress(EekGtkKeyboard *self,
@@ -158,9 +337,13 @@ static void depress(EekGtkKeyboard *self,
     if (!priv->keyboard) {
         return;
     }
-    squeek_layout_depress(priv->keyboard->layout,
-                          priv->submission,
-                          x, y, priv->render_geometry.widget_to_layout, time, self);
+    if (squeek_layout_depress(priv->keyboard->layout,
+                              priv->submission,
+                              x, y, priv->render_geometry.widget_to_layout, time, self)) {
+        priv->press_pending = TRUE;
+        priv->press_time = time;
+    }
+    update_long_press(self, time);
 }
 
 static void drag(EekGtkKeyboard *self,
@@ -174,6 +357,7 @@ static void drag(EekGtkKeyboard *self,
                        priv->submission,
                        x, y, priv->render_geometry.widget_to_layout, time,
                        priv->popover, priv->state_manager, self);
+    update_long_press(self, time);
 }
 
 static void release(EekGtkKeyboard *self, guint32 time)
@@ -185,6 +369,7 @@ static void release(EekGtkKeyboard *self, guint32 time)
     squeek_layout_release(eekboard_context_service_get_keyboard(priv->eekboard_context)->layout,
                           priv->submission, priv->render_geometry.widget_to_layout, time,
                           priv->popover, priv->state_manager, self);
+    cancel_long_press(priv);
 }
 
 static gboolean
@@ -192,6 +377,8 @@ eek_gtk_keyboard_real_button_press_event (GtkWidget      *self,
                                           GdkEventButton *event)
 {
     if (event->type == GDK_BUTTON_PRESS && event->button == 1) {
+        record(EEK_GTK_KEYBOARD(self), SQUEEK_TOUCH_PRESS, NULL,
+               event->x, event->y, event->time);
         depress(EEK_GTK_KEYBOARD(self), event->x, event->y, event->time);
     }
     return TRUE;
@@ -203,6 +390,8 @@ eek_gtk_keyboard_real_button_release_event (GtkWidget      *self,
                                             GdkEventButton *event)
 {
     if (event->type == GDK_BUTTON_RELEASE && event->button == 1) {
+        record(EEK_GTK_KEYBOARD(self), SQUEEK_TOUCH_RELEASE, NULL,
+               event->x, event->y, event->time);
         // TODO: can the event have different coords than the previous move event?
         release(EEK_GTK_KEYBOARD(self), event->time);
     }
@@ -214,6 +403,8 @@ eek_gtk_keyboard_leave_event (GtkWidget      *self,
                               GdkEventCrossing *event)
 {
     if (event->type == GDK_LEAVE_NOTIFY) {
+        record(EEK_GTK_KEYBOARD(self), SQUEEK_TOUCH_RELEASE, NULL,
+               event->x, event->y, event->time);
         // TODO: can the event have different coords than the previous move event?
         release(EEK_GTK_KEYBOARD(self), event->time);
     }
@@ -226,6 +417,8 @@ eek_gtk_keyboard_real_motion_notify_event (GtkWidget      *self,
                                            GdkEventMotion *event)
 {
     if (event->state & GDK_BUTTON1_MASK) {
+        record(EEK_GTK_KEYBOARD(self), SQUEEK_TOUCH_DRAG, NULL,
+               event->x, event->y, event->time);
         drag(EEK_GTK_KEYBOARD(self), event->x, event->y, event->time);
     }
     return TRUE;
@@ -239,6 +432,25 @@ handle_touch_event (GtkWidget     *widget,
     EekGtkKeyboard        *self = EEK_GTK_KEYBOARD (widget);
     EekGtkKeyboardPrivate *priv = eek_gtk_keyboard_get_instance_private (self);
 
+    /* Record everything, the filtering below gets replayed too. */
+    switch (event->type) {
+    case GDK_TOUCH_BEGIN:
+        record(self, SQUEEK_TOUCH_PRESS, event->sequence,
+               event->x, event->y, event->time);
+        break;
+    case GDK_TOUCH_UPDATE:
+        record(self, SQUEEK_TOUCH_DRAG, event->sequence,
+               event->x, event->y, event->time);
+        break;
+    case GDK_TOUCH_END:
+    case GDK_TOUCH_CANCEL:
+        record(self, SQUEEK_TOUCH_RELEASE, event->sequence,
+               event->x, event->y, event->time);
+        break;
+    default:
+        break;
+    }
+
     /* For each new touch, release the previous one and record the new event
        sequence. */
     if (event->type == GDK_TOUCH_BEGIN) {
@@ -270,6 +482,8 @@ eek_gtk_keyboard_real_unmap (GtkWidget *self)
     EekGtkKeyboardPrivate *priv =
         eek_gtk_keyboard_get_instance_private (EEK_GTK_KEYBOARD (self));
 
+    cancel_long_press (priv);
+
     if (priv->keyboard) {
         squeek_layout_release_all_only(
             priv->keyboard->layout,
@@ -312,6 +526,8 @@ eek_gtk_keyboard_dispose (GObject *object)
         priv->renderer = NULL;
     }
 
+    cancel_long_press (priv);
+
     if (priv->keyboard) {
         squeek_layout_release_all_only(
             priv->keyboard->layout,
@@ -325,9 +541,23 @@ eek_gtk_keyboard_dispose (GObject *object)
         lfb_uninit ();
     }
 
+    g_clear_pointer (&priv->recorder, squeek_recorder_free);
+
     G_OBJECT_CLASS (eek_gtk_keyboard_parent_class)->dispose (object);
 }
 
+static void
+eek_gtk_keyboard_finalize (GObject *object)
+{
+    EekGtkKeyboard        *self = EEK_GTK_KEYBOARD (object);
+    EekGtkKeyboardPrivate *priv = eek_gtk_keyboard_get_instance_private (self);
+
+    // Pending callbacks hold a reference, so they are all gone by now
+    g_clear_pointer (&priv->feedback, squeek_feedback_free);
+
+    G_OBJECT_CLASS (eek_gtk_keyboard_parent_class)->finalize (object);
+}
+
 static void
 eek_gtk_keyboard_class_init (EekGtkKeyboardClass *klass)
 {
@@ -351,6 +581,7 @@ eek_gtk_keyboard_class_init (EekGtkKeyboardClass *klass)
 
     gobject_class->set_property = eek_gtk_keyboard_set_property;
     gobject_class->dispose = eek_gtk_keyboard_dispose;
+    gobject_class->finalize = eek_gtk_keyboard_finalize;
 }
 
 static void
@@ -365,6 +596,9 @@ eek_gtk_keyboard_init (EekGtkKeyboard *self)
         g_warning ("Failed to init libfeedback: %s", err->message);
     }
 
+    priv->feedback = squeek_feedback_new ();
+    priv->recorder = squeek_recorder_new_from_env ();
+
     GtkIconTheme *theme = gtk_icon_theme_get_default ();
 
     gtk_icon_theme_add_resource_path (theme, "/sm/puri/squeekboard/icons");
@@ -438,7 +672,9 @@ eek_gtk_keyboard_new (EekboardContextService *eekservice,
 /**
  * eek_gtk_keyboard_emit_feedback:
  *
- * Emit button press haptic feedback via libfeedack.
+ * Request button press haptic feedback via libfeedack.
+ * Doesn't block: the feedback gets triggered from an idle callback,
+ * and requests made while one is outstanding get merged.
  */
 void
 eek_gtk_keyboard_emit_feedback (EekGtkKeyboard *self)
@@ -448,10 +684,7 @@ eek_gtk_keyboard_emit_feedback (EekGtkKeyboard *self)
     g_return_if_fail (EEK_IS_GTK_KEYBOARD (self));
 
     priv = eek_gtk_keyboard_get_instance_private (EEK_GTK_KEYBOARD (self));
-    if (priv->event) {
-        lfb_event_trigger_feedback_async (priv->event,
-                                          NULL,
-                                          (GAsyncReadyCallback)on_event_triggered,
-                                          NULL);
+    if (priv->event && squeek_feedback_request (priv->feedback)) {
+        schedule_feedback (self);
     }
 }
@@ -0,0 +1,32 @@
+/*! Compiles a word list into a prediction dictionary.
+ *
+ * Usage: build_dictionary <word list> <output>
+ *
+ * The word list has one word per line, optionally followed by its count.
+ */
+
+extern crate rs;
+
+use rs::predict;
+use std::env;
+use std::fs;
+
+fn main() -> () {
+    let input = env::args().nth(1).expect("No word list given");
+    let output = env::args().nth(2).expect("No output path given");
+    let text = fs::read_to_string(&input)
+        .expect("Can't read the word list");
+    let words: Vec<(String, u64)> = text.lines()
+        .filter_map(|line| {
+            let mut fields = line.split_whitespace();
+            let word = fields.next()?;
+            let count = fields.next()
+                .and_then(|c| c.parse().ok())
+                .unwrap_or(1);
+            Some((word.to_lowercase(), count))
+        })
+        .collect();
+    let data = predict::build(&words);
+    fs::write(&output, &data).expect("Can't write the dictionary");
+    println!("{} words, {} bytes", words.len(), data.len());
+}
@@ -0,0 +1,37 @@
+/*! Compiles a conversion list into a kanji dictionary.
+ *
+ * Usage: build_kanji_dictionary <conversion list> <output>
+ *
+ * Each line holds a reading in hiragana, its conversion,
+ * and optionally the cost of the conversion, separated by tabs.
+ */
+
+extern crate rs;
+
+use rs::kanji;
+use std::env;
+use std::fs;
+
+/// For conversions without a cost
+const DEFAULT_COST: u16 = 5000;
+
+fn main() -> () {
+    let input = env::args().nth(1).expect("No conversion list given");
+    let output = env::args().nth(2).expect("No output path given");
+    let text = fs::read_to_string(&input)
+        .expect("Can't read the conversion list");
+    let words: Vec<(String, String, u16)> = text.lines()
+        .filter_map(|line| {
+            let mut fields = line.split('\t');
+            let reading = fields.next()?;
+            let converted = fields.next()?;
+            let cost = fields.next()
+                .and_then(|c| c.trim().parse().ok())
+                .unwrap_or(DEFAULT_COST);
+            Some((reading.into(), converted.into(), cost))
+        })
+        .collect();
+    let data = kanji::build(&words);
+    fs::write(&output, &data).expect("Can't write the dictionary");
+    println!("{} conversions, {} bytes", words.len(), data.len());
+}
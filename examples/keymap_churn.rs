@@ -0,0 +1,48 @@
+/*! Types a text through the keymaps of built-in layouts.
+ *
+ * Usage: keymap_churn <text file> [layout...]
+ *
+ * Shows what typing the text would cost applications
+ * without text input support, per 1000 typed characters:
+ * keymap swaps, each of which sends a new keymap and resets modifiers,
+ * and Shift changes for symbols on the Shift level of keycodes.
+ * Characters missing from a layout are skipped.
+ * Without layout names, all built-in layouts are used.
+ */
+
+extern crate rs;
+
+use rs::resources;
+use rs::tests::type_through_builtin_layout;
+use std::env;
+use std::fs;
+
+fn per_1000(count: u64, typed: u64) -> f64 {
+    match typed {
+        0 => 0.0,
+        typed => count as f64 * 1000.0 / typed as f64,
+    }
+}
+
+fn main() -> () {
+    let path = env::args().nth(1).expect("No text given");
+    let text = fs::read_to_string(&path).expect("Can't read the text");
+    let names: Vec<String> = env::args().skip(2).collect();
+    let names = match names.is_empty() {
+        true => resources::get_keyboards().into_iter().map(String::from).collect(),
+        false => names,
+    };
+
+    println!("layout\ttyped\tmissing\tswaps\tshift changes");
+    for name in names {
+        let report = type_through_builtin_layout(&name, &text);
+        println!(
+            "{}\t{}\t{}\t{:.1}\t{:.1}",
+            name,
+            report.typed,
+            report.missing,
+            per_1000(report.swaps, report.typed),
+            per_1000(report.shift_changes, report.typed),
+        );
+    }
+}
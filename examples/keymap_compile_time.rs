@@ -0,0 +1,63 @@
+/*! Measures how long applications take to compile the keymaps of layouts.
+ *
+ * Usage: keymap_compile_time [layout...]
+ *
+ * Each keymap gets compiled the way applications do it on a keymap change,
+ * in the readable style and in the compact style sent to the compositor.
+ * Without layout names, all built-in layouts are measured.
+ */
+
+extern crate rs;
+extern crate xkbcommon;
+
+use rs::resources;
+use rs::tests::builtin_layout_keymap_texts;
+use std::env;
+use std::time::{ Duration, Instant };
+use xkbcommon::xkb;
+
+/// Compilations of each keymap, to even out the noise
+const ROUNDS: u32 = 20;
+
+/// Average time to compile all the keymaps
+fn measure(keymaps: &[String]) -> Duration {
+    let context = xkb::Context::new(xkb::CONTEXT_NO_FLAGS);
+    let start = Instant::now();
+    for _ in 0..ROUNDS {
+        for keymap in keymaps {
+            xkb::Keymap::new_from_string(
+                &context,
+                keymap.clone(),
+                xkb::KEYMAP_FORMAT_TEXT_V1,
+                xkb::KEYMAP_COMPILE_NO_FLAGS,
+            ).expect("Keymap doesn't compile");
+        }
+    }
+    start.elapsed() / ROUNDS
+}
+
+fn bytes(keymaps: &[String]) -> usize {
+    keymaps.iter().map(String::len).sum()
+}
+
+fn main() -> () {
+    let names: Vec<String> = env::args().skip(1).collect();
+    let names = match names.is_empty() {
+        true => resources::get_keyboards().into_iter().map(String::from).collect(),
+        false => names,
+    };
+
+    println!("layout\tkeymaps\treadable bytes\treadable µs\tcompact bytes\tcompact µs");
+    for name in names {
+        let (readable, compact) = builtin_layout_keymap_texts(&name);
+        println!(
+            "{}\t{}\t{}\t{}\t{}\t{}",
+            name,
+            compact.len(),
+            bytes(&readable),
+            measure(&readable).as_micros(),
+            bytes(&compact),
+            measure(&compact).as_micros(),
+        );
+    }
+}
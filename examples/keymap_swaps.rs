@@ -0,0 +1,58 @@
+/*! Reports how built-in layouts fit in keymaps.
+ *
+ * Usage: keymap_swaps [--corpus <text file>] [layout...]
+ *
+ * For each layout, shows the number of keymaps
+ * and the keymap swaps expected per 1000 typed characters,
+ * with only the base level of keycodes and with the Shift level too.
+ * Character frequencies come from the corpus if given;
+ * otherwise all symbols are typed equally often.
+ * Without layout names, all built-in layouts are reported.
+ */
+
+extern crate rs;
+
+use rs::resources;
+use rs::tests::report_builtin_layout_keymaps;
+use std::collections::HashMap;
+use std::env;
+use std::fs;
+
+fn main() -> () {
+    let mut args = env::args().skip(1).peekable();
+    let frequencies = match args.peek().map(String::as_str) {
+        Some("--corpus") => {
+            args.next();
+            let path = args.next().expect("No corpus given");
+            let text = fs::read_to_string(&path)
+                .expect("Can't read the corpus");
+            let mut counts = HashMap::<char, f64>::new();
+            for c in text.chars() {
+                *counts.entry(c).or_insert(0.0) += 1.0;
+            }
+            Some(counts)
+        },
+        _ => None,
+    };
+    let names: Vec<String> = args.collect();
+    let names = match names.is_empty() {
+        true => resources::get_keyboards().into_iter().map(String::from).collect(),
+        false => names,
+    };
+
+    println!("layout\tsymbols\tkeymaps\tswaps\tshift keymaps\tshift swaps\tshifted %");
+    for name in names {
+        let base = report_builtin_layout_keymaps(&name, false, frequencies.as_ref());
+        let shift = report_builtin_layout_keymaps(&name, true, frequencies.as_ref());
+        println!(
+            "{}\t{}\t{}\t{:.1}\t{}\t{:.1}\t{:.1}",
+            name,
+            base.symbols,
+            base.keymaps,
+            base.swaps_per_1000,
+            shift.keymaps,
+            shift.swaps_per_1000,
+            shift.shifted * 100.0,
+        );
+    }
+}
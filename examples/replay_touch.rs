@@ -0,0 +1,30 @@
+/*! Replays a recorded touch stream against a layout, without a compositor.
+ *
+ * Usage: replay_touch <layout> <recording> [im] [wide]
+ *
+ * With `im`, the input method is treated as active.
+ */
+
+extern crate rs;
+
+use rs::replay;
+use std::env;
+use std::path::PathBuf;
+
+fn main() -> () {
+    let layout = env::args().nth(1).expect("No layout name given");
+    let path = env::args().nth(2).map(PathBuf::from)
+        .expect("No recording given");
+    let flags: Vec<String> = env::args().skip(3).collect();
+    let has_flag = |name: &str| flags.iter().any(|f| f == name);
+
+    let kind = match has_flag("wide") {
+        true => replay::ArrangementKind::Wide,
+        false => replay::ArrangementKind::Base,
+    };
+
+    match replay::run_file(&layout, kind, &path, has_flag("im")) {
+        Ok(report) => println!("{}", report),
+        Err(e) => panic!("Can't replay {:?}: {}", path, e),
+    }
+}
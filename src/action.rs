@@ -68,6 +68,20 @@ impl Action {
             _ => false,
         }
     }
+    /// Whether holding the button should repeat it
+    pub fn repeats(&self) -> bool {
+        match self {
+            Action::Erase => true,
+            Action::Submit { text: None, keys } => match keys.as_slice() {
+                [key] => matches!(
+                    key.0.as_str(),
+                    "Left" | "Right" | "Up" | "Down",
+                ),
+                _ => false,
+            },
+            _ => false,
+        }
+    }
     pub fn is_active(&self, view_name: &str) -> bool {
         match self {
             Action::SetView(view) => view == view_name,
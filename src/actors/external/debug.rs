@@ -3,9 +3,15 @@
  *
  * SPDX-License-Identifier: GPL-3.0-or-later
  */
+use crate::automation;
+use crate::feedback;
+use crate::latency;
 use crate::main;
 use crate::state;
+use crate::submission;
+use crate::vkeyboard;
 
+use std::sync::atomic::Ordering;
 use std::thread;
 use zbus::{Connection, ObjectServer, dbus_interface, fdo};
 
@@ -18,6 +24,7 @@ use std::convert::TryInto;
 struct Manager {
     sender: main::EventLoop,
     enabled: bool,
+    keymap_churn: vkeyboard::ChurnStats,
 }
 
 #[dbus_interface(name = "sm.puri.SqueekDebug")]
@@ -29,6 +36,7 @@ impl Manager {
     #[dbus_interface(property, name = "Enabled")]
     fn set_enabled(&mut self, enabled: bool) {
         self.enabled = enabled;
+        automation::DEBUG_ENABLED.store(enabled, Ordering::Relaxed);
         self.sender
             .send(state::Event::Debug(
                 if enabled { Event::Enable }
@@ -36,6 +44,72 @@ impl Manager {
             ))
             .unwrap();
     }
+    #[dbus_interface(property, name = "FeedbackTriggered")]
+    fn get_feedback_triggered(&self) -> u64 {
+        feedback::TRIGGERED.load(Ordering::Relaxed)
+    }
+    /// Feedback requests folded into another trigger
+    #[dbus_interface(property, name = "FeedbackMerged")]
+    fn get_feedback_merged(&self) -> u64 {
+        feedback::MERGED.load(Ordering::Relaxed)
+    }
+    #[dbus_interface(property, name = "FeedbackDropped")]
+    fn get_feedback_dropped(&self) -> u64 {
+        feedback::DROPPED.load(Ordering::Relaxed)
+    }
+    /// Key presses submitted as keycodes
+    #[dbus_interface(property, name = "KeycodePresses")]
+    fn get_keycode_presses(&self) -> u64 {
+        submission::KEYCODE_PRESSES.load(Ordering::Relaxed)
+    }
+    /// Keymap switches caused by key presses and releases
+    #[dbus_interface(property, name = "KeymapSwaps")]
+    fn get_keymap_swaps(&self) -> u64 {
+        submission::KEYMAP_SWAPS.load(Ordering::Relaxed)
+    }
+    /// Keymaps sent to the compositor, including those of new layouts
+    #[dbus_interface(property, name = "KeymapUpdates")]
+    fn get_keymap_updates(&self) -> u64 {
+        submission::KEYMAP_UPDATES.load(Ordering::Relaxed)
+    }
+    /// Text changes committed through the input method, in batches
+    #[dbus_interface(property, name = "TextCommits")]
+    fn get_text_commits(&self) -> u64 {
+        submission::TEXT_COMMITS.load(Ordering::Relaxed)
+    }
+    /// Presses by the time until they showed on the screen:
+    /// the upper bound of each bucket in milliseconds, and the count
+    #[dbus_interface(property, name = "PressLatency")]
+    fn get_press_latency(&self) -> Vec<(u32, u64)> {
+        latency::get_histogram()
+    }
+    /// Frames showing a press which never reached the screen
+    #[dbus_interface(property, name = "PressLatencyDiscarded")]
+    fn get_press_latency_discarded(&self) -> u64 {
+        latency::DISCARDED.load(Ordering::Relaxed)
+    }
+    /// Presses whose presentation time made no sense
+    #[dbus_interface(property, name = "PressLatencyUnmatched")]
+    fn get_press_latency_unmatched(&self) -> u64 {
+        latency::UNMATCHED.load(Ordering::Relaxed)
+    }
+    /// For each layout: its name, keymap updates, keymap switches,
+    /// bytes of keymaps sent, and microseconds spent loading keymaps
+    #[dbus_interface(name = "KeymapChurn")]
+    fn keymap_churn(&self) -> Vec<(String, u64, u64, u64, u64)> {
+        match self.keymap_churn.lock() {
+            Ok(churn) => churn.iter()
+                .map(|(name, churn)| (
+                    name.clone(),
+                    churn.updates,
+                    churn.swaps,
+                    churn.bytes,
+                    churn.time.as_micros() as u64,
+                ))
+                .collect(),
+            Err(_) => Vec::new(),
+        }
+    }
 }
 
 fn start(mgr: Manager) -> Result<Void, Box<dyn std::error::Error>> {
@@ -55,10 +129,11 @@ fn start(mgr: Manager) -> Result<Void, Box<dyn std::error::Error>> {
     }
 }
 
-pub fn init(sender: main::EventLoop) {
+pub fn init(sender: main::EventLoop, keymap_churn: vkeyboard::ChurnStats) {
     let mgr = Manager {
         sender,
         enabled: false,
+        keymap_churn,
     };
     thread::spawn(move || {
         start(mgr).unwrap();
@@ -0,0 +1,221 @@
+/* Copyright (C) 2026 Purism SPC
+ * SPDX-License-Identifier: GPL-3.0+
+ */
+
+/*! Typing on request, for automated tests.
+ *
+ * Text and button names turn into taps on the buttons of the layout,
+ * including those switching views on the way,
+ * and go through the same submission as touches do.
+ * What got sent out is counted along the way,
+ * so that throughput can be measured without touch events.
+ *
+ * Anyone on the session bus could type into any application that way,
+ * so it only works in debug mode, or when enabled by the environment.
+ */
+
+use std::env;
+use std::sync::atomic::{ AtomicBool, Ordering };
+use std::time::Instant;
+
+use crate::action::{ Action, KeySym };
+use crate::batch;
+use crate::layout::{ Button, Layout };
+use crate::layout::seat;
+use crate::logging;
+use crate::repeat;
+use crate::submission;
+use crate::submission::{ Submission, Timestamp };
+
+/// Setting it to `1` allows typing on request outside of debug mode
+const ENV_VAR: &str = "SQUEEKBOARD_AUTOMATION";
+
+/// Follows the debug mode
+pub static DEBUG_ENABLED: AtomicBool = AtomicBool::new(false);
+
+fn is_allowed() -> bool {
+    DEBUG_ENABLED.load(Ordering::Relaxed)
+        || env::var(ENV_VAR).map(|v| v == "1").unwrap_or(false)
+}
+
+/// What typing took
+#[repr(C)]
+#[derive(Clone, Debug, Default, PartialEq)]
+pub struct Report {
+    /// Including those switching views
+    pub taps: u32,
+    /// Characters or names without a button
+    pub missing: u32,
+    pub keycode_presses: u32,
+    pub keymap_updates: u32,
+    pub text_commits: u32,
+    /// Until everything got sent
+    pub microseconds: u64,
+}
+
+/// Gathers stuff defined in C or called by C
+pub mod c {
+    use super::*;
+
+    use std::os::raw::c_char;
+
+    use crate::submission::c::Submission as CSubmission;
+    use crate::util::c::as_str;
+
+    #[no_mangle]
+    pub extern "C"
+    fn squeek_automation_is_allowed() -> u8 {
+        is_allowed() as u8
+    }
+
+    fn with_submission<F>(submission: CSubmission, f: F) -> Report
+        where F: FnOnce(&mut Submission) -> Report
+    {
+        let submission_ref = submission.clone_ref();
+        let report = f(&mut *submission_ref.borrow_mut());
+        repeat::arm_timer(&submission_ref);
+        batch::arm_timer(&submission_ref);
+        report
+    }
+
+    #[no_mangle]
+    pub extern "C"
+    fn squeek_layout_type_text(
+        layout: *mut Layout,
+        submission: CSubmission,
+        text: *const c_char,
+        time: u32,
+    ) -> Report {
+        let layout = unsafe { &mut *layout };
+        match as_str(&text) {
+            Ok(Some(text)) => with_submission(submission, |submission| {
+                type_text(layout, submission, text, Timestamp(time))
+            }),
+            _ => {
+                log_print!(logging::Level::Warning, "Text to type is invalid");
+                Report::default()
+            },
+        }
+    }
+
+    /// `names` ends with a null pointer
+    #[no_mangle]
+    pub extern "C"
+    fn squeek_layout_type_buttons(
+        layout: *mut Layout,
+        submission: CSubmission,
+        names: *const *const c_char,
+        time: u32,
+    ) -> Report {
+        let layout = unsafe { &mut *layout };
+        let mut valid = Vec::new();
+        for idx in 0.. {
+            let name = unsafe { *names.offset(idx) };
+            match as_str(&name) {
+                Ok(Some(name)) => valid.push(name),
+                Ok(None) => break,
+                Err(_) => log_print!(
+                    logging::Level::Warning,
+                    "Button name to type is invalid",
+                ),
+            }
+        }
+        with_submission(submission, |submission| {
+            type_buttons(layout, submission, &valid, Timestamp(time))
+        })
+    }
+}
+
+/// Whether the button types the character.
+/// Some control characters have keys of their own.
+fn types_char(button: &Button, c: char) -> bool {
+    let mut buffer = [0; 4];
+    match (&button.action, c) {
+        (Action::Submit { text: Some(text), keys: _ }, c) => {
+            text.as_bytes() == c.encode_utf8(&mut buffer).as_bytes()
+        },
+        (Action::Submit { text: None, keys }, '\n' | '\t') => {
+            match keys.as_slice() {
+                [KeySym(name)] => name == match c {
+                    '\n' => "Return",
+                    _ => "Tab",
+                },
+                _ => false,
+            }
+        },
+        (Action::Erase, '\u{8}') => true,
+        _ => false,
+    }
+}
+
+/// Taps a button for each target in turn.
+/// Targets without a matching button are skipped.
+fn tap_each<T, I, F>(
+    layout: &mut Layout,
+    submission: &mut Submission,
+    time: Timestamp,
+    targets: I,
+    matches: F,
+) -> Report
+    where I: Iterator<Item=T>,
+        F: Fn(&Button, &T) -> bool,
+{
+    let counters = || [
+        &submission::KEYCODE_PRESSES,
+        &submission::KEYMAP_UPDATES,
+        &submission::TEXT_COMMITS,
+    ].map(|counter| counter.load(Ordering::Relaxed));
+    let before = counters();
+    let start = Instant::now();
+    let mut report = Report::default();
+    for target in targets {
+        match layout.find_taps(|button| matches(button, &target)) {
+            Some(taps) => for position in taps {
+                seat::handle_press_key(layout, submission, time, &position);
+                seat::handle_release_key(
+                    layout,
+                    submission,
+                    None,
+                    time,
+                    None,
+                    &position,
+                );
+                report.taps += 1;
+            },
+            None => report.missing += 1,
+        }
+    }
+    // Batched text counts too
+    submission.flush_text();
+    report.microseconds = start.elapsed().as_micros() as u64;
+    let after = counters();
+    report.keycode_presses = (after[0] - before[0]) as u32;
+    report.keymap_updates = (after[1] - before[1]) as u32;
+    report.text_commits = (after[2] - before[2]) as u32;
+    report
+}
+
+/// Types the text one character at a time.
+/// Line breaks and tabs use their keys, and backspace erases.
+pub fn type_text(
+    layout: &mut Layout,
+    submission: &mut Submission,
+    text: &str,
+    time: Timestamp,
+) -> Report {
+    tap_each(layout, submission, time, text.chars(), |button, c| {
+        types_char(button, *c)
+    })
+}
+
+/// Taps the buttons with those names
+pub fn type_buttons(
+    layout: &mut Layout,
+    submission: &mut Submission,
+    names: &[&str],
+    time: Timestamp,
+) -> Report {
+    tap_each(layout, submission, time, names.iter(), |button, name| {
+        button.name.as_bytes() == name.as_bytes()
+    })
+}
@@ -0,0 +1,252 @@
+/* Copyright (C) 2026 Purism SPC
+ * SPDX-License-Identifier: GPL-3.0+
+ */
+
+/*! Batching of text sent through the input method.
+ *
+ * Every input method commit makes the application process its text again.
+ * Text typed in quick succession gets collected for a short window instead,
+ * and then sent as a single commit.
+ * Before the input method state changes, the batch gets sent right away,
+ * so that it reaches the text field it was typed into.
+ *
+ * A commit can only hold one deletion before the cursor,
+ * followed by one string to insert.
+ * Erasing text which hasn't been sent yet only shortens the string,
+ * and only erasing further than that grows the deletion.
+ *
+ * Anything sent as key presses must not overtake the text typed before,
+ * so the batch gets sent first.
+ */
+
+use std::cell::RefCell;
+use std::env;
+use std::rc::{ Rc, Weak };
+use std::time::{ Duration, Instant };
+
+use crate::grapheme;
+use crate::logging;
+use crate::repeat;
+use crate::submission::Submission;
+
+// Traits
+use crate::logging::Warn;
+
+/// About one frame
+const DEFAULT_WINDOW_MS: u32 = 16;
+
+/// In milliseconds. 0 sends every change right away.
+pub static WINDOW_ENV_VAR: &str = "SQUEEKBOARD_COMMIT_WINDOW";
+
+#[derive(Debug, Clone, Copy, PartialEq)]
+pub struct Config {
+    pub window: Duration,
+}
+
+impl Config {
+    pub fn new(window_ms: u32) -> Config {
+        Config { window: Duration::from_millis(window_ms as u64) }
+    }
+
+    pub fn from_env() -> Config {
+        let window_ms = match env::var(WINDOW_ENV_VAR) {
+            Ok(value) => value.parse::<u32>()
+                .or_print(
+                    logging::Problem::Warning,
+                    &format!("{} is not a number", WINDOW_ENV_VAR),
+                )
+                .unwrap_or(DEFAULT_WINDOW_MS),
+            Err(_) => DEFAULT_WINDOW_MS,
+        };
+        Config::new(window_ms)
+    }
+}
+
+impl Default for Config {
+    fn default() -> Config {
+        Config::new(DEFAULT_WINDOW_MS)
+    }
+}
+
+/// What to send in one commit
+#[derive(Debug, Clone, PartialEq)]
+pub struct Commit {
+    /// Bytes before the cursor, deleted before inserting the text
+    pub delete: usize,
+    pub text: String,
+}
+
+struct Pending {
+    commit: Commit,
+    due: Instant,
+}
+
+pub struct Batch {
+    config: Config,
+    pending: Option<Pending>,
+}
+
+impl Batch {
+    pub fn new(config: Config) -> Batch {
+        Batch { config, pending: None }
+    }
+
+    fn get_pending(&mut self, now: Instant) -> &mut Commit {
+        let window = self.config.window;
+        &mut self.pending.get_or_insert_with(|| Pending {
+            commit: Commit { delete: 0, text: String::new() },
+            due: now + window,
+        }).commit
+    }
+
+    pub fn push_text(&mut self, text: &str, now: Instant) {
+        self.get_pending(now).text.push_str(text);
+    }
+
+    /// Erases `count` grapheme clusters before the cursor.
+    /// `before` is the text before the cursor,
+    /// as the application had it before this batch.
+    /// Returns false when there was nothing known to erase.
+    pub fn erase(&mut self, count: u32, before: &str, now: Instant) -> bool {
+        let commit = self.get_pending(now);
+        let mut left = count;
+        let mut erased = false;
+        while left > 0 && !commit.text.is_empty() {
+            let length = grapheme::len_before(&commit.text, commit.text.len());
+            commit.text.truncate(commit.text.len() - length);
+            left -= 1;
+            erased = true;
+        }
+        if left > 0 {
+            let cursor = before.len().saturating_sub(commit.delete);
+            let length = grapheme::erase_length(before, cursor, left);
+            commit.delete += length;
+            erased |= length > 0;
+        }
+        if commit.delete == 0 && commit.text.is_empty() {
+            self.pending = None;
+        }
+        erased
+    }
+
+    /// When the batch should be sent
+    pub fn next_due(&self) -> Option<Instant> {
+        self.pending.as_ref().map(|pending| pending.due)
+    }
+
+    /// Bytes which will get deleted before the cursor
+    pub fn get_pending_delete(&self) -> usize {
+        self.pending.as_ref()
+            .map(|pending| pending.commit.delete)
+            .unwrap_or(0)
+    }
+
+    pub fn take(&mut self) -> Option<Commit> {
+        self.pending.take().map(|pending| pending.commit)
+    }
+}
+
+thread_local! {
+    /// The only timer sending batches
+    static TIMER: RefCell<Option<glib::SourceId>> = RefCell::new(None);
+    /// Where input method state changes send the batch from
+    static SUBMISSION: RefCell<Weak<RefCell<Submission>>> = RefCell::new(Weak::new());
+}
+
+/// Makes input method state changes send the batch of `submission`.
+pub fn watch_input_method(submission: &Rc<RefCell<Submission>>) {
+    SUBMISSION.with(|watched| *watched.borrow_mut() = Rc::downgrade(submission));
+}
+
+/// Sends the pending batch while the input method state is still the old one.
+/// Call before the state changes.
+pub fn flush_before_state_change(focus_changes: bool) {
+    let submission = SUBMISSION.with(|watched| watched.borrow().upgrade());
+    if let Some(submission) = submission {
+        match submission.try_borrow_mut() {
+            Ok(mut submission) => submission.handle_input_method_change(focus_changes),
+            Err(_) => log_print!(
+                logging::Level::Bug,
+                "Submission busy during input method event, batch not sent",
+            ),
+        }
+    }
+}
+
+/// Makes sure the pending batch gets sent when due.
+/// Call after submitting anything.
+pub fn arm_timer(submission: &Rc<RefCell<Submission>>) {
+    let due = match submission.borrow().get_next_commit() {
+        Some(due) => due,
+        None => return,
+    };
+    TIMER.with(|timer| {
+        // An earlier timer checks again when it fires
+        if timer.borrow().is_some() {
+            return;
+        }
+        let delay = due.saturating_duration_since(Instant::now());
+        let submission = submission.clone();
+        let id = repeat::add_timeout(delay, move || {
+            TIMER.with(|timer| timer.borrow_mut().take());
+            submission.borrow_mut().handle_commit_due(Instant::now());
+            arm_timer(&submission);
+            glib::Continue(false)
+        });
+        *timer.borrow_mut() = Some(id);
+    });
+}
+
+#[cfg(test)]
+mod test {
+    use super::*;
+
+    #[test]
+    fn text_accumulates() {
+        let mut batch = Batch::new(Config::new(16));
+        let start = Instant::now();
+        batch.push_text("a", start);
+        batch.push_text("bc", start + Duration::from_millis(5));
+        assert_eq!(batch.next_due(), Some(start + Duration::from_millis(16)));
+        assert_eq!(
+            batch.take(),
+            Some(Commit { delete: 0, text: "abc".into() }),
+        );
+        assert_eq!(batch.next_due(), None);
+    }
+
+    #[test]
+    fn erase_shortens_text_first() {
+        let mut batch = Batch::new(Config::new(16));
+        let now = Instant::now();
+        batch.push_text("żó", now);
+        assert!(batch.erase(3, "abc", now));
+        assert_eq!(
+            batch.take(),
+            Some(Commit { delete: 1, text: "".into() }),
+        );
+    }
+
+    #[test]
+    fn erase_grows_deletion() {
+        let mut batch = Batch::new(Config::new(16));
+        let now = Instant::now();
+        assert!(batch.erase(1, "aż", now));
+        assert!(batch.erase(1, "aż", now));
+        assert_eq!(batch.get_pending_delete(), 3);
+        // Nothing left
+        assert!(!batch.erase(1, "aż", now));
+        batch.push_text("x", now);
+        assert_eq!(
+            batch.take(),
+            Some(Commit { delete: 3, text: "x".into() }),
+        );
+    }
+
+    #[test]
+    fn nothing_to_erase() {
+        let mut batch = Batch::new(Config::new(16));
+        assert!(!batch.erase(1, "", Instant::now()));
+        assert_eq!(batch.take(), None);
+    }
+}
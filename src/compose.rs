@@ -0,0 +1,192 @@
+/* Copyright (C) 2026 Purism SPC
+ * SPDX-License-Identifier: GPL-3.0+
+ */
+
+/*! Dead keys, combined with the next character before submitting.
+ *
+ * A dead key types nothing by itself.
+ * When the input method is active, the accent shows as preedit text,
+ * and the character typed next gets committed with the accent on it.
+ * Otherwise, the dead key goes to the application,
+ * which combines it using its compose table.
+ *
+ * Going the other way, an accented letter can be typed as a dead key
+ * followed by the plain letter, needing no keycode of its own.
+ */
+
+/// An accent typed before the letter
+#[derive(Debug, PartialEq)]
+pub struct DeadKey {
+    /// Name of the keysym
+    pub name: &'static str,
+    /// The accent on its own
+    pub spacing: char,
+    /// Letters taking the accent
+    bases: &'static str,
+    /// The same letters with the accent, in the same order
+    composed: &'static str,
+}
+
+impl DeadKey {
+    pub fn compose(&self, base: char) -> Option<char> {
+        self.bases.chars().position(|c| c == base)
+            .and_then(|idx| self.composed.chars().nth(idx))
+    }
+
+    /// Text typed by the dead key followed by `text`.
+    /// The accent stays on its own when it doesn't combine,
+    /// and when followed by a space.
+    pub fn apply(&self, text: &str) -> String {
+        let mut chars = text.chars();
+        let composed = match chars.next() {
+            Some(' ') => None,
+            Some(c) => self.compose(c),
+            None => None,
+        };
+        match composed {
+            Some(c) => format!("{}{}", c, chars.as_str()),
+            None => match text {
+                " " => self.spacing.to_string(),
+                text => format!("{}{}", self.spacing, text),
+            },
+        }
+    }
+}
+
+const DEAD_KEYS: &[DeadKey] = &[
+    DeadKey {
+        name: "dead_grave",
+        spacing: '`',
+        bases: "AEINOUWYaeinouwyΑΕΗΙΟΥΩαεηιουω",
+        composed: "ÀÈÌǸÒÙẀỲàèìǹòùẁỳᾺῈῊῚῸῪῺὰὲὴὶὸὺὼ",
+    },
+    DeadKey {
+        name: "dead_acute",
+        spacing: '´',
+        bases: "ACEGIKLMNOPRSUWYZacegiklmnoprsuwyzΑΕΗΙΟΥΩαεηιουω",
+        composed: "ÁĆÉǴÍḰĹḾŃÓṔŔŚÚẂÝŹáćéǵíḱĺḿńóṕŕśúẃýźΆΈΉΊΌΎΏάέήίόύώ",
+    },
+    DeadKey {
+        name: "dead_circumflex",
+        spacing: '^',
+        bases: "ACEGHIJOSUWYZaceghijosuwyz",
+        composed: "ÂĈÊĜĤÎĴÔŜÛŴŶẐâĉêĝĥîĵôŝûŵŷẑ",
+    },
+    DeadKey {
+        name: "dead_tilde",
+        spacing: '~',
+        bases: "AEINOUVYaeinouvy",
+        composed: "ÃẼĨÑÕŨṼỸãẽĩñõũṽỹ",
+    },
+    DeadKey {
+        name: "dead_macron",
+        spacing: '¯',
+        bases: "AEGIOUYaegiouyΑΙΥαιυ",
+        composed: "ĀĒḠĪŌŪȲāēḡīōūȳᾹῙῩᾱῑῡ",
+    },
+    DeadKey {
+        name: "dead_breve",
+        spacing: '˘',
+        bases: "AEGIOUaegiouΑΙΥαιυ",
+        composed: "ĂĔĞĬŎŬăĕğĭŏŭᾸῘῨᾰῐῠ",
+    },
+    DeadKey {
+        name: "dead_abovedot",
+        spacing: '˙',
+        bases: "ABCDEFGHIMNOPRSTWXYZabcdefghmnoprstwxyz",
+        composed: "ȦḂĊḊĖḞĠḢİṀṄȮṖṘṠṪẆẊẎŻȧḃċḋėḟġḣṁṅȯṗṙṡṫẇẋẏż",
+    },
+    DeadKey {
+        name: "dead_diaeresis",
+        spacing: '¨',
+        bases: "AEHIOUWXYaehiotuwxyΙΥιυ",
+        composed: "ÄËḦÏÖÜẄẌŸäëḧïöẗüẅẍÿΪΫϊϋ",
+    },
+    DeadKey {
+        name: "dead_abovering",
+        spacing: '˚',
+        bases: "AUauwy",
+        composed: "ÅŮåůẘẙ",
+    },
+    DeadKey {
+        name: "dead_doubleacute",
+        spacing: '˝',
+        bases: "OUou",
+        composed: "ŐŰőű",
+    },
+    DeadKey {
+        name: "dead_caron",
+        spacing: 'ˇ',
+        bases: "ACDEGHIKLNORSTUZacdeghijklnorstuz",
+        composed: "ǍČĎĚǦȞǏǨĽŇǑŘŠŤǓŽǎčďěǧȟǐǰǩľňǒřšťǔž",
+    },
+    DeadKey {
+        name: "dead_cedilla",
+        spacing: '¸',
+        bases: "CDEGHKLNRSTcdeghklnrst",
+        composed: "ÇḐȨĢḨĶĻŅŖŞŢçḑȩģḩķļņŗşţ",
+    },
+    DeadKey {
+        name: "dead_ogonek",
+        spacing: '˛',
+        bases: "AEIOUaeiou",
+        composed: "ĄĘĮǪŲąęįǫų",
+    },
+];
+
+/// The dead key with that keysym name
+pub fn find(name: &str) -> Option<&'static DeadKey> {
+    DEAD_KEYS.iter().find(|dead_key| dead_key.name == name)
+}
+
+/// The dead key and the letter which type the character together
+pub fn decompose(c: char) -> Option<(&'static DeadKey, char)> {
+    DEAD_KEYS.iter()
+        .filter_map(|dead_key| {
+            dead_key.composed.chars().position(|composed| composed == c)
+                .and_then(|idx| dead_key.bases.chars().nth(idx))
+                .map(|base| (dead_key, base))
+        })
+        .next()
+}
+
+#[cfg(test)]
+mod test {
+    use super::*;
+
+    #[test]
+    fn table_aligned() {
+        for dead_key in DEAD_KEYS {
+            assert_eq!(
+                dead_key.bases.chars().count(),
+                dead_key.composed.chars().count(),
+                "{}",
+                dead_key.name,
+            );
+        }
+    }
+
+    #[test]
+    fn combine() {
+        let acute = find("dead_acute").unwrap();
+        assert_eq!(acute.apply("e"), "é");
+        assert_eq!(acute.apply("ω"), "ώ");
+        assert_eq!(acute.apply(" "), "´");
+        assert_eq!(acute.apply("b"), "´b");
+        assert_eq!(find("dead_caron").unwrap().apply("Zx"), "Žx");
+        assert_eq!(find("dead_breve"), Some(&DEAD_KEYS[5]));
+        assert_eq!(find("acute"), None);
+    }
+
+    #[test]
+    fn round_trip() {
+        assert_eq!(decompose('ő'), Some((find("dead_doubleacute").unwrap(), 'o')));
+        assert_eq!(decompose('o'), None);
+        for dead_key in DEAD_KEYS {
+            for c in dead_key.composed.chars() {
+                let (found, base) = decompose(c).unwrap();
+                assert_eq!(found.compose(base), Some(c));
+            }
+        }
+    }
+}
@@ -4,22 +4,53 @@
 
 /*! Loading layout files */
 
+use std::cell::RefCell;
 use std::env;
+use std::ffi::CString;
 use std::fmt;
 use std::path::PathBuf;
+use std::rc::Rc;
+use std::thread;
+
+use xkbcommon::xkb;
 
 use super::{ Error, LoadError };
 use super::parsing;
+use super::parsing::SymbolSet;
 
 use crate::layout;
 use crate::layout::ArrangementKind;
 use crate::logging;
 use crate::xdg;
 use crate::imservice::ContentPurpose;
+use crate::keyboard::Packing;
 
 
 const FALLBACK_LAYOUT_NAME: &str = "us";
 
+/// Set to 1 to make layouts for the purposes below share keymaps
+const SHARED_KEYMAP_ENV_VAR: &str = "SQUEEKBOARD_SHARED_KEYMAP";
+
+/// Purposes whose layouts share the keymap of the text layout.
+/// Terminal layouts have many more symbols, and are overlays as well.
+const SHARED_KEYMAP_PURPOSES: &[ContentPurpose] = &[
+    ContentPurpose::Normal,
+    ContentPurpose::Email,
+    ContentPurpose::Number,
+    ContentPurpose::Pin,
+    ContentPurpose::Url,
+];
+
+/// Set to 1 to type accented letters as dead keys followed by the letter,
+/// when the input method is not available
+const DEAD_KEYS_ENV_VAR: &str = "SQUEEKBOARD_DEAD_KEYS";
+
+thread_local! {
+    /// Symbols of the layouts sharing a keymap, for the last name and kind
+    static SHARED_SYMBOLS: RefCell<Option<(String, ArrangementKind, Rc<SymbolSet>)>>
+        = RefCell::new(None);
+}
+
 
 #[derive(Debug, Clone, PartialEq)]
 enum DataSource {
@@ -27,6 +58,16 @@ enum DataSource {
     Resource(String),
 }
 
+impl DataSource {
+    /// Short, to tell layouts apart in statistics
+    fn name(&self) -> String {
+        match self {
+            DataSource::File(path) => path.display().to_string(),
+            DataSource::Resource(name) => name.clone(),
+        }
+    }
+}
+
 impl fmt::Display for DataSource {
     fn fmt(&self, f: &mut fmt::Formatter<'_>) -> fmt::Result {
         match self {
@@ -191,25 +232,134 @@ fn iter_layout_sources(
     to_layout_sources(paths, layout_storage)
 }
 
-fn load_layout_data(source: DataSource)
+fn validate_keymap(keymap: &CString) -> Result<(), LoadError> {
+    let context = xkb::Context::new(xkb::CONTEXT_NO_FLAGS);
+    let keymap = keymap.to_str().map_err(|_| LoadError::InvalidKeyMap)?;
+    xkb::Keymap::new_from_string(
+        &context,
+        keymap.into(),
+        xkb::KEYMAP_FORMAT_TEXT_V1,
+        xkb::KEYMAP_COMPILE_NO_FLAGS,
+    ).ok_or(LoadError::InvalidKeyMap)?;
+    Ok(())
+}
+
+/// Keymaps get sent to the compositor without compiling them first.
+/// Those of builtin layouts get checked by `tests::check_builtin_layout`.
+/// Several keymaps get compiled at the same time, each on its own thread.
+fn validate_keymaps(keymaps: &[CString]) -> Result<(), LoadError> {
+    if let [keymap] = keymaps {
+        return validate_keymap(keymap);
+    }
+    let workers: Vec<_> = keymaps.iter()
+        .cloned()
+        .map(|keymap| thread::spawn(move || validate_keymap(&keymap)))
+        .collect();
+    for worker in workers {
+        worker.join().unwrap_or(Err(LoadError::InvalidKeyMap))?;
+    }
+    Ok(())
+}
+
+fn load_unbuilt_layout(source: DataSource)
+    -> Result<parsing::Layout, LoadError>
+{
+    match source {
+        DataSource::File(path) => parsing::Layout::from_file(path)
+            .map_err(LoadError::BadData),
+        DataSource::Resource(name) => parsing::Layout::from_resource(&name),
+    }
+}
+
+fn get_packing() -> Packing<'static> {
+    Packing {
+        dead_keys: env::var(DEAD_KEYS_ENV_VAR).map(|v| v == "1").unwrap_or(false),
+        ..Packing::for_layouts()
+    }
+}
+
+fn load_layout_data(source: DataSource, shared: &SymbolSet)
     -> Result<crate::layout::LayoutParseData, LoadError>
 {
     let handler = logging::Print {};
-    match source {
-        DataSource::File(path) => {
-            parsing::Layout::from_file(path.clone())
-                .map_err(LoadError::BadData)
-                .and_then(|layout|
-                    layout.build(handler).0.map_err(LoadError::BadKeyMap)
-                )
-        },
-        DataSource::Resource(name) => {
-            parsing::Layout::from_resource(&name)
-                .and_then(|layout|
-                    layout.build(handler).0.map_err(LoadError::BadKeyMap)
-                )
-        },
+    let is_file = matches!(source, DataSource::File(_));
+    let layout = load_unbuilt_layout(source)?
+        .build_with_packing(&get_packing(), shared, handler).0
+        .map_err(LoadError::BadKeyMap)?;
+    if is_file {
+        validate_keymaps(&layout.keymaps)?;
     }
+    Ok(layout)
+}
+
+/// Problems get reported when the layout gets built
+struct Quiet;
+
+impl logging::Handler for Quiet {
+    fn handle(&mut self, _level: logging::Level, _message: &str) {}
+}
+
+fn collect_shared_symbols(
+    name: &str,
+    kind: ArrangementKind,
+    path: Option<PathBuf>,
+    packing: &Packing,
+) -> SymbolSet {
+    let mut symbols = SymbolSet::default();
+    for purpose in SHARED_KEYMAP_PURPOSES {
+        let layout = iter_layout_sources(name, kind, *purpose, None, path.clone())
+            .find_map(|(_kind, source)| load_unbuilt_layout(source).ok());
+        if let Some(layout) = layout {
+            symbols.extend(layout.symbols(packing, &mut Quiet));
+        }
+    }
+    symbols
+}
+
+/// Symbols which the builtin layout of that name
+/// shares a keymap with, when `SHARED_KEYMAP_ENV_VAR` is set.
+/// Layouts for other purposes end up with the same keymap
+/// as the text layout, so only text layouts get any.
+pub fn builtin_shared_symbols(name: &str, packing: &Packing) -> Option<SymbolSet> {
+    if name.contains('/') {
+        return None;
+    }
+    let (name, kind) = match name.strip_suffix("_wide") {
+        Some(base) => (base, ArrangementKind::Wide),
+        None => (name, ArrangementKind::Base),
+    };
+    Some(collect_shared_symbols(name, kind, None, packing))
+}
+
+/// Collects the symbols of all layouts sharing a keymap
+/// with the layout of that name and kind.
+/// Switching between them then doesn't change the keymap.
+fn get_shared_symbols(
+    name: &str,
+    kind: ArrangementKind,
+    path: Option<PathBuf>,
+) -> Rc<SymbolSet> {
+    let cached = SHARED_SYMBOLS.with(|shared| {
+        shared.borrow().as_ref()
+            .filter(|(n, k, _)| n == name && *k == kind)
+            .map(|(_, _, symbols)| symbols.clone())
+    });
+    if let Some(symbols) = cached {
+        return symbols;
+    }
+    let symbols = Rc::new(collect_shared_symbols(name, kind, path, &get_packing()));
+    SHARED_SYMBOLS.with(|shared| {
+        *shared.borrow_mut() = Some((name.into(), kind, symbols.clone()));
+    });
+    symbols
+}
+
+fn shares_keymap(purpose: ContentPurpose, overlay: Option<&str>) -> bool {
+    let directory = get_directory_string(purpose, overlay);
+    env::var(SHARED_KEYMAP_ENV_VAR).map(|v| v == "1").unwrap_or(false)
+        && overlay.is_none()
+        && SHARED_KEYMAP_PURPOSES.iter()
+            .any(|p| get_directory_string(*p, None) == directory)
 }
 
 fn load_layout_data_with_fallback(
@@ -217,15 +367,20 @@ fn load_layout_data_with_fallback(
     kind: ArrangementKind,
     purpose: ContentPurpose,
     overlay: Option<&str>,
-) -> (ArrangementKind, layout::LayoutParseData) {
+) -> (ArrangementKind, String, layout::LayoutParseData) {
 
     // Build the path to the right keyboard layout subdirectory
     let path = env::var_os("SQUEEKBOARD_KEYBOARDSDIR")
         .map(PathBuf::from)
         .or_else(|| xdg::data_path("squeekboard/keyboards"));
 
+    let shared = match shares_keymap(purpose, overlay) {
+        true => get_shared_symbols(name, kind, path.clone()),
+        false => Rc::new(SymbolSet::default()),
+    };
+
     for (kind, source) in iter_layout_sources(&name, kind, purpose, overlay, path) {
-        let layout = load_layout_data(source.clone());
+        let layout = load_layout_data(source.clone(), &shared);
         match layout {
             Err(e) => match (e, source) {
                 (
@@ -244,7 +399,7 @@ fn load_layout_data_with_fallback(
             },
             Ok(layout) => {
                 log_print!(logging::Level::Info, "Loaded layout {}", source);
-                return (kind, layout);
+                return (kind, source.name(), layout);
             }
         }
     }
@@ -259,9 +414,11 @@ pub fn load_layout(
     overlay: &Option<String>,
 ) -> layout::Layout {
     let overlay = overlay.as_ref().map(String::as_str);
-    let (found_kind, layout)
+    let (found_kind, found_name, layout)
         = load_layout_data_with_fallback(name, kind, variant, overlay);
-    layout::Layout::new(layout, found_kind, variant)
+    let mut layout = layout::Layout::new(layout, found_kind, variant);
+    layout.shape.name = found_name;
+    layout
 }
 
 #[cfg(test)]
@@ -269,6 +426,7 @@ mod tests {
     use super::*;
 
     use crate::logging::ProblemPanic;
+    use std::collections::HashSet;
 
     #[test]
     fn parsing_fallback() {
@@ -387,4 +545,57 @@ mod tests {
             )
         );
     }
+
+    #[test]
+    fn shared_keymap_for_purposes() {
+        let shared = get_shared_symbols("us", ArrangementKind::Base, None);
+        let keymaps: Vec<Vec<CString>> = [
+            ContentPurpose::Normal,
+            ContentPurpose::Number,
+            ContentPurpose::Email,
+        ].iter()
+            .map(|purpose| {
+                let (_kind, source) = iter_layout_sources(
+                    "us", ArrangementKind::Base, *purpose, None, None,
+                ).next().unwrap();
+                load_layout_data(source, &shared).unwrap().keymaps
+            })
+            .collect();
+        assert_eq!(keymaps[0], keymaps[1]);
+        assert_eq!(keymaps[0], keymaps[2]);
+        // Cached
+        assert!(Rc::ptr_eq(
+            &shared,
+            &get_shared_symbols("us", ArrangementKind::Base, None),
+        ));
+    }
+
+    #[test]
+    fn dead_keys_replace_accented_letters() {
+        let layout = load_unbuilt_layout(DataSource::Resource("cz".into()))
+            .unwrap();
+        let count_symbols = |packing: &Packing| {
+            let names: HashSet<String> = layout.symbols(packing, &mut Quiet)
+                .names.into_iter()
+                .collect();
+            names.len()
+        };
+        let accented = count_symbols(&Packing::for_layouts());
+        let dead_keys = count_symbols(&Packing {
+            dead_keys: true,
+            ..Packing::for_layouts()
+        });
+        // Most letters with háček and čárka share a few dead keys
+        assert!(dead_keys + 30 < accented);
+    }
+
+    #[test]
+    fn dead_key_keymaps_compile() {
+        let packing = Packing { dead_keys: true, ..Packing::for_layouts() };
+        let layout = load_unbuilt_layout(DataSource::Resource("cz".into()))
+            .unwrap()
+            .build_with_packing(&packing, &SymbolSet::default(), logging::Print)
+            .0.unwrap();
+        validate_keymaps(&layout.keymaps).unwrap();
+    }
 }
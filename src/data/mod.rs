@@ -50,6 +50,8 @@ pub enum LoadError {
     MissingResource,
     BadResource(serde_yaml::Error),
     BadKeyMap(FormattingError),
+    /// The generated keymap doesn't compile
+    InvalidKeyMap,
 }
 
 impl fmt::Display for LoadError {
@@ -60,6 +62,7 @@ impl fmt::Display for LoadError {
             MissingResource => write!(f, "Missing resource"),
             BadResource(e) => write!(f, "Bad resource: {}", e),
             BadKeyMap(e) => write!(f, "Bad key map: {}", e),
+            InvalidKeyMap => write!(f, "Key map doesn't compile"),
         }
     }
 }
@@ -15,8 +15,10 @@ use xkbcommon::xkb;
 use super::{ Error, LoadError };
 
 use crate::action;
+use crate::compose;
 use crate::keyboard::{
-    Key, generate_keymaps, generate_keycodes, KeyCode, FormattingError
+    Key, generate_keymaps, generate_keycodes, KeyCode, FormattingError,
+    KeymapStyle, Packing,
 };
 use crate::layout;
 use crate::logging;
@@ -78,6 +80,9 @@ struct ButtonMeta {
     icon: Option<String>,
     /// The name of the outline. If not present, will be "default"
     outline: Option<String>,
+    /// Texts to choose from after a long press, e.g. accented letters
+    #[serde(default)]
+    alternates: Vec<String>,
 }
 
 #[derive(Debug, Deserialize, PartialEq, Clone)]
@@ -135,6 +140,20 @@ pub fn add_offsets<'a, I: 'a, T, F: 'a>(iterator: I, get_size: F)
     })
 }
 
+/// Names of keysyms, and those submitted together by one key
+#[derive(Debug, Clone, Default)]
+pub struct SymbolSet {
+    pub names: Vec<String>,
+    pub groups: Vec<Vec<String>>,
+}
+
+impl SymbolSet {
+    pub fn extend(&mut self, other: SymbolSet) {
+        self.names.extend(other.names);
+        self.groups.extend(other.groups);
+    }
+}
+
 impl Layout {
     pub fn from_resource(name: &str) -> Result<Layout, LoadError> {
         let data = resources::get_keyboard(name)
@@ -152,8 +171,33 @@ impl Layout {
         serde_yaml::from_reader(infile).map_err(Error::Yaml)
     }
 
-    pub fn build<H: logging::Handler>(self, mut warning_handler: H)
-        -> (Result<crate::layout::LayoutParseData, FormattingError>, H)
+    /// Symbols which the keys of the layout submit
+    pub(crate) fn symbols<H: logging::Handler>(
+        &self,
+        packing: &Packing,
+        warning_handler: &mut H,
+    ) -> SymbolSet {
+        let (button_actions, alternate_actions)
+            = self.create_actions(packing.dead_keys, warning_handler);
+        SymbolSet {
+            names: extract_symbol_names(&button_actions)
+                .chain(extract_symbol_names(&alternate_actions))
+                .collect(),
+            groups: extract_symbol_groups(&button_actions)
+                .chain(extract_symbol_groups(&alternate_actions))
+                .collect(),
+        }
+    }
+
+    /// Actions of buttons, and of their alternates
+    fn create_actions<H: logging::Handler>(
+        &self,
+        dead_keys: bool,
+        warning_handler: &mut H,
+    ) -> (
+            Vec<(&str, crate::action::Action)>,
+            Vec<(&str, crate::action::Action)>,
+        )
     {
         let button_names = self.views.values()
             .flat_map(|rows| {
@@ -171,48 +215,108 @@ impl Layout {
                     &self.buttons,
                     name,
                     self.views.keys().collect(),
-                    &mut warning_handler,
+                    dead_keys,
+                    warning_handler,
                 )
             )}).collect();
 
+        // Alternates get their keycodes now,
+        // so that a long press doesn't need to look anything up.
+        let alternate_actions: Vec<(&str, crate::action::Action)>
+            = button_names.iter()
+                .filter_map(|name| {
+                    self.buttons.get(*name).map(|meta| (*name, meta))
+                })
+                .flat_map(|(name, meta)| {
+                    meta.alternates.iter().map(move |text| (name, text))
+                })
+                .map(|(name, text)| (
+                    name,
+                    create_text_action(text, dead_keys, warning_handler),
+                ))
+                .collect();
+        (button_actions, alternate_actions)
+    }
+
+    pub fn build<H: logging::Handler>(self, warning_handler: H)
+        -> (Result<crate::layout::LayoutParseData, FormattingError>, H)
+    {
+        self.build_with_packing(
+            &Packing::for_layouts(),
+            &SymbolSet::default(),
+            warning_handler,
+        )
+    }
+
+    /// Like `build`, with a different distribution of symbols in keymaps.
+    /// Keymaps include the `shared` symbols too,
+    /// so that layouts sharing them get the same keymaps.
+    pub(crate) fn build_with_packing<H: logging::Handler>(
+        self,
+        packing: &Packing,
+        shared: &SymbolSet,
+        mut warning_handler: H,
+    ) -> (Result<crate::layout::LayoutParseData, FormattingError>, H) {
+        let (button_actions, alternate_actions)
+            = self.create_actions(packing.dead_keys, &mut warning_handler);
+
         let symbolmap: HashMap<String, KeyCode> = generate_keycodes(
             extract_symbol_names(&button_actions)
+                .chain(extract_symbol_names(&alternate_actions))
+                .chain(shared.names.iter().cloned()),
+            extract_symbol_groups(&button_actions)
+                .chain(extract_symbol_groups(&alternate_actions))
+                .chain(shared.groups.iter().cloned()),
+            packing,
         );
 
+        let get_keycodes = |name: &str, action: &crate::action::Action| {
+            match action {
+                crate::action::Action::Submit { text: _, keys } => {
+                    keys.iter().map(|named_keysym| {
+                        symbolmap.get(named_keysym.0.as_str())
+                            .expect(
+                                format!(
+                                    "keysym {} in key {} missing from symbol map",
+                                    named_keysym.0,
+                                    name
+                                ).as_str()
+                            )
+                            .clone()
+                    }).collect()
+                },
+                action::Action::Erase => vec![
+                    symbolmap.get("BackSpace")
+                        .expect(&format!("BackSpace missing from symbol map"))
+                        .clone(),
+                ],
+                _ => Vec::new(),
+            }
+        };
+
+        let mut alternate_states = HashMap::<String, Vec<Key>>::new();
+        for (name, action) in alternate_actions {
+            alternate_states.entry(name.into())
+                .or_insert_with(Vec::new)
+                .push(Key {
+                    keycodes: get_keycodes(name, &action),
+                    action,
+                });
+        }
+
         let button_states = HashMap::<String, Key>::from_iter(
             button_actions.into_iter().map(|(name, action)| {
-                let keycodes = match &action {
-                    crate::action::Action::Submit { text: _, keys } => {
-                        keys.iter().map(|named_keysym| {
-                            symbolmap.get(named_keysym.0.as_str())
-                                .expect(
-                                    format!(
-                                        "keysym {} in key {} missing from symbol map",
-                                        named_keysym.0,
-                                        name
-                                    ).as_str()
-                                )
-                                .clone()
-                        }).collect()
-                    },
-                    action::Action::Erase => vec![
-                        symbolmap.get("BackSpace")
-                            .expect(&format!("BackSpace missing from symbol map"))
-                            .clone(),
-                    ],
-                    _ => Vec::new(),
-                };
                 (
                     name.into(),
                     Key {
-                        keycodes,
+                        keycodes: get_keycodes(name, &action),
                         action,
                     }
                 )
             })
         );
 
-        let keymaps = match generate_keymaps(symbolmap) {
+        let keymaps = match generate_keymaps(symbolmap, KeymapStyle::Compact) {
             Err(e) => { return (Err(e), warning_handler) },
             Ok(v) => v,
         };
@@ -231,6 +335,9 @@ impl Layout {
                                 button_states_cache.get(name.into())
                                     .expect("Button state not created")
                                     .clone(),
+                                alternate_states.get(name)
+                                    .cloned()
+                                    .unwrap_or_default(),
                                 &mut warning_handler,
                             )
                         });
@@ -287,20 +394,21 @@ impl Layout {
     }
 }
 
+fn keysym_valid(name: &str) -> bool {
+    xkb::keysym_from_name(name, xkb::KEYSYM_NO_FLAGS) != xkb::KEY_NoSymbol
+}
+
 fn create_action<H: logging::Handler>(
     button_info: &HashMap<String, ButtonMeta>,
     name: &str,
     view_names: Vec<&String>,
+    dead_keys: bool,
     warning_handler: &mut H,
 ) -> crate::action::Action {
     let default_meta = ButtonMeta::default();
     let symbol_meta = button_info.get(name)
         .unwrap_or(&default_meta);
 
-    fn keysym_valid(name: &str) -> bool {
-        xkb::keysym_from_name(name, xkb::KEYSYM_NO_FLAGS) != xkb::KEY_NoSymbol
-    }
-    
     enum SubmitData {
         Action(Action),
         Text(String),
@@ -404,19 +512,8 @@ fn create_action<H: logging::Handler>(
                 }
             )),
         },
-        SubmitData::Text(text) => crate::action::Action::Submit {
-            text: CString::new(text.clone()).or_warn(
-                warning_handler,
-                logging::Problem::Warning,
-                &format!("Text {} contains problems", text),
-            ),
-            keys: text.chars().map(|codepoint| {
-                let codepoint_string = codepoint.to_string();
-                crate::action::KeySym(match keysym_valid(codepoint_string.as_str()) {
-                    true => codepoint_string,
-                    false => format!("U{:04X}", codepoint as u32),
-                })
-            }).collect(),
+        SubmitData::Text(text) => {
+            create_text_action(&text, dead_keys, warning_handler)
         },
         SubmitData::Modifier(modifier) => match modifier {
             Modifier::Control => action::Action::ApplyModifier(
@@ -444,6 +541,42 @@ fn create_action<H: logging::Handler>(
     }
 }
 
+fn char_keysym(codepoint: char) -> action::KeySym {
+    let codepoint_string = codepoint.to_string();
+    action::KeySym(match keysym_valid(codepoint_string.as_str()) {
+        true => codepoint_string,
+        false => format!("U{:04X}", codepoint as u32),
+    })
+}
+
+/// With `dead_keys`, a single accented letter
+/// gets submitted as a dead key followed by the plain letter.
+fn create_text_action<H: logging::Handler>(
+    text: &str,
+    dead_keys: bool,
+    warning_handler: &mut H,
+) -> crate::action::Action {
+    let mut chars = text.chars();
+    let decomposed = match (dead_keys, chars.next(), chars.next()) {
+        (true, Some(c), None) => compose::decompose(c),
+        _ => None,
+    };
+    crate::action::Action::Submit {
+        text: CString::new(text).or_warn(
+            warning_handler,
+            logging::Problem::Warning,
+            &format!("Text {} contains problems", text),
+        ),
+        keys: match decomposed {
+            Some((dead_key, base)) => vec![
+                action::KeySym(dead_key.name.into()),
+                char_keysym(base),
+            ],
+            None => text.chars().map(char_keysym).collect(),
+        },
+    }
+}
+
 /// TODO: Since this will receive user-provided data,
 /// all .expect() on them should be turned into soft fails
 fn create_button<H: logging::Handler>(
@@ -451,6 +584,7 @@ fn create_button<H: logging::Handler>(
     outlines: &HashMap<String, Outline>,
     name: &str,
     data: Key,
+    alternates: Vec<Key>,
     warning_handler: &mut H,
 ) -> crate::layout::Button {
     let cname = CString::new(name.clone())
@@ -503,17 +637,42 @@ fn create_button<H: logging::Handler>(
             "No default outline defined! Using 1x1!",
         ).unwrap_or(Outline { width: 1f64, height: 1f64 });
 
+    let outline_name = CString::new(outline_name).expect("Bad outline");
+    let size = layout::Size {
+        width: outline.width,
+        height: outline.height,
+    };
+
+    // Cells of the popup, looking like the button
+    let alternates = alternates.into_iter()
+        .map(|alternate| {
+            let label = match &alternate.action {
+                action::Action::Submit { text: Some(text), keys: _ } => {
+                    text.clone()
+                },
+                _ => CString::default(),
+            };
+            layout::Button {
+                name: cname.clone(),
+                outline_name: outline_name.clone(),
+                size: size.clone(),
+                label: crate::layout::Label::Text(label),
+                action: alternate.action,
+                keycodes: alternate.keycodes,
+                alternates: Vec::new(),
+            }
+        })
+        .collect();
+
     layout::Button {
         name: cname,
-        outline_name: CString::new(outline_name).expect("Bad outline"),
+        outline_name,
         // TODO: do layout before creating buttons
-        size: layout::Size {
-            width: outline.width,
-            height: outline.height,
-        },
+        size,
         label: label,
         action: data.action,
         keycodes: data.keycodes,
+        alternates,
     }
 }
 
@@ -534,6 +693,23 @@ fn extract_symbol_names<'a>(actions: &'a [(&str, action::Action)])
         .map(|named_keysym| named_keysym.0)
 }
 
+/// Symbols which get submitted together by a single key
+fn extract_symbol_groups<'a>(actions: &'a [(&str, action::Action)])
+    -> impl Iterator<Item=Vec<String>> + 'a
+{
+    actions.iter()
+        .filter_map(|(_name, act)| {
+            match act {
+                action::Action::Submit {
+                    text: _, keys,
+                } if keys.len() > 1 => Some(
+                    keys.iter().map(|named_keysym| named_keysym.0.clone()).collect()
+                ),
+                _ => None,
+            }
+        })
+}
+
 
 #[cfg(test)]
 mod tests {
@@ -578,6 +754,7 @@ mod tests {
                         modifier: None,
                         label: Some("test".into()),
                         outline: None,
+                        alternates: Vec::new(),
                     }
                 },
                 outlines: hashmap!{
@@ -715,6 +892,7 @@ mod tests {
                 },
                 ".",
                 Vec::new(),
+                false,
                 &mut ProblemPanic,
             ),
             crate::action::Action::Submit {
@@ -724,6 +902,31 @@ mod tests {
         );
     }
 
+    #[test]
+    fn test_text_dead_keys() {
+        assert_eq!(
+            create_text_action("é", true, &mut ProblemPanic),
+            crate::action::Action::Submit {
+                text: Some(CString::new("é").unwrap()),
+                keys: vec!(
+                    crate::action::KeySym("dead_acute".into()),
+                    crate::action::KeySym("e".into()),
+                ),
+            },
+        );
+        // Only single letters
+        assert_eq!(
+            create_text_action("éa", true, &mut ProblemPanic),
+            crate::action::Action::Submit {
+                text: Some(CString::new("éa").unwrap()),
+                keys: vec!(
+                    crate::action::KeySym("U00E9".into()),
+                    crate::action::KeySym("a".into()),
+                ),
+            },
+        );
+    }
+
     #[test]
     fn test_layout_margins() {
         let out = Layout::from_file(path_from_root("tests/layout_margins.yaml"))
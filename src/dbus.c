@@ -19,11 +19,16 @@
 #include "config.h"
 
 #include "dbus.h"
+#include "eek/eek-keyboard.h"
+#include "eekboard/eekboard-context-service.h"
+#include "layout.h"
 #include "main.h"
+#include "submission.h"
 
 #include <inttypes.h>
 #include <stdio.h>
 #include <gio/gio.h>
+#include <gtk/gtk.h>
 
 void
 dbus_handler_destroy(DBusHandler *service)
@@ -64,19 +69,156 @@ handle_set_visible(SmPuriOSK0 *object, GDBusMethodInvocation *invocation,
     return TRUE;
 }
 
+/// Reveals and types text, so only for debugging and automated tests.
+/// Returns FALSE after failing the invocation.
+static gboolean
+check_automation_allowed(GDBusMethodInvocation *invocation) {
+    if (!squeek_automation_is_allowed()) {
+        g_dbus_method_invocation_return_error_literal(invocation,
+                                                      G_DBUS_ERROR,
+                                                      G_DBUS_ERROR_ACCESS_DENIED,
+                                                      "Needs debug mode or SQUEEKBOARD_AUTOMATION=1");
+        return FALSE;
+    }
+    return TRUE;
+}
+
+static gboolean
+handle_get_suggestions(SmPuriOSK0 *object, GDBusMethodInvocation *invocation,
+                       guint arg_count, gpointer user_data) {
+    DBusHandler *service = user_data;
+
+    if (!check_automation_allowed(invocation)) {
+        return TRUE;
+    }
+
+    char *joined = submission_get_suggestions(service->submission, arg_count);
+    // Words never contain newlines
+    gchar **words = g_strsplit(joined, "\n", -1);
+    submission_free_suggestions(joined);
+
+    sm_puri_osk0_complete_get_suggestions(object, invocation,
+                                          (const gchar *const *)words);
+    g_strfreev(words);
+    return TRUE;
+}
+
+static gboolean
+handle_accept_suggestion(SmPuriOSK0 *object, GDBusMethodInvocation *invocation,
+                         const gchar *arg_word, gpointer user_data) {
+    DBusHandler *service = user_data;
+
+    if (!check_automation_allowed(invocation)) {
+        return TRUE;
+    }
+    submission_accept_suggestion(service->submission, arg_word);
+
+    sm_puri_osk0_complete_accept_suggestion(object, invocation);
+    return TRUE;
+}
+
+/// Returns the layout to type with,
+/// or NULL after failing the invocation.
+static struct squeek_layout *
+get_layout_to_type(DBusHandler *service, GDBusMethodInvocation *invocation) {
+    if (!check_automation_allowed(invocation)) {
+        return NULL;
+    }
+    Layout *keyboard = eekboard_context_service_get_keyboard(service->context);
+    if (!keyboard) {
+        g_dbus_method_invocation_return_error_literal(invocation,
+                                                      G_DBUS_ERROR,
+                                                      G_DBUS_ERROR_FAILED,
+                                                      "No layout loaded");
+        return NULL;
+    }
+    return keyboard->layout;
+}
+
+/// Typing may have switched the view on display
+static void
+queue_redraw_all(void) {
+    GList *windows = gtk_window_list_toplevels();
+    for (GList *window = windows; window; window = window->next) {
+        gtk_widget_queue_draw(GTK_WIDGET(window->data));
+    }
+    g_list_free(windows);
+}
+
+static uint32_t
+get_event_time(void) {
+    return (uint32_t)(g_get_monotonic_time() / 1000);
+}
+
+static gboolean
+handle_type_text(SmPuriOSK0 *object, GDBusMethodInvocation *invocation,
+                 const gchar *arg_text, gpointer user_data) {
+    DBusHandler *service = user_data;
+
+    struct squeek_layout *layout = get_layout_to_type(service, invocation);
+    if (!layout) {
+        return TRUE;
+    }
+    struct squeek_typing_report report = squeek_layout_type_text(
+                layout, service->submission, arg_text, get_event_time());
+    queue_redraw_all();
+
+    sm_puri_osk0_complete_type_text(object, invocation,
+                                    report.taps, report.missing,
+                                    report.keycode_presses,
+                                    report.keymap_updates,
+                                    report.text_commits,
+                                    report.microseconds);
+    return TRUE;
+}
+
+static gboolean
+handle_type_buttons(SmPuriOSK0 *object, GDBusMethodInvocation *invocation,
+                    const gchar *const *arg_names, gpointer user_data) {
+    DBusHandler *service = user_data;
+
+    struct squeek_layout *layout = get_layout_to_type(service, invocation);
+    if (!layout) {
+        return TRUE;
+    }
+    struct squeek_typing_report report = squeek_layout_type_buttons(
+                layout, service->submission, arg_names, get_event_time());
+    queue_redraw_all();
+
+    sm_puri_osk0_complete_type_buttons(object, invocation,
+                                       report.taps, report.missing,
+                                       report.keycode_presses,
+                                       report.keymap_updates,
+                                       report.text_commits,
+                                       report.microseconds);
+    return TRUE;
+}
+
 DBusHandler *
 dbus_handler_new (GDBusConnection *connection,
                       const gchar     *object_path,
-                  struct squeek_state_manager *state_manager)
+                  struct squeek_state_manager *state_manager,
+                  struct submission *submission,
+                  EekboardContextService *context)
 {
     DBusHandler *self = calloc(1, sizeof(DBusHandler));
     self->object_path = g_strdup(object_path);
     self->connection = connection;
     self->state_manager = state_manager;
+    self->submission = submission;
+    self->context = context;
 
     self->dbus_interface = sm_puri_osk0_skeleton_new();
     g_signal_connect(self->dbus_interface, "handle-set-visible",
                      G_CALLBACK(handle_set_visible), self);
+    g_signal_connect(self->dbus_interface, "handle-get-suggestions",
+                     G_CALLBACK(handle_get_suggestions), self);
+    g_signal_connect(self->dbus_interface, "handle-accept-suggestion",
+                     G_CALLBACK(handle_accept_suggestion), self);
+    g_signal_connect(self->dbus_interface, "handle-type-text",
+                     G_CALLBACK(handle_type_text), self);
+    g_signal_connect(self->dbus_interface, "handle-type-buttons",
+                     G_CALLBACK(handle_type_buttons), self);
 
     if (self->connection && self->object_path) {
         GError *error = NULL;
@@ -21,8 +21,11 @@
 
 #include "sm.puri.OSK0.h"
 
+#include "eek/eek-types.h"
+
 // From main.h
 struct squeek_state_manager;
+struct submission;
 
 G_BEGIN_DECLS
 
@@ -43,11 +46,17 @@ typedef struct _DBusHandler
 
     /// Forward incoming events there
     struct squeek_state_manager *state_manager; // shared reference
+    /// Text suggestions come from there
+    struct submission *submission; // shared reference
+    /// Holds the layout to type with
+    EekboardContextService *context; // shared reference
 } DBusHandler;
 
 DBusHandler * dbus_handler_new      (GDBusConnection *connection,
                                              const gchar     *object_path,
-                                     struct squeek_state_manager *state_manager);
+                                     struct squeek_state_manager *state_manager,
+                                     struct submission *submission,
+                                     EekboardContextService *context);
 
 void dbus_handler_destroy(DBusHandler*);
 G_END_DECLS
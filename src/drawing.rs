@@ -4,7 +4,9 @@ use cairo;
 
 use crate::action::{ Action, Modifier };
 use crate::keyboard;
-use crate::layout::{ Button, ButtonPosition, Label, LatchedState, Layout };
+use crate::layout::{
+    AlternatesPopup, Button, ButtonPosition, Label, LatchedState, Layout,
+};
 use crate::layout::c::{ Bounds, EekGtkKeyboard, Point };
 use crate::submission::c::Submission as CSubmission;
 
@@ -109,7 +111,14 @@ mod c {
                     state.pressed, locked,
                 );
             }
-        })
+        });
+
+        // On top of everything
+        if let Some(popup) = &layout.state.alternates {
+            if popup.shown {
+                render_alternates(renderer, &cr, layout, popup);
+            }
+        }
     }
     
     #[no_mangle]
@@ -223,6 +232,35 @@ fn render_button_at_position(
     cr.restore();
 }
 
+/// Draws the alternates in a row, all precomputed in the layout
+fn render_alternates(
+    renderer: c::EekRenderer,
+    cr: &cairo::Context,
+    layout: &Layout,
+    popup: &AlternatesPopup,
+) {
+    let button = match layout.shape.get_button(&popup.button) {
+        Some(button) => button,
+        None => return,
+    };
+    for (index, alternate) in button.alternates.iter().enumerate() {
+        let pressed = match popup.selected {
+            Some(selected) if selected == index => keyboard::PressType::Pressed,
+            _ => keyboard::PressType::Released,
+        };
+        render_button_at_position(
+            renderer, cr,
+            Point {
+                x: popup.origin.x + index as f64 * alternate.size.width,
+                y: popup.origin.y,
+            },
+            alternate,
+            pressed,
+            LockedStyle::Free,
+        );
+    }
+}
+
 fn with_button_context<R, F: FnOnce(&c::GtkStyleContext) -> R>(
     renderer: c::EekRenderer,
     button: &Button,
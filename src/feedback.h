@@ -0,0 +1,17 @@
+#ifndef __FEEDBACK_H
+#define __FEEDBACK_H
+
+#include "inttypes.h"
+
+struct squeek_feedback;
+
+// Defined in Rust
+struct squeek_feedback *squeek_feedback_new(void);
+void squeek_feedback_free(struct squeek_feedback *feedback);
+/// Returns whether the dispatch callback needs to be scheduled.
+uint8_t squeek_feedback_request(struct squeek_feedback *feedback);
+/// Returns whether feedback should get triggered now.
+uint8_t squeek_feedback_dispatch(struct squeek_feedback *feedback);
+/// Returns whether the dispatch callback needs to be scheduled again.
+uint8_t squeek_feedback_finished(struct squeek_feedback *feedback, uint8_t success);
+#endif
@@ -0,0 +1,176 @@
+/* Copyright (C) 2026 Purism SPC
+ * SPDX-License-Identifier: GPL-3.0+
+ */
+
+/*! Coalescing of haptic and audio feedback requests.
+ *
+ * Triggering feedback takes a round trip to feedbackd,
+ * so it must not happen inside touch handling.
+ * Requests only get noted here, and the widget triggers feedback later,
+ * from an idle callback.
+ *
+ * At most one trigger is in flight at any time.
+ * Requests made in the meantime are merged into a single trigger,
+ * sent once the previous one finishes.
+ * During fast typing, that spares feedbackd from a queue
+ * of vibrations nobody can tell apart anyway.
+ */
+
+use std::sync::atomic::{ AtomicU64, Ordering };
+
+/// Shared by all dispatchers, readable from any thread.
+pub static TRIGGERED: AtomicU64 = AtomicU64::new(0);
+/// Requests which got merged into another one
+pub static MERGED: AtomicU64 = AtomicU64::new(0);
+/// Triggers which failed
+pub static DROPPED: AtomicU64 = AtomicU64::new(0);
+
+/// Gathers stuff defined in C or called by C
+pub mod c {
+    use super::*;
+
+    #[no_mangle]
+    pub extern "C"
+    fn squeek_feedback_new() -> *mut Dispatcher {
+        Box::into_raw(Box::new(Dispatcher::new()))
+    }
+
+    #[no_mangle]
+    pub extern "C"
+    fn squeek_feedback_free(dispatcher: *mut Dispatcher) {
+        if !dispatcher.is_null() {
+            unsafe { Box::from_raw(dispatcher) };
+        }
+    }
+
+    /// Returns whether the dispatch callback needs to be scheduled.
+    #[no_mangle]
+    pub extern "C"
+    fn squeek_feedback_request(dispatcher: *mut Dispatcher) -> u8 {
+        if dispatcher.is_null() {
+            return 0;
+        }
+        let dispatcher = unsafe { &mut *dispatcher };
+        (dispatcher.request() == Next::Schedule) as u8
+    }
+
+    /// Returns whether feedback should get triggered now.
+    #[no_mangle]
+    pub extern "C"
+    fn squeek_feedback_dispatch(dispatcher: *mut Dispatcher) -> u8 {
+        if dispatcher.is_null() {
+            return 0;
+        }
+        let dispatcher = unsafe { &mut *dispatcher };
+        (dispatcher.dispatch() == Next::Trigger) as u8
+    }
+
+    /// Returns whether the dispatch callback needs to be scheduled again.
+    #[no_mangle]
+    pub extern "C"
+    fn squeek_feedback_finished(dispatcher: *mut Dispatcher, success: u8) -> u8 {
+        if dispatcher.is_null() {
+            return 0;
+        }
+        let dispatcher = unsafe { &mut *dispatcher };
+        (dispatcher.finished(success != 0) == Next::Schedule) as u8
+    }
+}
+
+#[derive(Debug, Clone, Copy, PartialEq)]
+enum State {
+    Idle,
+    /// The dispatch callback is queued
+    Scheduled,
+    /// Waiting for feedbackd.
+    InFlight { owed: bool },
+}
+
+/// What the caller needs to do
+#[derive(Debug, Clone, Copy, PartialEq)]
+pub enum Next {
+    Nothing,
+    /// Queue the dispatch callback
+    Schedule,
+    /// Send the feedback
+    Trigger,
+}
+
+pub struct Dispatcher {
+    state: State,
+}
+
+impl Dispatcher {
+    pub fn new() -> Dispatcher {
+        Dispatcher { state: State::Idle }
+    }
+
+    pub fn request(&mut self) -> Next {
+        let (state, next) = match self.state {
+            State::Idle => (State::Scheduled, Next::Schedule),
+            State::InFlight { owed: false } => {
+                (State::InFlight { owed: true }, Next::Nothing)
+            },
+            State::Scheduled | State::InFlight { owed: true } => {
+                MERGED.fetch_add(1, Ordering::Relaxed);
+                (self.state, Next::Nothing)
+            },
+        };
+        self.state = state;
+        next
+    }
+
+    pub fn dispatch(&mut self) -> Next {
+        match self.state {
+            State::Scheduled => {
+                self.state = State::InFlight { owed: false };
+                TRIGGERED.fetch_add(1, Ordering::Relaxed);
+                Next::Trigger
+            },
+            // Spurious callback
+            _ => Next::Nothing,
+        }
+    }
+
+    pub fn finished(&mut self, success: bool) -> Next {
+        if !success {
+            DROPPED.fetch_add(1, Ordering::Relaxed);
+        }
+        let (state, next) = match self.state {
+            State::InFlight { owed: true } => (State::Scheduled, Next::Schedule),
+            _ => (State::Idle, Next::Nothing),
+        };
+        self.state = state;
+        next
+    }
+}
+
+#[cfg(test)]
+mod test {
+    use super::*;
+
+    #[test]
+    fn burst_is_merged() {
+        let mut dispatcher = Dispatcher::new();
+        assert_eq!(dispatcher.request(), Next::Schedule);
+        // Before the dispatch callback runs
+        assert_eq!(dispatcher.request(), Next::Nothing);
+        assert_eq!(dispatcher.dispatch(), Next::Trigger);
+        // While feedbackd is busy
+        assert_eq!(dispatcher.request(), Next::Nothing);
+        assert_eq!(dispatcher.request(), Next::Nothing);
+        assert_eq!(dispatcher.finished(true), Next::Schedule);
+        assert_eq!(dispatcher.dispatch(), Next::Trigger);
+        assert_eq!(dispatcher.finished(true), Next::Nothing);
+        assert_eq!(dispatcher.state, State::Idle);
+    }
+
+    #[test]
+    fn failure_does_not_stall() {
+        let mut dispatcher = Dispatcher::new();
+        dispatcher.request();
+        dispatcher.dispatch();
+        assert_eq!(dispatcher.finished(false), Next::Nothing);
+        assert_eq!(dispatcher.request(), Next::Schedule);
+    }
+}
@@ -0,0 +1,173 @@
+/* Copyright (C) 2026 Purism SPC
+ * SPDX-License-Identifier: GPL-3.0+
+ */
+
+/*! Finding what a single press of the erase button should remove.
+ *
+ * That's the last user-perceived character, or grapheme cluster:
+ * a letter together with its accents, an emoji with its skin tone,
+ * a flag made of two regional indicators, and so on.
+ *
+ * This follows the rules of Unicode Standard Annex #29
+ * for the characters which layouts can produce,
+ * without pulling in the full Unicode property tables.
+ * Anything unrecognized counts as a cluster of its own,
+ * which erases too little rather than too much.
+ */
+
+const ZWJ: char = '\u{200d}';
+
+fn in_ranges(c: char, ranges: &[(u32, u32)]) -> bool {
+    let c = c as u32;
+    ranges.iter().any(|(start, end)| *start <= c && c <= *end)
+}
+
+/// Characters which never start a cluster: combining marks,
+/// spacing vowel signs, joiners, and variation selectors.
+fn is_extend(c: char) -> bool {
+    in_ranges(c, &[
+        (0x0300, 0x036f), // Combining diacritical marks
+        (0x0483, 0x0489), // Cyrillic
+        (0x0591, 0x05bd), // Hebrew
+        (0x05bf, 0x05bf),
+        (0x05c1, 0x05c2),
+        (0x05c4, 0x05c5),
+        (0x05c7, 0x05c7),
+        (0x0610, 0x061a), // Arabic
+        (0x064b, 0x065f),
+        (0x0670, 0x0670),
+        (0x06d6, 0x06dc),
+        (0x06df, 0x06e4),
+        (0x06e7, 0x06e8),
+        (0x06ea, 0x06ed),
+        (0x0900, 0x0903), // Devanagari
+        (0x093a, 0x093c),
+        (0x093e, 0x094f),
+        (0x0951, 0x0957),
+        (0x0962, 0x0963),
+        (0x0981, 0x0983), // Bengali
+        (0x09bc, 0x09bc),
+        (0x09be, 0x09cd),
+        (0x09d7, 0x09d7),
+        (0x09e2, 0x09e3),
+        (0x0e31, 0x0e31), // Thai
+        (0x0e34, 0x0e3a),
+        (0x0e47, 0x0e4e),
+        (0x1160, 0x11ff), // Hangul medial vowels and final consonants
+        (0x1ab0, 0x1aff), // Combining diacritical marks extended
+        (0x1dc0, 0x1dff), // Combining diacritical marks supplement
+        (0x200c, 0x200d), // Joiners
+        (0x20d0, 0x20ff), // Combining marks for symbols
+        (0x302a, 0x302f), // CJK tone marks
+        (0x3099, 0x309a), // Kana voicing marks
+        (0xfe00, 0xfe0f), // Variation selectors
+        (0xfe20, 0xfe2f), // Combining half marks
+        (0x1f3fb, 0x1f3ff), // Emoji skin tones
+        (0xe0020, 0xe007f), // Tags
+        (0xe0100, 0xe01ef), // Variation selectors supplement
+    ])
+}
+
+fn is_regional_indicator(c: char) -> bool {
+    in_ranges(c, &[(0x1f1e6, 0x1f1ff)])
+}
+
+/// Byte length of the grapheme cluster ending at `cursor`.
+/// `cursor` is a byte offset, as in the text-input protocol.
+pub fn len_before(text: &str, cursor: usize) -> usize {
+    let mut cursor = cursor.min(text.len());
+    while !text.is_char_boundary(cursor) {
+        cursor -= 1;
+    }
+    let before = &text[..cursor];
+    let mut chars = before.char_indices().rev().peekable();
+    let mut start = cursor;
+    // The base, together with anything extending it
+    while let Some((idx, c)) = chars.next() {
+        start = idx;
+        if c == '\r' || c == '\n' {
+            // CR LF is the only cluster of control characters
+            if c == '\n' && chars.peek().map(|(_, c)| *c) == Some('\r') {
+                start = chars.next().unwrap().0;
+            }
+            break;
+        }
+        if is_regional_indicator(c) {
+            // Flags are pairs, counted from the start of the run
+            let run = before[..idx].chars().rev()
+                .take_while(|c| is_regional_indicator(*c))
+                .count();
+            if run % 2 == 1 {
+                start = chars.next().unwrap().0;
+            }
+            break;
+        }
+        // Joiners included, so that the base before them gets taken too
+        if is_extend(c) {
+            continue;
+        }
+        // Emoji sequences glue the next base on with a joiner
+        match chars.peek() {
+            Some((_, prev)) if *prev == ZWJ => continue,
+            _ => break,
+        }
+    }
+    cursor - start
+}
+
+/// Byte length of `count` grapheme clusters before the cursor.
+pub fn erase_length(text: &str, cursor: usize, count: u32) -> usize {
+    let mut cursor = cursor.min(text.len());
+    while !text.is_char_boundary(cursor) {
+        cursor -= 1;
+    }
+    let end = cursor;
+    for _ in 0..count {
+        match len_before(text, cursor) {
+            0 => break,
+            len => cursor -= len,
+        }
+    }
+    end - cursor
+}
+
+#[cfg(test)]
+mod test {
+    use super::*;
+
+    #[test]
+    fn single_chars() {
+        assert_eq!(len_before("abc", 3), 1);
+        assert_eq!(len_before("żó", 4), 2);
+        assert_eq!(len_before("", 0), 0);
+        assert_eq!(len_before("a\r\n", 3), 2);
+    }
+
+    #[test]
+    fn combining_marks() {
+        // e with a combining acute accent
+        assert_eq!(len_before("xe\u{301}", 4), 3);
+        // Devanagari ki
+        assert_eq!(len_before("कि", 6), 6);
+    }
+
+    #[test]
+    fn emoji() {
+        // Thumbs up with a skin tone
+        assert_eq!(len_before("a👍🏽", 9), 8);
+        // Family: man, ZWJ, woman, ZWJ, girl
+        let family = "👨\u{200d}👩\u{200d}👧";
+        assert_eq!(len_before(family, family.len()), family.len());
+        // Two flags
+        assert_eq!(len_before("🇵🇱🇩🇪", 16), 8);
+    }
+
+    #[test]
+    fn erase_length_clusters() {
+        assert_eq!(erase_length("abc", 3, 2), 2);
+        assert_eq!(erase_length("żółw", 7, 2), 3);
+        assert_eq!(erase_length("ab", 2, 5), 2);
+        assert_eq!(erase_length("", 0, 1), 0);
+        assert_eq!(erase_length("ae\u{301}", 4, 1), 3);
+    }
+}
@@ -46,6 +46,12 @@ eek_input_method_delete_surrounding_text(struct zwp_input_method_v2 *zwp_input_m
     zwp_input_method_v2_delete_surrounding_text(zwp_input_method_v2, before_length, after_length);
 };
 
+void
+eek_input_method_set_preedit_string(struct zwp_input_method_v2 *zwp_input_method_v2, const char *text, int32_t cursor_begin, int32_t cursor_end)
+{
+    zwp_input_method_v2_set_preedit_string(zwp_input_method_v2, text, cursor_begin, cursor_end);
+}
+
 void
 eek_input_method_commit(struct zwp_input_method_v2 *zwp_input_method_v2, uint32_t serial)
 {
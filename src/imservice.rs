@@ -4,17 +4,18 @@
  */
 
 use std::boxed::Box;
-use std::ffi::CString;
+use std::ffi::{ CStr, CString };
 use std::fmt;
 use std::num::Wrapping;
 use std::string::String;
 use std::time::Instant;
 
+use crate::batch;
 use crate::main;
 use crate::state;
 use crate::state::Event;
 use crate::logging;
-use crate::util::c::into_cstring;
+use crate::surrounding::SurroundingText;
 
 // Traits
 use std::convert::TryFrom;
@@ -45,12 +46,13 @@ pub mod c {
     }
 
     extern "C" {
-        fn imservice_destroy_im(im: InputMethod);
+        pub fn imservice_destroy_im(im: InputMethod);
 
         #[allow(improper_ctypes)] // IMService will never be dereferenced in C
         pub fn imservice_connect_listeners(im: InputMethod, imservice: *const IMService);
         pub fn eek_input_method_commit_string(im: InputMethod, text: *const c_char);
         pub fn eek_input_method_delete_surrounding_text(im: InputMethod, before: u32, after: u32);
+        pub fn eek_input_method_set_preedit_string(im: InputMethod, text: *const c_char, cursor_begin: i32, cursor_end: i32);
         pub fn eek_input_method_commit(im: InputMethod, serial: u32);
     }
     
@@ -62,12 +64,15 @@ pub mod c {
     fn imservice_handle_input_method_activate(imservice: *mut IMService,
         im: InputMethod)
     {
+        batch::flush_before_state_change(true);
         let imservice = check_imservice(imservice, im).unwrap();
         imservice.preedit_string = String::new();
         imservice.pending = IMProtocolState {
             active: true,
             ..IMProtocolState::default()
         };
+        imservice.pending_surrounding.0.clear();
+        imservice.pending_surrounding.1 = 0;
     }
     
     #[no_mangle]
@@ -75,6 +80,7 @@ pub mod c {
     fn imservice_handle_input_method_deactivate(imservice: *mut IMService,
         im: InputMethod)
     {
+        batch::flush_before_state_change(true);
         let imservice = check_imservice(imservice, im).unwrap();
         imservice.pending = IMProtocolState {
             active: false,
@@ -89,13 +95,13 @@ pub mod c {
         text: *const c_char, cursor: u32, _anchor: u32)
     {
         let imservice = check_imservice(imservice, im).unwrap();
-        imservice.pending = IMProtocolState {
-            surrounding_text: into_cstring(text)
-                .expect("Received invalid string")
-                .expect("Received null string"),
-            surrounding_cursor: cursor,
-            ..imservice.pending.clone()
-        };
+        assert!(!text.is_null(), "Received null string");
+        let text = unsafe { CStr::from_ptr(text) };
+        // Reuses the buffer, the text only gets compared when done
+        let (pending, pending_cursor) = &mut imservice.pending_surrounding;
+        pending.clear();
+        pending.extend_from_slice(text.to_bytes());
+        *pending_cursor = cursor;
     }
     
     #[no_mangle]
@@ -151,9 +157,12 @@ pub mod c {
     fn imservice_handle_done(imservice: *mut IMService,
         im: InputMethod)
     {
+        batch::flush_before_state_change(false);
         let imservice = check_imservice(imservice, im).unwrap();
 
         imservice.current = imservice.pending.clone();
+        let (text, cursor) = &imservice.pending_surrounding;
+        imservice.surrounding.update(text, *cursor);
         imservice.serial += Wrapping(1u32);
         imservice.send_event();
     }
@@ -164,8 +173,9 @@ pub mod c {
     fn imservice_handle_unavailable(imservice: *mut IMService,
         im: InputMethod)
     {
+        batch::flush_before_state_change(true);
         let imservice = check_imservice(imservice, im).unwrap();
-        unsafe { imservice_destroy_im(im); }
+        imservice.backend.destroy();
 
         // no need to care about proper double-buffering,
         // the keyboard is already decommissioned
@@ -295,11 +305,10 @@ impl TryFrom<u32> for ChangeCause {
     }
 }
 
-/// Describes the desired state of the input method as requested by the server
+/// Describes the desired state of the input method as requested by the server,
+/// except for the surrounding text, which is kept separately.
 #[derive(Clone)]
 struct IMProtocolState {
-    surrounding_text: CString,
-    surrounding_cursor: u32,
     content_purpose: ContentPurpose,
     content_hint: ContentHint,
     text_change_cause: ChangeCause,
@@ -309,8 +318,6 @@ struct IMProtocolState {
 impl Default for IMProtocolState {
     fn default() -> IMProtocolState {
         IMProtocolState {
-            surrounding_text: CString::default(),
-            surrounding_cursor: 0, // TODO: mark that there's no cursor
             content_hint: ContentHint::NONE,
             content_purpose: ContentPurpose::Normal,
             text_change_cause: ChangeCause::InputMethod,
@@ -319,13 +326,72 @@ impl Default for IMProtocolState {
     }
 }
 
+/// Receives the requests of the input method.
+///
+/// Normally, they go to the compositor,
+/// but the same requests can be consumed offline, e.g. when replaying input.
+pub trait Backend {
+    fn commit_string(&self, text: &CStr);
+    fn delete_surrounding_text(&self, before: u32, after: u32);
+    fn set_preedit_string(&self, text: &CStr, cursor_begin: i32, cursor_end: i32);
+    fn commit(&self, serial: u32);
+    /// The input method became unavailable.
+    /// Called last, after all the other requests.
+    fn destroy(&self);
+}
+
+impl Backend for c::InputMethod {
+    fn commit_string(&self, text: &CStr) {
+        unsafe {
+            c::eek_input_method_commit_string(*self, text.as_ptr())
+        }
+    }
+
+    fn delete_surrounding_text(&self, before: u32, after: u32) {
+        unsafe {
+            c::eek_input_method_delete_surrounding_text(*self, before, after)
+        }
+    }
+
+    fn set_preedit_string(&self, text: &CStr, cursor_begin: i32, cursor_end: i32) {
+        unsafe {
+            c::eek_input_method_set_preedit_string(
+                *self,
+                text.as_ptr(),
+                cursor_begin,
+                cursor_end,
+            )
+        }
+    }
+
+    fn commit(&self, serial: u32) {
+        unsafe {
+            c::eek_input_method_commit(*self, serial)
+        }
+    }
+
+    fn destroy(&self) {
+        unsafe {
+            c::imservice_destroy_im(*self)
+        }
+    }
+}
+
 pub struct IMService {
     /// Owned reference (still created and destroyed in C)
     pub im: c::InputMethod,
-    sender: main::EventLoop,
+    backend: Box<dyn Backend>,
+    /// Missing when nobody listens to state changes (detached service).
+    sender: Option<main::EventLoop>,
 
     pending: IMProtocolState,
     current: IMProtocolState, // turn current into an idiomatic representation?
+    /// Surrounding text and cursor received since the last done event
+    pending_surrounding: (Vec<u8>, u32),
+    /// Only the changed part gets replaced on every update
+    surrounding: SurroundingText,
+    /// Sent with the next commit.
+    /// Every commit replaces the preedit, so it must be set again each time.
     preedit_string: String,
     serial: Wrapping<u32>,
 }
@@ -336,17 +402,22 @@ pub enum SubmitError {
 }
 
 impl IMService {
+    /// Requests go to `backend`, which is normally `im` itself.
     pub fn new(
         im: c::InputMethod,
+        backend: Box<dyn Backend>,
         sender: main::EventLoop,
     ) -> Box<IMService> {
         // IMService will be referenced to by C,
         // so it needs to stay in the same place in memory via Box
         let imservice = Box::new(IMService {
             im,
-            sender,
+            backend,
+            sender: Some(sender),
             pending: IMProtocolState::default(),
             current: IMProtocolState::default(),
+            pending_surrounding: (Vec::new(), 0),
+            surrounding: SurroundingText::new(),
             preedit_string: String::new(),
             serial: Wrapping(0u32),
         });
@@ -359,12 +430,40 @@ impl IMService {
         imservice
     }
 
+    /// Creates a service which is not connected to any compositor.
+    /// The protocol state stays as set here,
+    /// and requests only reach the `backend`.
+    pub fn new_detached(backend: Box<dyn Backend>, active: bool)
+        -> Box<IMService>
+    {
+        let state = IMProtocolState {
+            active,
+            ..IMProtocolState::default()
+        };
+        Box::new(IMService {
+            im: c::InputMethod::null(),
+            backend,
+            sender: None,
+            pending: state.clone(),
+            current: state,
+            pending_surrounding: (Vec::new(), 0),
+            surrounding: SurroundingText::new(),
+            preedit_string: String::new(),
+            serial: Wrapping(0u32),
+        })
+    }
+
+    /// Stands in for a state update with new surrounding text,
+    /// on services not connected to any compositor.
+    pub fn set_detached_surrounding_text(&mut self, text: CString, cursor: u32) {
+        self.surrounding.update(text.as_bytes(), cursor);
+        self.serial += Wrapping(1u32);
+    }
+
     pub fn commit_string(&self, text: &CString) -> Result<(), SubmitError> {
         match self.current.active {
             true => {
-                unsafe {
-                    c::eek_input_method_commit_string(self.im, text.as_ptr())
-                }
+                self.backend.commit_string(text.as_c_str());
                 Ok(())
             },
             false => Err(SubmitError::NotActive),
@@ -377,24 +476,32 @@ impl IMService {
     ) -> Result<(), SubmitError> {
         match self.current.active {
             true => {
-                unsafe {
-                    c::eek_input_method_delete_surrounding_text(
-                        self.im,
-                        before, after,
-                    )
-                }
+                self.backend.delete_surrounding_text(before, after);
                 Ok(())
             },
             false => Err(SubmitError::NotActive),
         }
     }
 
+    /// Shows the text at the cursor, with the cursor at its end,
+    /// until the commit after the next one.
+    pub fn set_preedit_string(&mut self, text: &str) {
+        self.preedit_string.clear();
+        self.preedit_string.push_str(text);
+    }
+
     pub fn commit(&mut self) -> Result<(), SubmitError> {
         match self.current.active {
             true => {
-                unsafe {
-                    c::eek_input_method_commit(self.im, self.serial.0)
+                if !self.preedit_string.is_empty() {
+                    let cursor = self.preedit_string.len() as i32;
+                    // Came from C strings, so there's no nul inside
+                    let text = CString::new(self.preedit_string.as_str())
+                        .unwrap_or_default();
+                    self.backend.set_preedit_string(&text, cursor, cursor);
+                    self.preedit_string.clear();
                 }
+                self.backend.commit(self.serial.0);
                 Ok(())
             },
             false => Err(SubmitError::NotActive),
@@ -405,7 +512,41 @@ impl IMService {
         self.current.active
     }
 
+    /// Whether the text must not be predicted or remembered
+    pub fn is_sensitive(&self) -> bool {
+        self.current.content_hint.intersects(
+            ContentHint::HIDDEN_TEXT | ContentHint::SENSITIVE_DATA
+        ) || matches!(
+            self.current.content_purpose,
+            ContentPurpose::Password | ContentPurpose::Pin
+        )
+    }
+
+    /// Whether whole dictionary words make sense in the text field
+    pub fn accepts_words(&self) -> bool {
+        !self.is_sensitive() && !matches!(
+            self.current.content_purpose,
+            ContentPurpose::Digits | ContentPurpose::Number
+                | ContentPurpose::Phone | ContentPurpose::Date
+                | ContentPurpose::Time | ContentPurpose::Datetime
+        )
+    }
+
+    /// Changes with every state update from the compositor
+    pub fn get_serial(&self) -> u32 {
+        self.serial.0
+    }
+
+    /// Text around the cursor, as of the last state update
+    pub fn surrounding_text(&self) -> &SurroundingText {
+        &self.surrounding
+    }
+
     fn send_event(&self) {
+        let sender = match &self.sender {
+            Some(sender) => sender,
+            None => return,
+        };
         let state = &self.current;
         let timestamp = Instant::now();
         let message = if state.active {
@@ -418,7 +559,7 @@ impl IMService {
         } else {
             state::InputMethod::InactiveSince(timestamp)
         };
-        self.sender.send(Event::InputMethod(message))
+        sender.send(Event::InputMethod(message))
             .or_warn(&mut logging::Print, logging::Problem::Warning, "Can't send to state manager");
     }
 }
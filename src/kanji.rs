@@ -0,0 +1,423 @@
+/* Copyright (C) 2026 Purism SPC
+ * SPDX-License-Identifier: GPL-3.0+
+ */
+
+/*! Conversion of kana into kanji.
+ *
+ * Kana typed on the kana layouts is held in a reading,
+ * shown as preedit text, until a conversion gets chosen.
+ *
+ * The reading gets split into words by finding the cheapest path
+ * through the lattice of all dictionary words found in it.
+ * Kana which doesn't start any word stays as typed, at a high cost.
+ *
+ * The dictionary is memory-mapped and used in place.
+ * Entries are sorted by reading, so looking up a part of the reading
+ * is a binary search, which also tells when no longer words can match.
+ *
+ * File layout, integers are little-endian:
+ *
+ * ``
+ * header: magic "SQKJ", version: u8, padding: [u8; 3],
+ *         entry_count: u32, index_offset: u32
+ * entries: (reading_len: u8, reading, candidate_count: u8,
+ *           candidate_count * (text_len: u8, text, cost: u16))
+ * index: entry_count * offset: u32
+ * ``
+ *
+ * Candidates of an entry are sorted by cost, cheapest first.
+ */
+
+use std::cmp::Ordering;
+use std::env;
+use std::ops::Deref;
+use std::path::{ Path, PathBuf };
+
+use crate::logging;
+use crate::predict::{ Error, Mapped };
+use crate::xdg;
+
+// Traits
+use crate::logging::Warn;
+
+const MAGIC: &[u8; 4] = b"SQKJ";
+const VERSION: u8 = 1;
+const HEADER_SIZE: usize = 16;
+const INDEX_ENTRY_SIZE: usize = 4;
+/// Longer readings and texts are not stored
+const MAX_LENGTH: usize = 255;
+/// Longest word to look up, in characters
+const MAX_WORD_CHARS: usize = 16;
+/// Added for every word, so that fewer, longer words win
+const WORD_COST: u32 = 2000;
+/// For each character not found in the dictionary
+const UNKNOWN_COST: u32 = 20000;
+
+pub static DICTIONARY_ENV_VAR: &str = "SQUEEKBOARD_KANJI_DICTIONARY";
+
+/// Characters which make up a reading
+pub fn is_kana(c: char) -> bool {
+    match c {
+        // Hiragana, without the voicing marks which are used alone
+        '\u{3041}'..='\u{3096}' => true,
+        // Prolonged sound mark
+        'ー' => true,
+        _ => false,
+    }
+}
+
+pub fn to_katakana(text: &str) -> String {
+    text.chars()
+        .map(|c| match c {
+            '\u{3041}'..='\u{3096}' => {
+                char::from_u32(c as u32 + 0x60).unwrap_or(c)
+            },
+            c => c,
+        })
+        .collect()
+}
+
+fn u32_at(data: &[u8], offset: usize) -> usize {
+    u32::from_le_bytes([
+        data[offset], data[offset + 1], data[offset + 2], data[offset + 3],
+    ]) as usize
+}
+
+/// Turns a list of (reading, text, cost) into the dictionary format.
+pub fn build(words: &[(String, String, u16)]) -> Vec<u8> {
+    let mut words: Vec<&(String, String, u16)> = words.iter()
+        .filter(|(reading, text, _)| {
+            !reading.is_empty() && reading.len() <= MAX_LENGTH
+                && !text.is_empty() && text.len() <= MAX_LENGTH
+        })
+        .collect();
+    words.sort_by(|(r1, t1, c1), (r2, t2, c2)| {
+        r1.as_bytes().cmp(r2.as_bytes())
+            .then(c1.cmp(c2))
+            .then(t1.cmp(t2))
+    });
+    words.dedup_by(|(r1, t1, _), (r2, t2, _)| r1 == r2 && t1 == t2);
+
+    let mut out = Vec::from(&MAGIC[..]);
+    out.extend_from_slice(&[VERSION, 0, 0, 0]);
+    // Filled in at the end
+    out.extend_from_slice(&[0; 8]);
+
+    let mut index = Vec::new();
+    let mut start = 0;
+    while start < words.len() {
+        let reading = &words[start].0;
+        let end = words[start..].iter()
+            .position(|(r, _, _)| r != reading)
+            .map(|len| start + len)
+            .unwrap_or(words.len());
+        let candidates = &words[start..end.min(start + 255)];
+        index.extend_from_slice(&(out.len() as u32).to_le_bytes());
+        out.push(reading.len() as u8);
+        out.extend_from_slice(reading.as_bytes());
+        out.push(candidates.len() as u8);
+        for (_, text, cost) in candidates {
+            out.push(text.len() as u8);
+            out.extend_from_slice(text.as_bytes());
+            out.extend_from_slice(&cost.to_le_bytes());
+        }
+        start = end;
+    }
+    let entry_count = (index.len() / INDEX_ENTRY_SIZE) as u32;
+    let index_offset = out.len() as u32;
+    out.extend_from_slice(&index);
+    out[8..12].copy_from_slice(&entry_count.to_le_bytes());
+    out[12..16].copy_from_slice(&index_offset.to_le_bytes());
+    out
+}
+
+/// Conversions of one reading, cheapest first
+pub struct Candidates<'a> {
+    data: &'a [u8],
+    offset: usize,
+    left: usize,
+}
+
+impl<'a> Iterator for Candidates<'a> {
+    type Item = (&'a str, u16);
+    fn next(&mut self) -> Option<Self::Item> {
+        if self.left == 0 {
+            return None;
+        }
+        self.left -= 1;
+        let len = *self.data.get(self.offset)? as usize;
+        let start = self.offset + 1;
+        let text = self.data.get(start..start + len)?;
+        let cost = self.data.get(start + len..start + len + 2)?;
+        self.offset = start + len + 2;
+        match std::str::from_utf8(text) {
+            Ok(text) => Some((text, u16::from_le_bytes([cost[0], cost[1]]))),
+            Err(_) => {
+                self.left = 0;
+                None
+            },
+        }
+    }
+}
+
+/// Where a dictionary search ended
+enum Found<'a> {
+    Entry(Candidates<'a>),
+    /// Some longer readings start with the searched one
+    Prefix,
+    Nothing,
+}
+
+/// One word of a conversion
+#[derive(Debug, Clone, PartialEq)]
+pub struct Segment<'a> {
+    /// Byte range in the reading
+    pub start: usize,
+    pub end: usize,
+    pub text: &'a str,
+}
+
+pub struct Dictionary<T: Deref<Target=[u8]> = Mapped> {
+    data: T,
+    entry_count: usize,
+    index_offset: usize,
+}
+
+impl Dictionary<Mapped> {
+    pub fn open(path: &Path) -> Result<Self, Error> {
+        Dictionary::new(Mapped::open(path)?)
+    }
+
+    fn path() -> Option<PathBuf> {
+        env::var_os(DICTIONARY_ENV_VAR)
+            .map(PathBuf::from)
+            .or_else(|| xdg::data_path("squeekboard/dictionaries/kanji.dict"))
+    }
+
+    /// Conversion is disabled when there's no dictionary.
+    pub fn load_default() -> Option<Self> {
+        let path = Dictionary::path()?;
+        if !path.exists() {
+            log_print!(logging::Level::Debug, "No kanji dictionary at {:?}", path);
+            return None;
+        }
+        Dictionary::open(&path)
+            .or_print(
+                logging::Problem::Warning,
+                &format!("Can't load kanji dictionary {:?}", path),
+            )
+    }
+}
+
+impl<T: Deref<Target=[u8]>> Dictionary<T> {
+    /// Checks the index. Entries are only ever read with bounds checks.
+    pub fn new(data: T) -> Result<Self, Error> {
+        if data.len() < HEADER_SIZE || &data[..4] != MAGIC || data[4] != VERSION {
+            return Err(Error::BadHeader);
+        }
+        let entry_count = u32_at(&data, 8);
+        let index_offset = u32_at(&data, 12);
+        let index_end = entry_count.checked_mul(INDEX_ENTRY_SIZE)
+            .and_then(|size| size.checked_add(index_offset));
+        if index_offset < HEADER_SIZE || index_end != Some(data.len()) {
+            return Err(Error::BadHeader);
+        }
+        let dictionary = Dictionary { data, entry_count, index_offset };
+        for entry in 0..entry_count {
+            let offset = dictionary.entry_offset(entry);
+            if offset < HEADER_SIZE || offset >= index_offset {
+                return Err(Error::BadHeader);
+            }
+        }
+        Ok(dictionary)
+    }
+
+    fn entry_offset(&self, entry: usize) -> usize {
+        u32_at(&self.data, self.index_offset + entry * INDEX_ENTRY_SIZE)
+    }
+
+    fn entry_reading(&self, entry: usize) -> &[u8] {
+        let offset = self.entry_offset(entry);
+        let len = self.data.get(offset).copied().unwrap_or(0) as usize;
+        self.data.get(offset + 1..offset + 1 + len).unwrap_or(&[])
+    }
+
+    fn entry_candidates(&self, entry: usize) -> Candidates<'_> {
+        let offset = self.entry_offset(entry) + 1 + self.entry_reading(entry).len();
+        Candidates {
+            data: &self.data[..self.index_offset],
+            offset: offset + 1,
+            left: self.data.get(offset).copied().unwrap_or(0) as usize,
+        }
+    }
+
+    fn find(&self, reading: &[u8]) -> Found<'_> {
+        // First entry not before the reading
+        let (mut low, mut high) = (0, self.entry_count);
+        while low < high {
+            let mid = (low + high) / 2;
+            match self.entry_reading(mid).cmp(reading) {
+                Ordering::Less => low = mid + 1,
+                _ => high = mid,
+            }
+        }
+        if low == self.entry_count {
+            return Found::Nothing;
+        }
+        let found = self.entry_reading(low);
+        if found == reading {
+            Found::Entry(self.entry_candidates(low))
+        } else if found.starts_with(reading) {
+            Found::Prefix
+        } else {
+            Found::Nothing
+        }
+    }
+
+    /// Conversions of exactly the reading
+    pub fn lookup(&self, reading: &str) -> Option<Candidates<'_>> {
+        match self.find(reading.as_bytes()) {
+            Found::Entry(candidates) => Some(candidates),
+            _ => None,
+        }
+    }
+
+    /// Splits the reading into the cheapest sequence of words.
+    pub fn best_path<'a>(&'a self, reading: &'a str) -> Vec<Segment<'a>> {
+        let bounds: Vec<usize> = reading.char_indices()
+            .map(|(i, _)| i)
+            .chain(Some(reading.len()))
+            .collect();
+        let positions = bounds.len();
+        // The cheapest way to reach each position, and the word ending there
+        let mut costs: Vec<Option<u32>> = vec![None; positions];
+        let mut words: Vec<Option<Segment<'a>>> = vec![None; positions];
+        costs[0] = Some(0);
+
+        for i in 0..(positions - 1) {
+            let base = match costs[i] {
+                Some(cost) => cost,
+                None => continue,
+            };
+            let start = bounds[i];
+            let mut relax = |j: usize, cost: u32, text: &'a str| {
+                if costs[j].map(|known| cost < known).unwrap_or(true) {
+                    costs[j] = Some(cost);
+                    words[j] = Some(Segment { start, end: bounds[j], text });
+                }
+            };
+            for j in (i + 1)..positions.min(i + 1 + MAX_WORD_CHARS) {
+                match self.find(reading[start..bounds[j]].as_bytes()) {
+                    Found::Entry(candidates) => for (text, cost) in candidates {
+                        relax(j, base + cost as u32 + WORD_COST, text);
+                    },
+                    Found::Prefix => {},
+                    Found::Nothing => break,
+                }
+            }
+            relax(i + 1, base + UNKNOWN_COST, &reading[start..bounds[i + 1]]);
+        }
+
+        let mut segments = Vec::new();
+        let mut position = positions - 1;
+        while let Some(segment) = words[position].take() {
+            position = bounds.binary_search(&segment.start).unwrap_or(0);
+            segments.push(segment);
+        }
+        segments.reverse();
+        segments
+    }
+
+    /// Up to `count` conversions of the reading, most likely first.
+    /// The reading itself and its katakana form are always included.
+    pub fn convert(&self, reading: &str, count: usize) -> Vec<String> {
+        let segments = self.best_path(reading);
+        let mut found: Vec<String> = Vec::with_capacity(count + 2);
+        let mut add = |text: String| {
+            if !found.contains(&text) {
+                found.push(text);
+            }
+        };
+        add(segments.iter().map(|s| s.text).collect());
+        // The first word gets the alternatives,
+        // like when converting word by word
+        if let Some(first) = segments.first() {
+            let rest: String = segments[1..].iter().map(|s| s.text).collect();
+            if let Some(candidates) = self.lookup(&reading[first.start..first.end]) {
+                for (text, _cost) in candidates {
+                    add(format!("{}{}", text, rest));
+                }
+            }
+        }
+        add(reading.into());
+        add(to_katakana(reading));
+        found.truncate(count);
+        found
+    }
+}
+
+#[cfg(test)]
+mod test {
+    use super::*;
+
+    fn dictionary() -> Dictionary<Vec<u8>> {
+        let words = [
+            ("わたし", "私", 3000),
+            ("わたし", "渡し", 6000),
+            ("は", "は", 500),
+            ("は", "歯", 5000),
+            ("にほん", "日本", 3000),
+            ("にほんご", "日本語", 3500),
+            ("ご", "語", 4000),
+            ("ご", "後", 4500),
+        ];
+        let words: Vec<(String, String, u16)> = words.iter()
+            .map(|(r, t, c)| (r.to_string(), t.to_string(), *c))
+            .collect();
+        Dictionary::new(build(&words)).unwrap()
+    }
+
+    #[test]
+    fn lookup_sorted() {
+        let dictionary = dictionary();
+        let found: Vec<&str> = dictionary.lookup("わたし").unwrap()
+            .map(|(text, _)| text)
+            .collect();
+        assert_eq!(found, vec!["私", "渡し"]);
+        assert!(dictionary.lookup("わた").is_none());
+        assert!(dictionary.lookup("ん").is_none());
+    }
+
+    #[test]
+    fn segments() {
+        let dictionary = dictionary();
+        let texts = |reading| -> Vec<String> {
+            dictionary.best_path(reading).iter()
+                .map(|s| s.text.to_string())
+                .collect()
+        };
+        assert_eq!(texts("わたしはにほんご"), vec!["私", "は", "日本語"]);
+        // Unknown kana stays as typed
+        assert_eq!(texts("わたしぬ"), vec!["私", "ぬ"]);
+        assert_eq!(texts(""), Vec::<String>::new());
+    }
+
+    #[test]
+    fn candidates() {
+        let dictionary = dictionary();
+        assert_eq!(
+            dictionary.convert("わたしは", 5),
+            vec!["私は", "渡しは", "わたしは", "ワタシハ"],
+        );
+        assert_eq!(dictionary.convert("わたしは", 1), vec!["私は"]);
+    }
+
+    #[test]
+    fn bad_file() {
+        assert!(Dictionary::new(b"SQKJ".to_vec()).is_err());
+        let mut data = build(&[("あ".into(), "亜".into(), 1)]);
+        let last = data.len() - 1;
+        data[last] = 0xff;
+        assert!(Dictionary::new(data).is_err());
+    }
+}
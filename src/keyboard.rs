@@ -3,13 +3,13 @@
 
 use crate::action::Action;
 use crate::layout;
-use crate::util;
 use std::collections::HashMap;
 use std::fmt;
 use std::io;
 use std::mem;
 use std::ptr;
 use std::string::FromUtf8Error;
+use xkbcommon::xkb;
 
 // Traits
 use std::io::Write;
@@ -26,6 +26,8 @@ pub enum PressType {
 pub struct KeyCode {
     pub code: u32,
     pub keymap_idx: usize,
+    /// On the second level of the keycode, typed while Shift is down
+    pub shifted: bool,
 }
 
 bitflags!{
@@ -98,23 +100,275 @@ fn sorted<'a, I: Iterator<Item=String>>(
     v.into_iter()
 }
 
+/// Usable keycodes in a single keymap: 9 to 254
+const KEYMAP_CAPACITY: usize = 255 - 9;
+
+/// How symbols get spread over keymaps
+#[derive(Clone, Default)]
+pub struct Packing<'a> {
+    /// Symbols which don't fit in the base level of a keymap
+    /// go to the Shift level of the same keycodes.
+    /// Only symbols typing a character are eligible,
+    /// and only those not submitted together with others,
+    /// because Shift would change the meaning of shortcuts.
+    pub shift_level: bool,
+    /// How often characters get typed.
+    /// Frequent symbols share the first keymap and the base level,
+    /// so that typing rarely swaps keymaps.
+    /// Without it, all symbols are equally frequent.
+    pub frequencies: Option<&'a HashMap<char, f64>>,
+    /// Accented letters get submitted as a dead key and the plain letter,
+    /// needing no symbols of their own.
+    /// Only applications with a compose table can type them that way.
+    pub dead_keys: bool,
+}
+
+impl Packing<'_> {
+    /// As used for layouts at runtime
+    pub fn for_layouts() -> Self {
+        Packing { shift_level: true, frequencies: None, dead_keys: false }
+    }
+}
+
+/// The character typed by the symbol, if it's not a control key
+pub fn symbol_char(name: &str) -> Option<char> {
+    let sym = xkb::keysym_from_name(name, xkb::KEYSYM_NO_FLAGS);
+    match sym {
+        xkb::KEY_NoSymbol => None,
+        sym => char::from_u32(xkb::keysym_to_utf32(sym))
+            .filter(|c| *c != '\0' && !c.is_control()),
+    }
+}
+
+/// How often each symbol gets typed, relative to others
+fn symbol_weights<'a, I: Iterator<Item=&'a str>>(
+    names: I,
+    frequencies: Option<&HashMap<char, f64>>,
+) -> Vec<f64> {
+    match frequencies {
+        None => names.map(|_| 1.0).collect(),
+        Some(frequencies) => {
+            // Keys like BackSpace and Return get typed in any text
+            let most = frequencies.values().cloned().fold(0.0, f64::max);
+            names.map(|name| match symbol_char(name) {
+                Some(c) => frequencies.get(&c).cloned().unwrap_or(0.0),
+                None => most,
+            }).collect()
+        },
+    }
+}
+
 /// Generates a mapping where each key gets a keycode, starting from ~~8~~
 /// HACK: starting from 9, because 8 results in keycode 0,
 /// which the compositor likes to discard
-pub fn generate_keycodes<'a, C: IntoIterator<Item=String>>(
+///
+/// The names submitted together by one key stay in one keymap if possible.
+/// Otherwise, pressing that key would switch keymaps in the middle,
+/// which releases all keys and sends a whole keymap to the compositor.
+/// When everything fits in one keymap, groups change nothing.
+pub fn generate_keycodes<C, G>(
     key_names: C,
-) -> HashMap<String, KeyCode> {
+    groups: G,
+    packing: &Packing,
+) -> HashMap<String, KeyCode>
+    where C: IntoIterator<Item=String>,
+        G: IntoIterator<Item=Vec<String>>,
+{
+    // Sort to remove a source of indeterminism in keycode assignment.
+    let mut names: Vec<String> = sorted(key_names.into_iter()).collect();
+    names.dedup();
+    let indices: HashMap<&str, usize> = names.iter()
+        .enumerate()
+        .map(|(i, name)| (name.as_str(), i))
+        .collect();
+    let weights = symbol_weights(
+        names.iter().map(String::as_str),
+        packing.frequencies,
+    );
+    let mut shiftable: Vec<bool> = names.iter()
+        .map(|name| packing.shift_level && symbol_char(name).is_some())
+        .collect();
+
+    // Names sharing a group end up in one component
+    let mut parents: Vec<usize> = (0..names.len()).collect();
+    fn find(parents: &mut Vec<usize>, mut i: usize) -> usize {
+        while parents[i] != i {
+            parents[i] = parents[parents[i]];
+            i = parents[i];
+        }
+        i
+    }
+    for group in groups {
+        let members: Vec<usize> = group.iter()
+            .filter_map(|name| indices.get(name.as_str()).cloned())
+            .collect();
+        if let Some((first, others)) = members.split_first() {
+            for other in others {
+                let (a, b) = (find(&mut parents, *first), find(&mut parents, *other));
+                parents[a.max(b)] = a.min(b);
+            }
+        }
+        if members.len() > 1 {
+            for i in members {
+                shiftable[i] = false;
+            }
+        }
+    }
+    let mut components: Vec<Vec<usize>> = Vec::new();
+    let mut component_of_root = HashMap::new();
+    for i in 0..names.len() {
+        let root = find(&mut parents, i);
+        let idx = *component_of_root.entry(root).or_insert_with(|| {
+            components.push(Vec::new());
+            components.len() - 1
+        });
+        components[idx].push(i);
+    }
+
+    // First fit, most frequent first. Ties keep the sorted order,
+    // so that without groups, keymaps fill up in order.
+    // Without frequencies, that's biggest first.
+    let component_weight = |members: &Vec<usize>| -> f64 {
+        members.iter().map(|i| weights[*i]).sum()
+    };
+    components.sort_by(|a, b| {
+        component_weight(b).partial_cmp(&component_weight(a))
+            .unwrap_or(std::cmp::Ordering::Equal)
+    });
+    let levels = if packing.shift_level { 2 } else { 1 };
+    let fits = |(base, total): (usize, usize), (more_base, more): (usize, usize)| {
+        base + more_base <= KEYMAP_CAPACITY
+            && total + more <= KEYMAP_CAPACITY * levels
+    };
+    let mut keymap_of = vec![0; names.len()];
+    // Symbols needing the base level, and all symbols
+    let mut used: Vec<(usize, usize)> = Vec::new();
+    for members in components {
+        // Too big for any keymap, so it has to be split
+        let mut chunks: Vec<Vec<usize>> = vec![Vec::new()];
+        let mut chunk_used = (0, 0);
+        for i in members {
+            let needs = (!shiftable[i] as usize, 1);
+            if !fits(chunk_used, needs) {
+                chunks.push(Vec::new());
+                chunk_used = (0, 0);
+            }
+            chunk_used = (chunk_used.0 + needs.0, chunk_used.1 + 1);
+            chunks.last_mut().unwrap().push(i);
+        }
+        for chunk in chunks {
+            let needs = (
+                chunk.iter().filter(|i| !shiftable[**i]).count(),
+                chunk.len(),
+            );
+            let keymap_idx = match used.iter()
+                .position(|used| fits(*used, needs))
+            {
+                Some(idx) => idx,
+                None => {
+                    used.push((0, 0));
+                    used.len() - 1
+                },
+            };
+            let (base, total) = used[keymap_idx];
+            used[keymap_idx] = (base + needs.0, total + needs.1);
+            for i in chunk {
+                keymap_of[i] = keymap_idx;
+            }
+        }
+    }
+
+    // Within a keymap, the base level takes the symbols
+    // which can't be shifted, then the most frequent ones.
+    let mut order: Vec<usize> = (0..names.len()).collect();
+    order.sort_by(|a, b| {
+        shiftable[*a].cmp(&shiftable[*b])
+            .then(
+                weights[*b].partial_cmp(&weights[*a])
+                    .unwrap_or(std::cmp::Ordering::Equal)
+            )
+    });
+    let mut placed = vec![0; used.len()];
+    let mut keycodes = vec![None; names.len()];
+    for i in order {
+        let keymap_idx = keymap_of[i];
+        let slot = placed[keymap_idx];
+        placed[keymap_idx] += 1;
+        keycodes[i] = Some(KeyCode {
+            code: 9 + (slot % KEYMAP_CAPACITY) as u32,
+            keymap_idx,
+            shifted: slot >= KEYMAP_CAPACITY,
+        });
+    }
     HashMap::from_iter(
-        // Sort to remove a source of indeterminism in keycode assignment.
-        sorted(key_names.into_iter())
-            .zip(util::cycle_count(9..255))
-            .map(|(name, (code, keymap_idx))| (
-                String::from(name),
-                KeyCode { code, keymap_idx },
-            ))
+        names.into_iter()
+            .zip(keycodes.into_iter().map(Option::unwrap))
     )
 }
 
+/// Keymap swaps per 1000 typed symbols,
+/// if symbols get typed independently of each other.
+pub fn expected_swaps(
+    keycodes: &HashMap<String, KeyCode>,
+    frequencies: Option<&HashMap<char, f64>>,
+) -> f64 {
+    let weights = symbol_weights(
+        keycodes.keys().map(String::as_str),
+        frequencies,
+    );
+    let total: f64 = weights.iter().sum();
+    if total == 0.0 {
+        return 0.0;
+    }
+    let mut per_keymap: Vec<f64> = Vec::new();
+    for (code, weight) in keycodes.values().zip(weights) {
+        if code.keymap_idx >= per_keymap.len() {
+            per_keymap.resize(code.keymap_idx + 1, 0.0);
+        }
+        per_keymap[code.keymap_idx] += weight;
+    }
+    // The next symbol is in another keymap than the previous one
+    let same: f64 = per_keymap.iter().map(|w| w * w).sum();
+    1000.0 * (1.0 - same / (total * total))
+}
+
+/// The share of typed symbols needing Shift
+pub fn shifted_share(
+    keycodes: &HashMap<String, KeyCode>,
+    frequencies: Option<&HashMap<char, f64>>,
+) -> f64 {
+    let weights = symbol_weights(
+        keycodes.keys().map(String::as_str),
+        frequencies,
+    );
+    let total: f64 = weights.iter().sum();
+    let shifted: f64 = keycodes.values().zip(weights)
+        .filter(|(code, _)| code.shifted)
+        .map(|(_, weight)| weight)
+        .sum();
+    if total == 0.0 {
+        return 0.0;
+    }
+    shifted / total
+}
+
+/// Splits the keycodes of a key into runs sharing a keymap.
+/// The order of submission stays, because it's the order of the typed text.
+pub fn plan_keymap_runs(keycodes: &[KeyCode]) -> Vec<&[KeyCode]> {
+    let mut runs = Vec::new();
+    let mut start = 0;
+    for i in 1..keycodes.len() {
+        if keycodes[i].keymap_idx != keycodes[start].keymap_idx {
+            runs.push(&keycodes[start..i]);
+            start = i;
+        }
+    }
+    if start < keycodes.len() {
+        runs.push(&keycodes[start..]);
+    }
+    runs
+}
+
 #[derive(Debug)]
 pub enum FormattingError {
     Utf(FromUtf8Error),
@@ -136,10 +390,10 @@ impl From<io::Error> for FormattingError {
     }
 }
 
-/// Index is the key code, String is the occupant.
+/// Index is the key code, String is the occupant of each level.
 /// Starts all empty.
 /// https://gitlab.freedesktop.org/xorg/xserver/-/issues/260
-type SingleKeyMap = [Option<String>; 256];
+type SingleKeyMap = [[Option<String>; 2]; 256];
 
 fn single_key_map_new() -> SingleKeyMap {
     // Why can't we just initialize arrays without tricks -_- ?
@@ -150,36 +404,111 @@ fn single_key_map_new() -> SingleKeyMap {
     unsafe {
         let arref = &mut *array.as_mut_ptr();
         for element in arref.iter_mut() {
-            ptr::write(element, None);
+            ptr::write(element, [None, None]);
         }
 
         array.assume_init()
     }
 }
 
-pub fn generate_keymaps(symbolmap: HashMap::<String, KeyCode>)
-    -> Result<Vec<String>, FormattingError>
+/// How keymap text gets written
+#[derive(Clone, Copy, Debug, PartialEq)]
+pub enum KeymapStyle {
+    /// Indented and commented, for people to read
+    Readable,
+    /// The smallest text Xwayland still accepts.
+    /// Every application in focus reads it on each keymap change.
+    Compact,
+}
+
+pub fn generate_keymaps(
+    symbolmap: HashMap::<String, KeyCode>,
+    style: KeymapStyle,
+) -> Result<Vec<String>, FormattingError>
 {
     let mut bins: Vec<SingleKeyMap> = Vec::new();
     
-    for (name, KeyCode { code, keymap_idx }) in symbolmap.into_iter() {
+    for (name, KeyCode { code, keymap_idx, shifted }) in symbolmap.into_iter() {
         if keymap_idx >= bins.len() {
             bins.resize_with(
                 keymap_idx + 1,
                 || single_key_map_new(),
             );
         }
-        bins[keymap_idx][code as usize] = Some(name);
+        bins[keymap_idx][code as usize][shifted as usize] = Some(name);
     }
 
     let mut out = Vec::new();
     for bin in bins {
-        out.push(generate_keymap(&bin)?);
+        out.push(match style {
+            KeymapStyle::Readable => generate_keymap(&bin)?,
+            KeymapStyle::Compact => generate_compact_keymap(&bin)?,
+        });
     }
     Ok(out)
 }
 
-/// Generates a de-facto single level keymap.
+/// Like `generate_keymap`, without white space and comments.
+/// All the type names stay, because Xwayland needs them,
+/// but the Shift level is only described when a key uses it.
+fn generate_compact_keymap(
+    symbolmap: &SingleKeyMap,
+) -> Result<String, FormattingError> {
+    let mut buf: Vec<u8> = Vec::new();
+    let keys: Vec<(usize, &[Option<String>; 2])> = symbolmap.iter()
+        .enumerate()
+        .filter(|(_code, levels)| levels[0].is_some())
+        .collect();
+
+    write!(
+        buf,
+        "xkb_keymap{{xkb_keycodes \"squeekboard\"{{minimum=8;maximum=255;"
+    )?;
+    for (keycode, _levels) in &keys {
+        write!(buf, "<I{}>={0};", keycode)?;
+    }
+    write!(
+        buf,
+        "indicator 1=\"Caps Lock\";}};xkb_symbols \"squeekboard\"{{"
+    )?;
+    let mut shift_used = false;
+    for (keycode, levels) in keys {
+        match levels {
+            [Some(name), None] => write!(buf, "key<I{}>{{[{}]}};", keycode, name)?,
+            [Some(name), Some(shifted)] => {
+                shift_used = true;
+                write!(
+                    buf,
+                    "key<I{}>{{type=\"TWO_LEVEL\",[{},{}]}};",
+                    keycode,
+                    name,
+                    shifted,
+                )?
+            },
+            [None, _] => unreachable!(),
+        }
+    }
+    write!(
+        buf,
+        "}};xkb_types \"squeekboard\"{{virtual_modifiers Squeekboard;\
+type \"ONE_LEVEL\"{{modifiers=none;level_name[Level1]=\"Any\";}};\
+type \"TWO_LEVEL\"{{{}level_name[Level1]=\"Base\";}};\
+type \"ALPHABETIC\"{{level_name[Level1]=\"Base\";}};\
+type \"KEYPAD\"{{level_name[Level1]=\"Base\";}};\
+type \"SHIFT+ALT\"{{level_name[Level1]=\"Base\";}};}};\
+xkb_compatibility \"squeekboard\"{{\
+interpret Any+AnyOf(all){{action=SetMods(modifiers=modMapMods,clearLocks);}};}};}};",
+        match shift_used {
+            true => "modifiers=Shift;map[Shift]=Level2;",
+            false => "",
+        },
+    )?;
+
+    String::from_utf8(buf).map_err(FormattingError::Utf)
+}
+
+/// Generates a keymap where the second level is only used
+/// when the first one is full.
 /// Key codes must not repeat and must remain between 9 and 255.
 fn generate_keymap(
     symbolmap: &SingleKeyMap,
@@ -194,18 +523,17 @@ fn generate_keymap(
         maximum = 255;"
     )?;
 
-    let pairs: Vec<(&String, usize)> = symbolmap.iter()
+    let pairs: Vec<(&[Option<String>; 2], usize)> = symbolmap.iter()
         // Attach a key code to each cell.
         .enumerate()
         // Get rid of empty keycodes.
-        .filter_map(|(code, name)| name.as_ref().map(|n| (n, code)))
+        .filter(|(_code, levels)| levels[0].is_some())
+        .map(|(code, levels)| (levels, code))
         .collect();
     
-    // Xorg can only consume up to 255 keys, so this may not work in Xwayland.
-    // Two possible solutions:
-    // - use levels to cram multiple characters into one key
-    // - swap layouts on key presses
-    for (_name, keycode) in &pairs {
+    // Xorg can only consume up to 255 keys,
+    // so more symbols go to the Shift level, and then to other keymaps.
+    for (_levels, keycode) in &pairs {
         write!(
             buf,
             "
@@ -224,14 +552,25 @@ fn generate_keymap(
 "
     )?;
     
-    for (name, keycode) in pairs {
-        write!(
-            buf,
-            "
+    for (levels, keycode) in pairs {
+        match levels {
+            [Some(name), None] => write!(
+                buf,
+                "
 key <I{}> {{ [ {} ] }};",
-            keycode,
-            name,
-        )?;
+                keycode,
+                name,
+            )?,
+            [Some(name), Some(shifted)] => write!(
+                buf,
+                "
+key <I{}> {{ type = \"TWO_LEVEL\", [ {}, {} ] }};",
+                keycode,
+                name,
+                shifted,
+            )?,
+            [None, _] => unreachable!(),
+        }
     }
 
     writeln!(
@@ -248,7 +587,10 @@ key <I{}> {{ [ {} ] }};",
             level_name[Level1]= \"Any\";
         }};
         type \"TWO_LEVEL\" {{
+            modifiers= Shift;
+            map[Shift]= Level2;
             level_name[Level1]= \"Base\";
+            level_name[Level2]= \"Shift\";
         }};
         type \"ALPHABETIC\" {{
             level_name[Level1]= \"Base\";
@@ -279,13 +621,14 @@ key <I{}> {{ [ {} ] }};",
 mod tests {
     use super::*;
     
+    use std::collections::HashSet;
     use xkbcommon::xkb;
 
     #[test]
     fn test_keymap_single_resolve() {
         let mut key_map = single_key_map_new();
-        key_map[9] = Some("a".into());
-        key_map[10] = Some("c".into());
+        key_map[9] = [Some("a".into()), Some("b".into())];
+        key_map[10] = [Some("c".into()), None];
 
         let keymap_str = generate_keymap(&key_map).unwrap();
 
@@ -302,13 +645,46 @@ mod tests {
 
         assert_eq!(state.key_get_one_sym(9), xkb::KEY_a);
         assert_eq!(state.key_get_one_sym(10), xkb::KEY_c);
+        assert_eq!(keymap.key_get_syms_by_level(9, 0, 1), &[xkb::KEY_b]);
+    }
+
+    #[test]
+    fn test_keymap_compact_resolve() {
+        let symbolmap: HashMap<String, KeyCode> = hashmap!(
+            "a".into() => KeyCode { keymap_idx: 0, code: 9, shifted: false },
+            "b".into() => KeyCode { keymap_idx: 0, code: 9, shifted: true },
+            "BackSpace".into() => KeyCode { keymap_idx: 0, code: 10, shifted: false },
+        );
+        let readable = generate_keymaps(symbolmap.clone(), KeymapStyle::Readable)
+            .unwrap();
+        let compact = generate_keymaps(symbolmap, KeymapStyle::Compact)
+            .unwrap();
+        assert!(compact[0].len() < readable[0].len());
+
+        let context = xkb::Context::new(xkb::CONTEXT_NO_FLAGS);
+        let keymap = xkb::Keymap::new_from_string(
+            &context,
+            compact[0].clone(),
+            xkb::KEYMAP_FORMAT_TEXT_V1,
+            xkb::KEYMAP_COMPILE_NO_FLAGS,
+        ).expect("Failed to create keymap");
+
+        assert_eq!(keymap.key_get_syms_by_level(9, 0, 0), &[xkb::KEY_a]);
+        assert_eq!(keymap.key_get_syms_by_level(9, 0, 1), &[xkb::KEY_b]);
+        assert_eq!(keymap.key_get_syms_by_level(10, 0, 0), &[xkb::KEY_BackSpace]);
+        let mut state = xkb::State::new(&keymap);
+        state.update_mask(Modifiers::SHIFT.bits() as u32, 0, 0, 0, 0, 0);
+        assert_eq!(state.key_get_one_sym(9), xkb::KEY_b);
     }
 
     #[test]
     fn test_keymap_second_resolve() {
-        let keymaps = generate_keymaps(hashmap!(
-            "a".into() => KeyCode { keymap_idx: 1, code: 9 },
-        )).unwrap();
+        let keymaps = generate_keymaps(
+            hashmap!(
+                "a".into() => KeyCode { keymap_idx: 1, code: 9, shifted: false },
+            ),
+            KeymapStyle::Readable,
+        ).unwrap();
 
         let context = xkb::Context::new(xkb::CONTEXT_NO_FLAGS);
 
@@ -329,10 +705,121 @@ mod tests {
         // The 257th key (U1101) is interesting.
         // Use Unicode encoding for being able to use in xkb keymaps.
         let keynames = (0..258).map(|num| format!("U{:04X}", 0x1000 + num));
-        let keycodes = generate_keycodes(keynames);
+        let keycodes = generate_keycodes(
+            keynames,
+            Vec::new(),
+            &Packing::default(),
+        );
         
         // test now
         let code = keycodes.get("U1101").expect("Did not find the tested keysym");
         assert_eq!(code.keymap_idx, 1);
     }
+
+    #[test]
+    fn test_keymap_runs() {
+        let code = |keymap_idx| KeyCode { code: 9, keymap_idx, shifted: false };
+        let keycodes = vec![code(0), code(0), code(1), code(0)];
+        let runs: Vec<usize> = plan_keymap_runs(&keycodes).iter()
+            .map(|run| run.len())
+            .collect();
+        assert_eq!(runs, vec![2, 1, 1]);
+        assert!(plan_keymap_runs(&[]).is_empty());
+    }
+
+    #[test]
+    fn test_symbolmap_groups_together() {
+        let keynames: Vec<_> = (0..300)
+            .map(|num| format!("U{:04X}", 0x1000 + num))
+            .collect();
+        // Would straddle the end of the first keymap
+        let group = vec!["U10F0".to_string(), "U1100".to_string()];
+        let keycodes = generate_keycodes(
+            keynames.clone(),
+            vec![group.clone()],
+            &Packing::default(),
+        );
+        let idxs: Vec<_> = group.iter()
+            .map(|name| keycodes.get(name).unwrap().keymap_idx)
+            .collect();
+        assert_eq!(idxs[0], idxs[1]);
+        // Still unique
+        let codes: HashSet<_> = keycodes.values()
+            .map(|code| (code.keymap_idx, code.code))
+            .collect();
+        assert_eq!(codes.len(), keynames.len());
+        assert!(keycodes.values().all(|code| code.code >= 9 && code.code < 255));
+    }
+
+    #[test]
+    fn test_symbolmap_shift_level() {
+        let keynames: Vec<String> = (0..300)
+            .map(|num| format!("U{:04X}", 0x1000 + num))
+            .chain(vec!["BackSpace".into(), "Return".into()])
+            .collect();
+        let keycodes = generate_keycodes(
+            keynames.clone(),
+            Vec::new(),
+            &Packing::for_layouts(),
+        );
+        assert!(keycodes.values().all(|code| code.keymap_idx == 0));
+        assert!(!keycodes["BackSpace"].shifted);
+        assert!(!keycodes["Return"].shifted);
+        let codes: HashSet<_> = keycodes.values()
+            .map(|code| (code.code, code.shifted))
+            .collect();
+        assert_eq!(codes.len(), keynames.len());
+        assert_eq!(expected_swaps(&keycodes, None), 0.0);
+        // Every shifted symbol has a base one on the same key
+        let base: HashSet<_> = keycodes.values()
+            .filter(|code| !code.shifted)
+            .map(|code| code.code)
+            .collect();
+        assert!(
+            keycodes.values()
+                .filter(|code| code.shifted)
+                .all(|code| base.contains(&code.code))
+        );
+    }
+
+    #[test]
+    fn test_symbolmap_frequent_first() {
+        let keynames: Vec<String> = (0..600)
+            .map(|num| format!("U{:04X}", 0x1000 + num))
+            .collect();
+        // Frequent symbols straddle the first two keymaps
+        let frequencies: HashMap<char, f64> = (0..100)
+            .map(|num| (char::from_u32(0x1000 + 200 + num).unwrap(), 10.0))
+            .collect();
+        let unweighted = generate_keycodes(
+            keynames.clone(),
+            Vec::new(),
+            &Packing::default(),
+        );
+        let weighted = generate_keycodes(
+            keynames.clone(),
+            Vec::new(),
+            &Packing {
+                shift_level: false,
+                frequencies: Some(&frequencies),
+                dead_keys: false,
+            },
+        );
+        assert_eq!(weighted["U1100"].keymap_idx, 0);
+        assert!(
+            expected_swaps(&weighted, Some(&frequencies))
+                < expected_swaps(&unweighted, Some(&frequencies))
+        );
+        let shifted = generate_keycodes(
+            keynames,
+            Vec::new(),
+            &Packing {
+                shift_level: true,
+                frequencies: Some(&frequencies),
+                dead_keys: false,
+            },
+        );
+        assert!(!shifted["U1100"].shifted);
+        assert_eq!(shifted_share(&shifted, Some(&frequencies)), 0.0);
+    }
 }
@@ -0,0 +1,10 @@
+#ifndef __LATENCY_H
+#define __LATENCY_H
+
+#include "inttypes.h"
+
+// Defined in Rust
+/// Times in milliseconds of the monotonic clock.
+void squeek_latency_presented(uint32_t event_time, uint32_t presented_time);
+void squeek_latency_discarded(void);
+#endif
@@ -0,0 +1,111 @@
+/* Copyright (C) 2026 Purism SPC
+ * SPDX-License-Identifier: GPL-3.0+
+ */
+
+/*! Time from touching a button until it shows as pressed.
+ *
+ * The widget asks the compositor for presentation feedback
+ * on the first frame drawn after a button got pressed.
+ * The time the frame reached the screen gets compared
+ * with the time of the touch event.
+ *
+ * Both times must come from the same clock.
+ * Compositors usually take event times from the monotonic clock,
+ * so feedback is only requested when presentation uses it too.
+ * Latencies too long to be real are counted apart,
+ * as a sign that the clocks differ after all.
+ */
+
+use std::sync::atomic::{ AtomicU64, Ordering };
+
+/// Upper bounds of histogram buckets, in milliseconds.
+/// The last bucket holds everything longer.
+pub const BUCKET_BOUNDS: [u32; 9] = [8, 16, 24, 33, 50, 67, 100, 150, 250];
+
+/// Longer latencies mean the clocks don't match
+const MAX_LATENCY_MS: u32 = 10_000;
+
+const ZERO: AtomicU64 = AtomicU64::new(0);
+
+/// Presses by latency, readable from any thread
+pub static HISTOGRAM: [AtomicU64; BUCKET_BOUNDS.len() + 1]
+    = [ZERO; BUCKET_BOUNDS.len() + 1];
+/// Frames which never reached the screen
+pub static DISCARDED: AtomicU64 = AtomicU64::new(0);
+/// Latencies which made no sense
+pub static UNMATCHED: AtomicU64 = AtomicU64::new(0);
+
+/// Gathers stuff defined in C or called by C
+pub mod c {
+    use super::*;
+
+    /// Both times are in milliseconds of the monotonic clock,
+    /// truncated to 32 bits.
+    #[no_mangle]
+    pub extern "C"
+    fn squeek_latency_presented(event_time: u32, presented_time: u32) {
+        record(presented_time.wrapping_sub(event_time));
+    }
+
+    #[no_mangle]
+    pub extern "C"
+    fn squeek_latency_discarded() {
+        DISCARDED.fetch_add(1, Ordering::Relaxed);
+    }
+}
+
+fn bucket(latency_ms: u32) -> usize {
+    BUCKET_BOUNDS.iter()
+        .position(|bound| latency_ms <= *bound)
+        .unwrap_or(BUCKET_BOUNDS.len())
+}
+
+fn record(latency_ms: u32) {
+    match latency_ms {
+        0..=MAX_LATENCY_MS => {
+            HISTOGRAM[bucket(latency_ms)].fetch_add(1, Ordering::Relaxed);
+        },
+        // Also presented before the touch, wrapped around
+        _ => {
+            UNMATCHED.fetch_add(1, Ordering::Relaxed);
+        },
+    }
+}
+
+/// Upper bounds and counts of buckets.
+/// The last bound is `u32::MAX`.
+pub fn get_histogram() -> Vec<(u32, u64)> {
+    BUCKET_BOUNDS.iter().cloned()
+        .chain(Some(u32::MAX))
+        .zip(HISTOGRAM.iter())
+        .map(|(bound, count)| (bound, count.load(Ordering::Relaxed)))
+        .collect()
+}
+
+#[cfg(test)]
+mod test {
+    use super::*;
+
+    #[test]
+    fn buckets() {
+        assert_eq!(bucket(0), 0);
+        assert_eq!(bucket(8), 0);
+        assert_eq!(bucket(9), 1);
+        assert_eq!(bucket(40), 4);
+        assert_eq!(bucket(250), 8);
+        assert_eq!(bucket(251), 9);
+        assert_eq!(get_histogram().len(), BUCKET_BOUNDS.len() + 1);
+    }
+
+    #[test]
+    fn wrapped_clock() {
+        let unmatched = UNMATCHED.load(Ordering::Relaxed);
+        // Presented before the touch
+        c::squeek_latency_presented(1000, 990);
+        assert_eq!(UNMATCHED.load(Ordering::Relaxed), unmatched + 1);
+        let before = HISTOGRAM[1].load(Ordering::Relaxed);
+        // The clock wrapped between touch and presentation
+        c::squeek_latency_presented(u32::MAX - 4, 5);
+        assert_eq!(HISTOGRAM[1].load(Ordering::Relaxed), before + 1);
+    }
+}
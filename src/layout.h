@@ -47,11 +47,12 @@ void squeek_layout_release(struct squeek_layout *layout,
 void squeek_layout_release_all_only(struct squeek_layout *layout,
                                     struct submission *submission,
                                     uint32_t timestamp);
-void squeek_layout_depress(struct squeek_layout *layout,
-                           struct submission *submission,
-                           double x_widget, double y_widget,
-                           struct transformation widget_to_layout,
-                           uint32_t timestamp, EekGtkKeyboard *ui_keyboard);
+/// Returns whether a button got pressed.
+uint8_t squeek_layout_depress(struct squeek_layout *layout,
+                              struct submission *submission,
+                              double x_widget, double y_widget,
+                              struct transformation widget_to_layout,
+                              uint32_t timestamp, EekGtkKeyboard *ui_keyboard);
 void squeek_layout_drag(struct squeek_layout *layout,
                         struct submission *submission,
                         double x_widget, double y_widget,
@@ -59,6 +60,36 @@ void squeek_layout_drag(struct squeek_layout *layout,
                         uint32_t timestamp, struct squeek_popover *popover,
                         struct squeek_state_manager *state,
                         EekGtkKeyboard *ui_keyboard);
+/// Returns whether a held button waits to show its alternates,
+/// and when, as an event time.
+uint8_t squeek_layout_get_long_press_due(const struct squeek_layout *layout,
+                                         uint32_t *due);
+void squeek_layout_long_press(struct squeek_layout *layout,
+                              EekGtkKeyboard *ui_keyboard);
+
+/// Whether typing on request is allowed. See automation.rs
+uint8_t squeek_automation_is_allowed(void);
+
+/// What typing on request took. See automation.rs
+struct squeek_typing_report {
+    uint32_t taps;
+    uint32_t missing;
+    uint32_t keycode_presses;
+    uint32_t keymap_updates;
+    uint32_t text_commits;
+    uint64_t microseconds;
+};
+
+/// Taps the buttons typing the text, switching views as needed
+struct squeek_typing_report squeek_layout_type_text(struct squeek_layout *layout,
+                                                    struct submission *submission,
+                                                    const char *text,
+                                                    uint32_t timestamp);
+/// Taps the buttons with the names, which end with NULL
+struct squeek_typing_report squeek_layout_type_buttons(struct squeek_layout *layout,
+                                                       struct submission *submission,
+                                                       const char *const *names,
+                                                       uint32_t timestamp);
 void squeek_layout_draw_all_changed(struct squeek_layout *layout, EekRenderer* renderer, cairo_t     *cr, struct submission *submission);
 void squeek_draw_layout_base_view(struct squeek_layout *layout, EekRenderer* renderer, cairo_t     *cr);
 #endif
@@ -18,20 +18,25 @@
  */
 
 use std::cmp;
-use std::collections::HashMap;
+use std::collections::{ HashMap, HashSet, VecDeque };
 use std::ffi::CString;
 use std::fmt;
 use std::vec::Vec;
 
 use crate::action::Action;
 use crate::actors;
+use crate::batch;
+use crate::compose;
 use crate::drawing;
 use crate::float_ord::FloatOrd;
 use crate::keyboard::{KeyState, KeyCode, PressType};
 use crate::logging;
 use crate::popover;
 use crate::receiver;
+use crate::repeat;
 use crate::submission::{ Submission, SubmitData, Timestamp };
+use crate::swipe;
+use crate::touch_model;
 use crate::util::find_max_double;
 
 use crate::imservice::ContentPurpose;
@@ -135,7 +140,7 @@ pub mod c {
                 scale_y: self.scale_y * next.scale_y,
             }
         }
-        fn forward(&self, p: Point) -> Point {
+        pub fn forward(&self, p: Point) -> Point {
             Point {
                 x: (p.x - self.origin_x) / self.scale_x,
                 y: (p.y - self.origin_y) / self.scale_y,
@@ -223,8 +228,8 @@ pub mod c {
         ) {
             let time = Timestamp(time);
             let layout = unsafe { &mut *layout };
-            let submission = submission.clone_ref();
-            let mut submission = submission.borrow_mut();
+            let submission_ref = submission.clone_ref();
+            let mut submission = submission_ref.borrow_mut();
             let app_state = app_state.clone_owned();
             let popover_state = popover.clone_owned();
             
@@ -233,20 +238,16 @@ pub mod c {
                 keyboard: ui_keyboard,
             };
 
-            // The list must be copied,
-            // because it will be mutated in the loop
-            let pressed_buttons
-                = layout.state.active_buttons.clone();
-            for (button, _key_state) in pressed_buttons.iter_pressed() {
-                seat::handle_release_key(
-                    layout,
-                    &mut submission,
-                    Some(&ui_backend),
-                    time,
-                    Some((&popover_state, app_state.clone())),
-                    button,
-                );
-            }
+            seat::handle_release_all(
+                layout,
+                &mut submission,
+                Some(&ui_backend),
+                time,
+                Some((&popover_state, app_state)),
+            );
+            drop(submission);
+            repeat::arm_timer(&submission_ref);
+            batch::arm_timer(&submission_ref);
             drawing::queue_redraw(ui_keyboard);
         }
 
@@ -259,21 +260,18 @@ pub mod c {
             time: u32,
         ) {
             let layout = unsafe { &mut *layout };
-            let submission = submission.clone_ref();
-            let mut submission = submission.borrow_mut();
-            // The list must be copied,
-            // because it will be mutated in the loop
-            let pressed_buttons = layout.state.active_buttons.clone();
-            for (button, _key_state) in pressed_buttons.iter_pressed() {
-                seat::handle_release_key(
-                    layout,
-                    &mut submission,
-                    None, // don't update UI
-                    Timestamp(time),
-                    None, // don't switch layouts
-                    button,
-                );
-            }
+            let submission_ref = submission.clone_ref();
+            let mut submission = submission_ref.borrow_mut();
+            seat::handle_release_all(
+                layout,
+                &mut submission,
+                None, // don't update UI
+                Timestamp(time),
+                None, // don't switch layouts
+            );
+            drop(submission);
+            repeat::arm_timer(&submission_ref);
+            batch::arm_timer(&submission_ref);
         }
 
         #[no_mangle]
@@ -285,34 +283,32 @@ pub mod c {
             widget_to_layout: Transformation,
             time: u32,
             ui_keyboard: EekGtkKeyboard,
-        ) {
+        ) -> u8 {
             let layout = unsafe { &mut *layout };
-            let submission = submission.clone_ref();
-            let mut submission = submission.borrow_mut();
+            let submission_ref = submission.clone_ref();
+            let mut submission = submission_ref.borrow_mut();
             let point = widget_to_layout.forward(
                 Point { x: x_widget, y: y_widget }
             );
 
-            let index = layout.find_index_by_position(point);
+            let pressed = seat::handle_press_at(
+                layout,
+                &mut submission,
+                Timestamp(time),
+                point,
+            );
+            drop(submission);
+            repeat::arm_timer(&submission_ref);
+            batch::arm_timer(&submission_ref);
 
-            if let Some((row, position_in_row)) = index {
-                let button = ButtonPosition {
-                    view: layout.state.current_view.clone(),
-                    row,
-                    position_in_row,
-                };
-                seat::handle_press_key(
-                    layout,
-                    &mut submission,
-                    Timestamp(time),
-                    &button,
-                );
+            if pressed {
                 // maybe TODO: draw on the display buffer here
                 drawing::queue_redraw(ui_keyboard);
                 unsafe {
                     eek_gtk_keyboard_emit_feedback(ui_keyboard);
                 }
             };
+            pressed as u8
         }
 
         // FIXME: this will work funny
@@ -332,8 +328,8 @@ pub mod c {
         ) {
             let time = Timestamp(time);
             let layout = unsafe { &mut *layout };
-            let submission = submission.clone_ref();
-            let mut submission = submission.borrow_mut();
+            let submission_ref = submission.clone_ref();
+            let mut submission = submission_ref.borrow_mut();
             // We only need to query state here, not update.
             // A copy is enough.
             let popover_state = popover.clone_owned();
@@ -346,63 +342,59 @@ pub mod c {
                 Point { x: x_widget, y: y_widget }
             );
 
-            let pressed_buttons = layout.state.active_buttons.clone();
-            let pressed_buttons = pressed_buttons.iter_pressed();
-            let button_info = layout.find_index_by_position(point);
-
-            if let Some((row, position_in_row)) = button_info {
-                let current_pos = ButtonPosition {
-                    view: layout.state.current_view.clone(),
-                    row,
-                    position_in_row,
-                };
-                let mut found = false;
-                for (button, _key_state) in pressed_buttons {
-                    if button == &current_pos {
-                        found = true;
-                    } else {
-                        seat::handle_release_key(
-                            layout,
-                            &mut submission,
-                            Some(&ui_backend),
-                            time,
-                            Some((&popover_state, app_state.clone())),
-                            button,
-                        );
-                    }
-                }
-                if !found {
-                    let button = ButtonPosition {
-                        view: layout.state.current_view.clone(),
-                        row,
-                        position_in_row,
-                    };
-                    seat::handle_press_key(
-                        layout,
-                        &mut submission,
-                        time,
-                        &button,
-                    );
-                    // maybe TODO: draw on the display buffer here
-                    unsafe {
-                        eek_gtk_keyboard_emit_feedback(ui_keyboard);
-                    }
-                }
-            } else {
-                for (button, _key_state) in pressed_buttons {
-                    seat::handle_release_key(
-                        layout,
-                        &mut submission,
-                        Some(&ui_backend),
-                        time,
-                        Some((&popover_state, app_state.clone())),
-                        button,
-                    );
+            let pressed = seat::handle_drag_to(
+                layout,
+                &mut submission,
+                Some(&ui_backend),
+                time,
+                Some((&popover_state, app_state)),
+                point,
+            );
+            drop(submission);
+            batch::arm_timer(&submission_ref);
+            if pressed {
+                repeat::arm_timer(&submission_ref);
+                // maybe TODO: draw on the display buffer here
+                unsafe {
+                    eek_gtk_keyboard_emit_feedback(ui_keyboard);
                 }
             }
             drawing::queue_redraw(ui_keyboard);
         }
 
+        /// Returns whether a held button waits to show its alternates.
+        /// If so, `due` gets the event time when that should happen.
+        #[no_mangle]
+        pub extern "C"
+        fn squeek_layout_get_long_press_due(
+            layout: *const Layout,
+            due: *mut u32,
+        ) -> u8 {
+            let layout = unsafe { &*layout };
+            match layout.get_long_press_due() {
+                Some(time) => {
+                    unsafe { *due = time.0 };
+                    1
+                },
+                None => 0,
+            }
+        }
+
+        #[no_mangle]
+        pub extern "C"
+        fn squeek_layout_long_press(
+            layout: *mut Layout,
+            ui_keyboard: EekGtkKeyboard,
+        ) {
+            let layout = unsafe { &mut *layout };
+            if seat::handle_long_press(layout) {
+                drawing::queue_redraw(ui_keyboard);
+                unsafe {
+                    eek_gtk_keyboard_emit_feedback(ui_keyboard);
+                }
+            }
+        }
+
         #[cfg(test)]
         mod test {
             use super::*;
@@ -457,6 +449,9 @@ pub struct Button {
     pub keycodes: Vec<KeyCode>,
     /// Static description of what the key does when pressed or released
     pub action: Action,
+    /// Offered on long press, each drawn like this button.
+    /// Ready to submit, so that nothing needs to be looked up then.
+    pub alternates: Vec<Button>,
 }
 
 impl Button {
@@ -466,6 +461,22 @@ impl Button {
             width: self.size.width, height: self.size.height,
         }
     }
+
+    /// The letter typed by the button, lowercase, if there's exactly one
+    pub fn get_letter(&self) -> Option<char> {
+        let text = match (&self.action, &self.label) {
+            (Action::Submit { text: Some(text), .. }, _) => text,
+            (Action::Submit { text: None, .. }, Label::Text(text)) => text,
+            _ => return None,
+        };
+        let mut chars = text.to_str().ok()?
+            .chars()
+            .flat_map(char::to_lowercase);
+        match (chars.next(), chars.next()) {
+            (Some(c), None) if c.is_alphabetic() => Some(c),
+            _ => None,
+        }
+    }
 }
 
 /// The representation of a row of buttons
@@ -637,6 +648,27 @@ impl View {
     }
 }
 
+/// Buttons closer to the touch than this fraction of their size
+/// are considered by the touch model
+const TOUCH_CORRECTION_MARGIN: f64 = 0.5;
+
+/// Touches closer to the center of a button than this fraction of its size
+/// always press it, whatever the touch model says
+const TOUCH_CORE: f32 = 0.3;
+
+/// How long a button must be held for its alternates to show
+const LONG_PRESS_MS: u32 = 400;
+
+/// Position of the point relative to the button center, in button sizes
+fn touch_offset(button_origin: &c::Point, button: &Button, point: &c::Point)
+    -> touch_model::Offset
+{
+    touch_model::Offset {
+        x: ((point.x - button_origin.x) / button.size.width - 0.5) as f32,
+        y: ((point.y - button_origin.y) / button.size.height - 0.5) as f32,
+    }
+}
+
 /// The physical characteristic of layout for the purpose of styling
 #[derive(Clone, Copy, PartialEq, Debug)]
 pub enum ArrangementKind {
@@ -733,6 +765,78 @@ pub struct LayoutState {
     /// Latched/locked appearance is derived from current view
     /// and button metadata.
     pub active_buttons: ActiveButtons,
+    /// Path of the touch point, when swipe typing is possible
+    swipe: Option<swipe::Trace>,
+    /// Present while a button with alternates is held
+    pub alternates: Option<AlternatesPopup>,
+}
+
+/// The alternates of a held button.
+/// The button gets submitted on release,
+/// unless held long enough for its alternates to show.
+#[derive(Clone, Debug, PartialEq)]
+pub struct AlternatesPopup {
+    pub button: ButtonPosition,
+    /// Top left corner of the first alternate, in layout coordinates
+    pub origin: c::Point,
+    /// Event time of the press
+    pressed_at: u32,
+    pub shown: bool,
+    /// Index of the alternate under the touch point
+    pub selected: Option<usize>,
+}
+
+impl AlternatesPopup {
+    /// Returns None if the button has no alternates.
+    fn new(layout: &Layout, button_pos: &ButtonPosition, time: Timestamp)
+        -> Option<AlternatesPopup>
+    {
+        let (origin, button) = layout.shape.find_button_place(button_pos)?;
+        if button.alternates.is_empty() {
+            return None;
+        }
+        let (view_offset, _view) = layout.get_current_view_position();
+        let place = view_offset + origin;
+        let width = button.size.width * button.alternates.len() as f64;
+        let max_x = layout.shape.calculate_inner_size().width - width;
+        let origin = c::Point {
+            x: place.x.min(max_x).max(0.0),
+            // Above the button, unless there's no room
+            y: match place.y >= button.size.height {
+                true => place.y - button.size.height,
+                false => place.y,
+            },
+        };
+        let mut popup = AlternatesPopup {
+            button: button_pos.clone(),
+            origin,
+            pressed_at: time.0,
+            shown: false,
+            selected: None,
+        };
+        // The one closest to where the finger is
+        popup.selected = popup.find_index(
+            button,
+            &c::Point {
+                x: place.x + button.size.width / 2.0,
+                y: popup.origin.y + button.size.height / 2.0,
+            },
+        );
+        Some(popup)
+    }
+
+    /// Finds the alternate at the point.
+    /// Points far above or below select nothing.
+    fn find_index(&self, button: &Button, point: &c::Point) -> Option<usize> {
+        let size = &button.size;
+        let center_y = self.origin.y + size.height / 2.0;
+        if (point.y - center_y).abs() > size.height * 1.5 {
+            return None;
+        }
+        let index = ((point.x - self.origin.x) / size.width).floor();
+        let last = button.alternates.len().checked_sub(1)?;
+        Some((index.max(0.0) as usize).min(last))
+    }
 }
 
 /// A builder structure for picking up layout data from storage
@@ -747,6 +851,8 @@ pub struct LayoutParseData {
 
 /// Static, cacheable information for the layout
 pub struct LayoutData {
+    /// Where the layout came from
+    pub name: String,
     pub margins: Margins,
     pub kind: ArrangementKind,
     pub purpose: ContentPurpose,
@@ -773,7 +879,7 @@ impl fmt::Display for NoSuchView {
 
 
 impl LayoutData {
-    fn get_button(&self, button: &ButtonPosition) -> Option<&Button> {
+    pub fn get_button(&self, button: &ButtonPosition) -> Option<&Button> {
         let (_, view) = self.views.get(&button.view)?;
         let (_, row) = view.rows.get(button.row)?;
         let (_, key) = row.buttons.get(button.position_in_row)?;
@@ -838,6 +944,7 @@ impl Layout {
     pub fn new(data: LayoutParseData, kind: ArrangementKind, purpose: ContentPurpose) -> Layout {
         Layout {
             shape: LayoutData {
+                name: String::new(),
                 kind,
                 views: data.views,
                 keymaps: data.keymaps,
@@ -848,6 +955,8 @@ impl Layout {
                 current_view: "base".to_owned(),
                 view_latched: LatchedState::Not,
                 active_buttons: ActiveButtons(HashMap::new()),
+                swipe: None,
+                alternates: None,
             },
         }
     }
@@ -883,6 +992,59 @@ impl Layout {
             .map(|(_b, i)| i)
     }
 
+    /// Returns index within current view.
+    /// When the point is close to several buttons,
+    /// the one with the highest score wins.
+    /// The score is the log-likelihood of the touch meaning the button.
+    fn find_index_by_likelihood<F>(&self, point: c::Point, score: F)
+        -> Option<(usize, usize)>
+        where F: Fn(&Button, touch_model::Offset) -> f32
+    {
+        // Touches outside of the view stay outside
+        let hit = self.find_index_by_position(point.clone())?;
+        let mut best: Option<((usize, usize), f32)> = None;
+        let mut in_core = false;
+        self.foreach_visible_button(|offset, button, index| {
+            if index == hit {
+                let offset = touch_offset(&offset, button, &point);
+                in_core = offset.x.abs() < TOUCH_CORE
+                    && offset.y.abs() < TOUCH_CORE;
+            }
+            let margin = button.size.width.min(button.size.height)
+                * TOUCH_CORRECTION_MARGIN;
+            let near = c::Bounds {
+                x: offset.x - margin,
+                y: offset.y - margin,
+                width: button.size.width + 2.0 * margin,
+                height: button.size.height + 2.0 * margin,
+            };
+            if index == hit || near.contains(&point) {
+                let likelihood = score(
+                    button,
+                    touch_offset(&offset, button, &point),
+                );
+                match best {
+                    Some((_, best_likelihood)) if best_likelihood >= likelihood => {},
+                    _ => best = Some((index, likelihood)),
+                }
+            }
+        });
+        match in_core {
+            true => Some(hit),
+            false => best.map(|(index, _)| index),
+        }
+    }
+
+    /// When the held button should show its alternates, if ever
+    pub fn get_long_press_due(&self) -> Option<Timestamp> {
+        match &self.state.alternates {
+            Some(popup) if !popup.shown => {
+                Some(Timestamp(popup.pressed_at.wrapping_add(LONG_PRESS_MS)))
+            },
+            _ => None,
+        }
+    }
+
     /// Returns index within current view too.
     pub fn foreach_visible_button<F>(&self, mut f: F)
         where F: FnMut(c::Point, &Button, (usize, usize))
@@ -935,6 +1097,69 @@ impl Layout {
         }
     }
 
+    /// Buttons to tap to get to the first button matching `wanted`,
+    /// ending with that button.
+    /// Starts in the current view, and switches views like the user would,
+    /// taking the fewest view switches.
+    pub fn find_taps<F>(&self, wanted: F) -> Option<Vec<ButtonPosition>>
+        where F: Fn(&Button) -> bool
+    {
+        fn buttons<'a>(view_name: &'a str, view: &'a View)
+            -> impl Iterator<Item=(ButtonPosition, &'a Button)>
+        {
+            view.get_rows().iter().enumerate()
+                .flat_map(move |(row, (_offset, row_buttons))| {
+                    row_buttons.get_buttons().iter().enumerate()
+                        .map(move |(position_in_row, (_offset, button))| (
+                            ButtonPosition {
+                                view: view_name.into(),
+                                row,
+                                position_in_row,
+                            },
+                            button,
+                        ))
+                })
+        }
+
+        let current = &self.state.current_view;
+        let mut visited = HashSet::new();
+        visited.insert(current.clone());
+        let mut queue = VecDeque::new();
+        queue.push_back((
+            current.clone(),
+            self.state.view_latched.clone(),
+            Vec::new(),
+        ));
+        while let Some((view_name, latched, taps)) = queue.pop_front() {
+            let view = match self.shape.views.get(&view_name) {
+                Some((_offset, view)) => view,
+                None => continue,
+            };
+            let found = buttons(&view_name, view)
+                .find(|(_position, button)| wanted(button));
+            if let Some((position, _button)) = found {
+                let mut taps = taps;
+                taps.push(position);
+                return Some(taps);
+            }
+            for (position, button) in buttons(&view_name, view) {
+                let (transition, latched) = Layout::process_action_for_view(
+                    &button.action,
+                    &view_name,
+                    &latched,
+                );
+                if let ViewTransition::ChangeTo(next) = transition {
+                    if visited.insert(next.to_owned()) {
+                        let mut taps = taps.clone();
+                        taps.push(position);
+                        queue.push_back((next.to_owned(), latched, taps));
+                    }
+                }
+            }
+        }
+        None
+    }
+
     /// Last bool is new latch state.
     /// It doesn't make sense when the result carries UnlatchAll,
     /// but let's not be picky.
@@ -1067,7 +1292,7 @@ pub struct UIBackend {
 }
 
 /// Top level procedures, dispatching to everything
-mod seat {
+pub mod seat {
     use super::*;
 
     fn handle_press_key_cleaner(
@@ -1078,22 +1303,27 @@ mod seat {
     ) {
         let button = shape.get_button(button_pos).unwrap();
         let action = button.action.clone();
-        match action {
+        match &action {
             Action::Submit {
                 text: Some(text),
                 keys: _,
             } => submission.handle_press(
                 button_pos.into(),
-                SubmitData::Text(&text),
+                SubmitData::Text(text),
                 &button.keycodes,
                 time,
             ),
             Action::Submit {
                 text: None,
-                keys: _,
+                keys,
             } => submission.handle_press(
                 button_pos.into(),
-                SubmitData::Keycodes,
+                match keys.as_slice() {
+                    [key] => compose::find(&key.0)
+                        .map(SubmitData::DeadKey)
+                        .unwrap_or(SubmitData::Keycodes),
+                    _ => SubmitData::Keycodes,
+                },
                 &button.keycodes,
                 time,
             ),
@@ -1105,16 +1335,50 @@ mod seat {
             ),
             _ => {},
         };
+        if action.repeats() {
+            submission.handle_repeat_start(
+                button_pos.into(),
+                matches!(action, Action::Erase),
+                time,
+            );
+        } else {
+            submission.handle_repeat_cancel();
+        }
     }
     
+    fn handle_press_alternate(
+        shape: &LayoutData,
+        submission: &mut Submission,
+        time: Timestamp,
+        button_pos: &ButtonPosition,
+        index: usize,
+    ) {
+        let button = shape.get_button(button_pos).unwrap();
+        if let Some(alternate) = button.alternates.get(index) {
+            if let Action::Submit { text: Some(text), keys: _ } = &alternate.action {
+                submission.handle_press(
+                    button_pos.into(),
+                    SubmitData::Text(text),
+                    &alternate.keycodes,
+                    time,
+                );
+                // The button itself may not release anything
+                submission.handle_release(button_pos.into(), time);
+            }
+        }
+    }
+
     pub fn handle_press_key(
         layout: &mut Layout,
         submission: &mut Submission,
         time: Timestamp,
         button_pos: &ButtonPosition,
     ) {
-        // Send messages
-        handle_press_key_cleaner(&layout.shape, submission, time, button_pos);
+        // Send messages, unless an alternate may be chosen instead
+        layout.state.alternates = AlternatesPopup::new(layout, button_pos, time);
+        if layout.state.alternates.is_none() {
+            handle_press_key_cleaner(&layout.shape, submission, time, button_pos);
+        }
     
         // Update state
         let find = layout.state.active_buttons.get(button_pos);
@@ -1210,6 +1474,33 @@ mod seat {
         manager: Option<(&actors::popover::State, receiver::State)>,
         button_pos: &ButtonPosition,
     ) {
+        let popup = match &layout.state.alternates {
+            Some(popup) if popup.button == *button_pos => {
+                layout.state.alternates.take()
+            },
+            _ => None,
+        };
+        if let Some(popup) = popup {
+            match (popup.shown, popup.selected) {
+                // Released early, so it's the button itself
+                (false, _) => handle_press_key_cleaner(
+                    &layout.shape,
+                    submission,
+                    time,
+                    button_pos,
+                ),
+                (true, Some(index)) => handle_press_alternate(
+                    &layout.shape,
+                    submission,
+                    time,
+                    button_pos,
+                    index,
+                ),
+                // Dragged away from the popup
+                (true, None) => {},
+            }
+        }
+
         // Send events
         let action = handle_release_key_cleaner(
             &layout.shape,
@@ -1230,6 +1521,173 @@ mod seat {
             );
         }
     }
+
+    /// Presses the button under the point, if there is one.
+    /// The point is in the layout's coordinate space.
+    /// Returns whether any button got pressed.
+    pub fn handle_press_at(
+        layout: &mut Layout,
+        submission: &mut Submission,
+        time: Timestamp,
+        point: c::Point,
+    ) -> bool {
+        let found = match submission.get_touch_scorer() {
+            Some(score) => layout.find_index_by_likelihood(point.clone(), score),
+            None => layout.find_index_by_position(point.clone()),
+        };
+        match found {
+            Some((row, position_in_row)) => {
+                let button = ButtonPosition {
+                    view: layout.state.current_view.clone(),
+                    row,
+                    position_in_row,
+                };
+                if let Some((origin, pressed)) = layout.shape.find_button_place(&button) {
+                    let (view_offset, _view) = layout.get_current_view_position();
+                    submission.handle_touch(
+                        pressed,
+                        touch_offset(&(view_offset + origin), pressed, &point),
+                    );
+                }
+                handle_press_key(layout, submission, time, &button);
+                layout.state.swipe = match submission.can_swipe() {
+                    true => Some(swipe::Trace::new(button, point)),
+                    false => None,
+                };
+                true
+            },
+            None => false,
+        }
+    }
+
+    /// Moves the pressing point, releasing the buttons it left
+    /// and pressing the one it entered.
+    /// Returns whether a new button got pressed.
+    pub fn handle_drag_to(
+        layout: &mut Layout,
+        submission: &mut Submission,
+        ui: Option<&UIBackend>,
+        time: Timestamp,
+        manager: Option<(&actors::popover::State, receiver::State)>,
+        point: c::Point,
+    ) -> bool {
+        if let Some(popup) = &mut layout.state.alternates {
+            if popup.shown {
+                let button = layout.shape.get_button(&popup.button).unwrap();
+                popup.selected = popup.find_index(button, &point);
+                return false;
+            }
+        }
+
+        if let Some(trace) = &mut layout.state.swipe {
+            trace.push(point.clone());
+            // Keys don't get pressed while swiping
+            if trace.is_swiping() {
+                return false;
+            }
+        }
+
+        let pressed_buttons = layout.state.active_buttons.clone();
+        let pressed_buttons = pressed_buttons.iter_pressed();
+        let button_info = layout.find_index_by_position(point);
+
+        if let Some((row, position_in_row)) = button_info {
+            let current_pos = ButtonPosition {
+                view: layout.state.current_view.clone(),
+                row,
+                position_in_row,
+            };
+            let mut found = false;
+            for (button, _key_state) in pressed_buttons {
+                if button == &current_pos {
+                    found = true;
+                } else {
+                    handle_release_key(
+                        layout,
+                        submission,
+                        ui,
+                        time,
+                        manager.as_ref().map(|(p, s)| (*p, s.clone())),
+                        button,
+                    );
+                }
+            }
+            if !found {
+                // Leaving the first key turns the press into a swipe
+                let swiping = match &mut layout.state.swipe {
+                    Some(trace) => submission.handle_swipe_begin(
+                        &layout.shape,
+                        trace,
+                    ),
+                    None => false,
+                };
+                if swiping {
+                    return false;
+                }
+                let button = ButtonPosition {
+                    view: layout.state.current_view.clone(),
+                    row,
+                    position_in_row,
+                };
+                handle_press_key(layout, submission, time, &button);
+            }
+            !found
+        } else {
+            for (button, _key_state) in pressed_buttons {
+                handle_release_key(
+                    layout,
+                    submission,
+                    ui,
+                    time,
+                    manager.as_ref().map(|(p, s)| (*p, s.clone())),
+                    button,
+                );
+            }
+            false
+        }
+    }
+
+    /// Shows the alternates of the held button.
+    /// Returns whether they got shown.
+    pub fn handle_long_press(layout: &mut Layout) -> bool {
+        match &mut layout.state.alternates {
+            Some(popup) if !popup.shown => {
+                popup.shown = true;
+                // Choosing an alternate is not swiping
+                layout.state.swipe = None;
+                true
+            },
+            _ => false,
+        }
+    }
+
+    /// Releases every pressed button.
+    pub fn handle_release_all(
+        layout: &mut Layout,
+        submission: &mut Submission,
+        ui: Option<&UIBackend>,
+        time: Timestamp,
+        manager: Option<(&actors::popover::State, receiver::State)>,
+    ) {
+        if let Some(trace) = layout.state.swipe.take() {
+            if trace.is_swiping() {
+                submission.handle_swipe_end(&layout.shape, &trace, time);
+            }
+        }
+        // The list must be copied,
+        // because it will be mutated in the loop
+        let pressed_buttons = layout.state.active_buttons.clone();
+        for (button, _key_state) in pressed_buttons.iter_pressed() {
+            handle_release_key(
+                layout,
+                submission,
+                ui,
+                time,
+                manager.as_ref().map(|(p, s)| (*p, s.clone())),
+                button,
+            );
+        }
+    }
 }
 
 #[cfg(test)]
@@ -1248,6 +1706,7 @@ mod test {
             label: Label::Text(CString::new(name).unwrap()),
             action: Action::SetView("default".into()),
             keycodes: Vec::new(),
+            alternates: Vec::new(),
         }
     }
 
@@ -1317,9 +1776,12 @@ mod test {
                 current_view: "base".into(),
                 view_latched: LatchedState::Not,
                 active_buttons: ActiveButtons(HashMap::new()),
+                swipe: None,
+                alternates: None,
             },
             shape: LayoutData {
                 keymaps: Vec::new(),
+                name: String::new(),
                 kind: ArrangementKind::Base,
                 margins: Margins {
                     top: 0.0,
@@ -1354,6 +1816,134 @@ mod test {
         assert_eq!(&layout.state.current_view, "base");
     }
 
+    #[test]
+    fn find_taps_across_views() {
+        fn make_view(switch_to: &str, letter: &str) -> View {
+            View::new(vec![(
+                0.0,
+                Row::new(vec![
+                    (
+                        0.0,
+                        Button {
+                            action: Action::SetView(switch_to.into()),
+                            ..make_button("switch".into())
+                        },
+                    ),
+                    (
+                        1.0,
+                        Button {
+                            action: Action::Submit {
+                                text: Some(CString::new(letter).unwrap()),
+                                keys: Vec::new(),
+                            },
+                            ..make_button(letter.into())
+                        },
+                    ),
+                ]),
+            )])
+        }
+
+        let layout = Layout {
+            state: LayoutState {
+                current_view: "base".into(),
+                view_latched: LatchedState::Not,
+                active_buttons: ActiveButtons(HashMap::new()),
+                swipe: None,
+                alternates: None,
+            },
+            shape: LayoutData {
+                keymaps: Vec::new(),
+                name: String::new(),
+                kind: ArrangementKind::Base,
+                margins: Margins {
+                    top: 0.0,
+                    left: 0.0,
+                    right: 0.0,
+                    bottom: 0.0,
+                },
+                views: hashmap! {
+                    "base".into() => (
+                        c::Point { x: 0.0, y: 0.0 },
+                        make_view("numbers", "a"),
+                    ),
+                    "numbers".into() => (
+                        c::Point { x: 0.0, y: 0.0 },
+                        make_view("base", "1"),
+                    ),
+                },
+                purpose: ContentPurpose::Normal,
+            },
+        };
+
+        let position = |view: &str, position_in_row| ButtonPosition {
+            view: view.into(),
+            row: 0,
+            position_in_row,
+        };
+        let named = |name: &'static str| {
+            move |button: &Button| button.name.to_str() == Ok(name)
+        };
+        assert_eq!(layout.find_taps(named("a")), Some(vec![position("base", 1)]));
+        assert_eq!(
+            layout.find_taps(named("1")),
+            Some(vec![position("base", 0), position("numbers", 1)]),
+        );
+        assert_eq!(layout.find_taps(named("x")), None);
+    }
+
+    #[test]
+    fn touch_core_beats_score() {
+        let size = Size { width: 10.0, height: 10.0 };
+        let view = View::new(vec![(
+            0.0,
+            Row::new(vec![
+                (0.0, Button { size: size.clone(), ..make_button("a".into()) }),
+                (10.0, Button { size, ..make_button("b".into()) }),
+            ]),
+        )]);
+        let layout = Layout {
+            state: LayoutState {
+                current_view: "base".into(),
+                view_latched: LatchedState::Not,
+                active_buttons: ActiveButtons(HashMap::new()),
+                swipe: None,
+                alternates: None,
+            },
+            shape: LayoutData {
+                keymaps: Vec::new(),
+                name: String::new(),
+                kind: ArrangementKind::Base,
+                margins: Margins {
+                    top: 0.0,
+                    left: 0.0,
+                    right: 0.0,
+                    bottom: 0.0,
+                },
+                views: hashmap! {
+                    "base".into() => (c::Point { x: 0.0, y: 0.0 }, view),
+                },
+                purpose: ContentPurpose::Normal,
+            },
+        };
+        // Whatever the touch, "b" is much more likely
+        let prefer_b = |button: &Button, _offset: touch_model::Offset| -> f32 {
+            match button.name.to_str() {
+                Ok("b") => 0.0,
+                _ => -100.0,
+            }
+        };
+        // Close to the center of "a"
+        assert_eq!(
+            layout.find_index_by_likelihood(c::Point { x: 7.0, y: 5.0 }, prefer_b),
+            Some((0, 0)),
+        );
+        // At the edge of "a"
+        assert_eq!(
+            layout.find_index_by_likelihood(c::Point { x: 9.0, y: 5.0 }, prefer_b),
+            Some((0, 1)),
+        );
+    }
+
     #[test]
     fn reverse_unlatch_layout() {
         let switch = Action::LockView {
@@ -1397,9 +1987,12 @@ mod test {
                 current_view: "base".into(),
                 view_latched: LatchedState::Not,
                 active_buttons: ActiveButtons(HashMap::new()),
+                swipe: None,
+                alternates: None,
             },
             shape: LayoutData {
                 keymaps: Vec::new(),
+                name: String::new(),
                 kind: ArrangementKind::Base,
                 margins: Margins {
                     top: 0.0,
@@ -1468,9 +2061,12 @@ mod test {
                 current_view: "base".into(),
                 view_latched: LatchedState::Not,
                 active_buttons: ActiveButtons(HashMap::new()),
+                swipe: None,
+                alternates: None,
             },
             shape: LayoutData {
                 keymaps: Vec::new(),
+                name: String::new(),
                 kind: ArrangementKind::Base,
                 margins: Margins {
                     top: 0.0,
@@ -1574,6 +2170,7 @@ mod test {
         ]);
         let layout = LayoutData {
             keymaps: Vec::new(),
+            name: String::new(),
             kind: ArrangementKind::Base,
             // Lots of bottom margin
             margins: Margins {
@@ -1624,6 +2221,7 @@ mod test {
         ]);
         let layout = LayoutData {
             keymaps: Vec::new(),
+            name: String::new(),
             kind: ArrangementKind::Base,
             margins: Margins {
                 top: 0.0,
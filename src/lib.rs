@@ -25,24 +25,41 @@ mod logging;
 mod action;
 pub mod actors;
 mod animation;
+mod automation;
+mod batch;
+mod compose;
 pub mod data;
 mod drawing;
 mod event_loop;
+mod feedback;
 pub mod float_ord;
+mod grapheme;
 pub mod imservice;
+pub mod kanji;
 mod keyboard;
+mod latency;
 mod layout;
 mod locale;
 mod main;
+mod ngram;
 mod outputs;
 mod panel;
 mod popover;
+pub mod predict;
 mod receiver;
+mod recorder;
+mod repeat;
+pub mod replay;
 pub mod resources;
 mod state;
 mod style;
 mod submission;
+pub mod surrounding;
+mod swipe;
 pub mod tests;
+mod touch_model;
+pub mod userdict;
 pub mod util;
 mod vkeyboard;
+mod wire;
 mod xdg;
@@ -35,15 +35,27 @@ mod c {
 
     use crate::actors::Destination;
     use crate::actors::popover;
+    use crate::batch;
     use crate::event_loop::driver;
     use crate::imservice::IMService;
     use crate::imservice::c::InputMethod;
+    use crate::kanji;
     use crate::layout;
+    use crate::ngram::CharModel;
     use crate::outputs::Outputs;
+    use crate::predict;
+    use crate::repeat;
     use crate::state;
     use crate::submission::Submission;
+    use crate::swipe;
+    use crate::touch_model::TouchModel;
+    use crate::userdict;
     use crate::util::c::{ArcWrapped, Wrapped};
+    use crate::vkeyboard;
+    use crate::vkeyboard::VirtualKeyboard;
     use crate::vkeyboard::c::ZwpVirtualKeyboardV1;
+    use crate::wire;
+    use crate::wire::Wire;
     
     /// DbusHandler*
     #[repr(transparent)]
@@ -80,6 +92,7 @@ mod c {
         seat: *const c_void,
         input_method: InputMethod,
         virtual_keyboard: ZwpVirtualKeyboardV1,
+        display: wire::c::WlDisplay,
     }
 
     impl Wayland {
@@ -92,6 +105,7 @@ mod c {
                 seat: ptr::null(),
                 input_method: InputMethod::null(),
                 virtual_keyboard: ZwpVirtualKeyboardV1::null(),
+                display: wire::c::WlDisplay::null(),
             }
         }
     }
@@ -120,21 +134,45 @@ mod c {
         let height = height_px();
         let state_manager = driver::Threaded::new(sender, state::Application::new(now, height));
 
-        debug::init(state_manager.clone());
+        let keymap_churn = vkeyboard::ChurnStats::default();
+        debug::init(state_manager.clone(), keymap_churn.clone());
 
         let outputs = Outputs::new(state_manager.clone());
         let mut wayland = Box::new(Wayland::new(outputs));
         let wayland_raw = &mut *wayland as *mut _;
         unsafe { init_wayland(wayland_raw); }
 
-        let vk = wayland.virtual_keyboard;
+        // Requests get written to the socket outside of the main thread
+        let wire = Wire::spawn(
+            wayland.display,
+            wayland.virtual_keyboard,
+            wayland.input_method,
+        );
 
         let imservice = if wayland.input_method.is_null() {
             None
         } else {
-            Some(IMService::new(wayland.input_method, state_manager.clone()))
+            Some(IMService::new(
+                wayland.input_method,
+                Box::new(wire::InputMethodRequests(wire.clone())),
+                state_manager.clone(),
+            ))
         };
-        let submission = Submission::new(vk, imservice);
+        let mut submission = Submission::new(
+            VirtualKeyboard::new(Box::new(wire::VirtualKeyboardRequests(wire))),
+            imservice,
+        );
+        submission.set_swipe_lexicon(swipe::Lexicon::load_default());
+        submission.set_dictionary(predict::Dictionary::load_default());
+        submission.set_kanji_dictionary(kanji::Dictionary::load_default());
+        submission.set_learned_words(userdict::Store::load_default());
+        submission.set_touch_model(TouchModel::load_from_env());
+        submission.set_char_model(CharModel::load_from_env());
+        submission.set_repeat_config(repeat::Config::from_env());
+        submission.set_batch_config(batch::Config::from_env());
+        submission.set_keymap_churn(keymap_churn);
+        let submission = Wrapped::new(submission);
+        batch::watch_input_method(&submission.clone_ref());
         
         let popover = ArcWrapped::new(actors::popover::State::new(true));
 
@@ -142,7 +180,7 @@ mod c {
         crate::actors::external::screensaver::init(popover.clone_ref());
         
         RsObjects {
-            submission: Wrapped::new(submission),
+            submission,
             state_manager: Wrapped::new(state_manager),
             receiver: Wrapped::new(receiver),
             wayland: Box::into_raw(wayland),
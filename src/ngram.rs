@@ -0,0 +1,218 @@
+/* Copyright (C) 2026 Purism SPC
+ * SPDX-License-Identifier: GPL-3.0+
+ */
+
+/*! Character n-gram model predicting the next letter.
+ *
+ * The model counts letter trigrams, bigrams and single letters,
+ * and blends their probabilities, so that rare contexts
+ * fall back to shorter ones.
+ *
+ * It's seeded from a text file, and learns from the letters typed,
+ * unless they get erased right away.
+ * The context comes from the text around the cursor.
+ */
+
+use std::collections::HashMap;
+use std::env;
+use std::fs;
+use std::path::PathBuf;
+
+use crate::logging;
+
+/// Stands for the beginning of a word and for anything not a letter
+const BOUNDARY: char = ' ';
+/// Blend of trigram, bigram and unigram probabilities
+const WEIGHTS: (f32, f32, f32) = (0.6, 0.3, 0.1);
+/// Counts get halved when the total reaches this,
+/// to keep adapting and to keep the numbers in range.
+const MAX_TOTAL: u32 = 1 << 24;
+/// Limit of the log-odds either way,
+/// so that the language never outweighs where the touch landed
+const MAX_LOG_ODDS: f32 = 2.0;
+
+pub static MODEL_ENV_VAR: &str = "SQUEEKBOARD_LANGUAGE_MODEL";
+
+/// The two characters before the cursor, oldest first
+pub type Context = (char, char);
+
+fn normalize(c: char) -> char {
+    match c.is_alphabetic() {
+        true => c.to_lowercase().next().unwrap_or(c),
+        false => BOUNDARY,
+    }
+}
+
+/// Takes the context from the text before the cursor.
+/// `cursor` is a byte offset, as in the text-input protocol.
+pub fn context_before(text: &str, cursor: usize) -> Context {
+    let mut cursor = cursor.min(text.len());
+    while !text.is_char_boundary(cursor) {
+        cursor -= 1;
+    }
+    let mut chars = text[..cursor].chars().rev().map(normalize);
+    let last = chars.next().unwrap_or(BOUNDARY);
+    let before = chars.next().unwrap_or(BOUNDARY);
+    (before, last)
+}
+
+#[derive(Default)]
+pub struct CharModel {
+    trigrams: HashMap<(char, char, char), u32>,
+    bigrams: HashMap<(char, char), u32>,
+    unigrams: HashMap<char, u32>,
+    /// Totals by context, for normalization
+    trigram_contexts: HashMap<(char, char), u32>,
+    bigram_contexts: HashMap<char, u32>,
+    total: u32,
+    /// The last letter, until it's known whether it stays
+    pending: Option<(Context, char)>,
+}
+
+impl CharModel {
+    pub fn new() -> CharModel {
+        CharModel::default()
+    }
+
+    /// Returns None unless enabled.
+    pub fn load_from_env() -> Option<CharModel> {
+        let path = PathBuf::from(env::var_os(MODEL_ENV_VAR)?);
+        let mut model = CharModel::new();
+        match fs::read_to_string(&path) {
+            Ok(text) => model.learn_text(&text),
+            Err(e) => log_print!(
+                logging::Level::Warning,
+                "Can't read language model text {:?}: {}", path, e,
+            ),
+        };
+        Some(model)
+    }
+
+    pub fn learn_text(&mut self, text: &str) {
+        let mut context = (BOUNDARY, BOUNDARY);
+        for c in text.chars().map(normalize) {
+            if c != BOUNDARY {
+                self.learn(context, c);
+            }
+            context = (context.1, c);
+        }
+    }
+
+    fn learn(&mut self, context: Context, c: char) {
+        if self.total >= MAX_TOTAL {
+            self.halve();
+        }
+        *self.trigrams.entry((context.0, context.1, c)).or_insert(0) += 1;
+        *self.trigram_contexts.entry(context).or_insert(0) += 1;
+        *self.bigrams.entry((context.1, c)).or_insert(0) += 1;
+        *self.bigram_contexts.entry(context.1).or_insert(0) += 1;
+        *self.unigrams.entry(c).or_insert(0) += 1;
+        self.total += 1;
+    }
+
+    fn halve(&mut self) {
+        fn halve_map<K: std::hash::Hash + Eq>(map: &mut HashMap<K, u32>) {
+            map.retain(|_, count| {
+                *count /= 2;
+                *count > 0
+            });
+        }
+        halve_map(&mut self.trigrams);
+        halve_map(&mut self.bigrams);
+        halve_map(&mut self.unigrams);
+        halve_map(&mut self.trigram_contexts);
+        halve_map(&mut self.bigram_contexts);
+        self.total = self.unigrams.values().sum();
+    }
+
+    fn probability(&self, context: Context, c: char) -> f32 {
+        let ratio = |count: Option<&u32>, total: Option<&u32>| {
+            match (count, total) {
+                (Some(count), Some(total)) => *count as f32 / *total as f32,
+                _ => 0.0,
+            }
+        };
+        let trigram = ratio(
+            self.trigrams.get(&(context.0, context.1, c)),
+            self.trigram_contexts.get(&context),
+        );
+        let bigram = ratio(
+            self.bigrams.get(&(context.1, c)),
+            self.bigram_contexts.get(&context.1),
+        );
+        // Add-one, so that no letter is impossible
+        let alphabet = self.unigrams.len() as f32 + 1.0;
+        let unigram = (self.unigrams.get(&c).cloned().unwrap_or(0) as f32 + 1.0)
+            / (self.total as f32 + alphabet);
+        WEIGHTS.0 * trigram + WEIGHTS.1 * bigram + WEIGHTS.2 * unigram
+    }
+
+    /// How much more likely the letter is than an average letter,
+    /// as a natural logarithm. Zero means no preference.
+    pub fn log_odds(&self, context: Context, c: char) -> f32 {
+        let c = normalize(c);
+        if c == BOUNDARY {
+            return 0.0;
+        }
+        let average = 1.0 / (self.unigrams.len() as f32 + 1.0);
+        (self.probability(context, c) / average).ln()
+            .max(-MAX_LOG_ODDS)
+            .min(MAX_LOG_ODDS)
+    }
+
+    /// Records a typed letter. The previous one is accepted.
+    pub fn handle_letter(&mut self, context: Context, c: char) {
+        self.accept_pending();
+        self.pending = Some((context, normalize(c)));
+    }
+
+    /// Something else than a letter got typed.
+    pub fn handle_other(&mut self) {
+        self.accept_pending();
+    }
+
+    /// The previous letter got erased, so it doesn't teach anything.
+    pub fn handle_erase(&mut self) {
+        self.pending = None;
+    }
+
+    fn accept_pending(&mut self) {
+        if let Some((context, c)) = self.pending.take() {
+            if c != BOUNDARY {
+                self.learn(context, c);
+            }
+        }
+    }
+}
+
+#[cfg(test)]
+mod test {
+    use super::*;
+
+    #[test]
+    fn context_from_text() {
+        assert_eq!(context_before("Hello th", 8), ('t', 'h'));
+        assert_eq!(context_before("Hello ", 6), ('o', ' '));
+        assert_eq!(context_before("", 0), (' ', ' '));
+        assert_eq!(context_before("Żó", 4), ('ż', 'ó'));
+    }
+
+    #[test]
+    fn prefers_seen_letters() {
+        let mut model = CharModel::new();
+        model.learn_text("the then there these that this");
+        let context = context_before("t", 1);
+        assert!(model.log_odds(context, 'h') > 0.0);
+        assert!(model.log_odds(context, 'h') > model.log_odds(context, 'g'));
+        assert!(model.log_odds(context, 'g') >= -MAX_LOG_ODDS);
+    }
+
+    #[test]
+    fn erased_letter_not_learned() {
+        let mut model = CharModel::new();
+        model.handle_letter((' ', ' '), 'q');
+        model.handle_erase();
+        model.handle_other();
+        assert_eq!(model.total, 0);
+    }
+}
@@ -0,0 +1,451 @@
+/* Copyright (C) 2026 Purism SPC
+ * SPDX-License-Identifier: GPL-3.0+
+ */
+
+/*! Word completion from a memory-mapped dictionary.
+ *
+ * The dictionary file is used in place, never parsed into memory.
+ * Words are sorted and front-coded: each word stores only the part
+ * which differs from the previous word.
+ * Words are grouped into blocks which start with a complete word,
+ * so that a binary search over the block index finds the first block
+ * which can contain a prefix.
+ *
+ * The index also stores the highest frequency within each block.
+ * Blocks which can't improve on the completions found so far
+ * are skipped without decoding.
+ *
+ * File layout, integers are little-endian:
+ *
+ * ``
+ * header: magic "SQDC", version: u8, padding: [u8; 3],
+ *         block_count: u32, index_offset: u32
+ * blocks: entries of (shared: u8, suffix_len: u8, suffix, frequency: u8)
+ * index: block_count * (offset: u32, max_frequency: u8, padding: [u8; 3])
+ * ``
+ */
+
+use std::env;
+use std::fs::File;
+use std::io;
+use std::ops::Deref;
+use std::path::{ Path, PathBuf };
+
+use crate::logging;
+use crate::xdg;
+
+// Traits
+use crate::logging::Warn;
+use std::os::unix::io::AsRawFd;
+
+const MAGIC: &[u8; 4] = b"SQDC";
+const VERSION: u8 = 1;
+const HEADER_SIZE: usize = 16;
+const INDEX_ENTRY_SIZE: usize = 8;
+/// Words per block. Larger blocks compress better, but take longer to scan.
+const BLOCK_WORDS: usize = 16;
+/// Words longer than this are not stored
+const MAX_WORD: usize = 255;
+
+pub static DICTIONARY_ENV_VAR: &str = "SQUEEKBOARD_DICTIONARY";
+
+mod c {
+    use std::os::raw::{ c_int, c_long, c_void };
+
+    pub const PROT_READ: c_int = 1;
+    pub const MAP_PRIVATE: c_int = 2;
+
+    extern "C" {
+        // From libc
+        pub fn mmap(
+            addr: *mut c_void,
+            length: usize,
+            prot: c_int,
+            flags: c_int,
+            fd: c_int,
+            offset: c_long,
+        ) -> *mut c_void;
+        pub fn munmap(addr: *mut c_void, length: usize) -> c_int;
+    }
+}
+
+/// A read-only file mapping
+pub struct Mapped {
+    data: *const u8,
+    len: usize,
+}
+
+impl Mapped {
+    pub fn open(path: &Path) -> Result<Mapped, io::Error> {
+        let file = File::open(path)?;
+        let len = file.metadata()?.len() as usize;
+        if len == 0 {
+            return Err(io::Error::new(io::ErrorKind::InvalidData, "Empty file"));
+        }
+        let data = unsafe {
+            c::mmap(
+                std::ptr::null_mut(),
+                len,
+                c::PROT_READ,
+                c::MAP_PRIVATE,
+                file.as_raw_fd(),
+                0,
+            )
+        };
+        // MAP_FAILED
+        if data as isize == -1 {
+            return Err(io::Error::last_os_error());
+        }
+        // The mapping outlives the file descriptor.
+        Ok(Mapped { data: data as *const u8, len })
+    }
+}
+
+impl Deref for Mapped {
+    type Target = [u8];
+    fn deref(&self) -> &[u8] {
+        unsafe { std::slice::from_raw_parts(self.data, self.len) }
+    }
+}
+
+impl Drop for Mapped {
+    fn drop(&mut self) {
+        unsafe { c::munmap(self.data as *mut _, self.len) };
+    }
+}
+
+#[derive(Debug)]
+pub enum Error {
+    Io(io::Error),
+    BadHeader,
+}
+
+impl std::fmt::Display for Error {
+    fn fmt(&self, f: &mut std::fmt::Formatter<'_>) -> std::fmt::Result {
+        match self {
+            Error::Io(e) => write!(f, "IO: {}", e),
+            Error::BadHeader => write!(f, "Not a valid dictionary"),
+        }
+    }
+}
+
+impl From<io::Error> for Error {
+    fn from(e: io::Error) -> Self {
+        Error::Io(e)
+    }
+}
+
+fn u32_at(data: &[u8], offset: usize) -> usize {
+    u32::from_le_bytes([
+        data[offset], data[offset + 1], data[offset + 2], data[offset + 3],
+    ]) as usize
+}
+
+/// Turns a list of words with counts into the dictionary format.
+pub fn build(words: &[(String, u64)]) -> Vec<u8> {
+    let mut words: Vec<&(String, u64)> = words.iter()
+        .filter(|(word, _)| !word.is_empty() && word.len() <= MAX_WORD)
+        .collect();
+    words.sort_by(|(a, _), (b, _)| a.as_bytes().cmp(b.as_bytes()));
+    words.dedup_by(|(a, _), (b, _)| a == b);
+
+    let max = words.iter().map(|(_, c)| *c).max().unwrap_or(1);
+    let quantize = |count: u64| {
+        (255.0 * (1.0 + count as f64).ln() / (1.0 + max as f64).ln()).round() as u8
+    };
+
+    let mut out = Vec::from(&MAGIC[..]);
+    out.extend_from_slice(&[VERSION, 0, 0, 0]);
+    // Filled in at the end
+    out.extend_from_slice(&[0; 8]);
+
+    let mut index = Vec::new();
+    for block in words.chunks(BLOCK_WORDS) {
+        let max_frequency = block.iter().map(|(_, c)| quantize(*c)).max().unwrap_or(0);
+        index.extend_from_slice(&(out.len() as u32).to_le_bytes());
+        index.extend_from_slice(&[max_frequency, 0, 0, 0]);
+        let mut previous: &[u8] = &[];
+        for (word, count) in block {
+            let word = word.as_bytes();
+            let shared = previous.iter().zip(word)
+                .take_while(|(a, b)| a == b)
+                .count();
+            out.push(shared as u8);
+            out.push((word.len() - shared) as u8);
+            out.extend_from_slice(&word[shared..]);
+            out.push(quantize(*count));
+            previous = word;
+        }
+    }
+    let block_count = (index.len() / INDEX_ENTRY_SIZE) as u32;
+    let index_offset = out.len() as u32;
+    out.extend_from_slice(&index);
+    out[8..12].copy_from_slice(&block_count.to_le_bytes());
+    out[12..16].copy_from_slice(&index_offset.to_le_bytes());
+    out
+}
+
+pub struct Dictionary<T: Deref<Target=[u8]> = Mapped> {
+    data: T,
+    block_count: usize,
+    index_offset: usize,
+}
+
+impl Dictionary<Mapped> {
+    pub fn open(path: &Path) -> Result<Self, Error> {
+        Dictionary::new(Mapped::open(path)?)
+    }
+
+    fn path() -> Option<PathBuf> {
+        env::var_os(DICTIONARY_ENV_VAR)
+            .map(PathBuf::from)
+            .or_else(|| xdg::data_path("squeekboard/dictionaries/words.dict"))
+    }
+
+    /// Prediction is disabled when there's no dictionary.
+    pub fn load_default() -> Option<Self> {
+        let path = Dictionary::path()?;
+        if !path.exists() {
+            log_print!(logging::Level::Debug, "No dictionary at {:?}", path);
+            return None;
+        }
+        Dictionary::open(&path)
+            .or_print(
+                logging::Problem::Warning,
+                &format!("Can't load dictionary {:?}", path),
+            )
+    }
+}
+
+/// Anything which can complete a word
+pub trait Completions {
+    /// Returns up to `count` most likely words starting with `prefix`,
+    /// most likely first. The prefix itself is not included.
+    fn complete(&self, prefix: &str, count: usize) -> Vec<String>;
+}
+
+/// Single decoded word
+struct Entry<'a> {
+    shared: usize,
+    suffix: &'a [u8],
+    frequency: u8,
+}
+
+impl<T: Deref<Target=[u8]>> Dictionary<T> {
+    /// Checks the index. Entries are only ever read with bounds checks,
+    /// so that the whole file doesn't have to be paged in here.
+    pub fn new(data: T) -> Result<Self, Error> {
+        if data.len() < HEADER_SIZE || &data[..4] != MAGIC || data[4] != VERSION {
+            return Err(Error::BadHeader);
+        }
+        let block_count = u32_at(&data, 8);
+        let index_offset = u32_at(&data, 12);
+        let index_end = block_count.checked_mul(INDEX_ENTRY_SIZE)
+            .and_then(|size| size.checked_add(index_offset));
+        if index_offset < HEADER_SIZE || index_end != Some(data.len()) {
+            return Err(Error::BadHeader);
+        }
+        let dictionary = Dictionary { data, block_count, index_offset };
+        for block in 0..block_count {
+            let (start, end) = dictionary.block_range(block);
+            if start < HEADER_SIZE || start > end || end > index_offset {
+                return Err(Error::BadHeader);
+            }
+        }
+        Ok(dictionary)
+    }
+
+    fn block_range(&self, block: usize) -> (usize, usize) {
+        let start = u32_at(&self.data, self.index_offset + block * INDEX_ENTRY_SIZE);
+        let end = match block + 1 == self.block_count {
+            true => self.index_offset,
+            false => u32_at(
+                &self.data,
+                self.index_offset + (block + 1) * INDEX_ENTRY_SIZE,
+            ),
+        };
+        (start, end)
+    }
+
+    fn block_max_frequency(&self, block: usize) -> u8 {
+        self.data[self.index_offset + block * INDEX_ENTRY_SIZE + 4]
+    }
+
+    fn entry_at(&self, offset: usize) -> Option<Entry<'_>> {
+        let shared = *self.data.get(offset)? as usize;
+        let len = *self.data.get(offset + 1)? as usize;
+        let suffix = self.data.get(offset + 2..offset + 2 + len)?;
+        let frequency = *self.data.get(offset + 2 + len)?;
+        Some(Entry { shared, suffix, frequency })
+    }
+
+    /// The first word of a block is stored whole
+    fn block_first_word(&self, block: usize) -> &[u8] {
+        let (start, _end) = self.block_range(block);
+        self.entry_at(start).map(|e| e.suffix).unwrap_or(&[])
+    }
+
+    /// Returns up to `count` most frequent words starting with `prefix`,
+    /// most frequent first. The prefix itself is not included.
+    pub fn complete(&self, prefix: &str, count: usize) -> Vec<String> {
+        let prefix = prefix.as_bytes();
+        if self.block_count == 0 || count == 0 {
+            return Vec::new();
+        }
+        // Last block starting not after the prefix
+        let first = {
+            let (mut low, mut high) = (0, self.block_count);
+            while high - low > 1 {
+                let mid = (low + high) / 2;
+                match self.block_first_word(mid) <= prefix {
+                    true => low = mid,
+                    false => high = mid,
+                }
+            }
+            low
+        };
+
+        // Sorted by frequency, descending
+        let mut best: Vec<(u8, Vec<u8>)> = Vec::with_capacity(count + 1);
+        let mut word = Vec::with_capacity(MAX_WORD);
+        for block in first..self.block_count {
+            let first_word = self.block_first_word(block);
+            if block > first && !first_word.starts_with(prefix) {
+                break;
+            }
+            if best.len() == count
+                && self.block_max_frequency(block) <= best[count - 1].0
+            {
+                continue;
+            }
+            let (mut offset, end) = self.block_range(block);
+            word.clear();
+            while offset < end {
+                let entry = match self.entry_at(offset) {
+                    Some(entry) => entry,
+                    None => break,
+                };
+                offset += 3 + entry.suffix.len();
+                word.truncate(entry.shared);
+                word.extend_from_slice(entry.suffix);
+                if word.len() == prefix.len() || !word.starts_with(prefix) {
+                    continue;
+                }
+                let beats_last = best.len() < count
+                    || entry.frequency > best[count - 1].0;
+                if beats_last {
+                    let place = best.iter()
+                        .position(|(f, _)| *f < entry.frequency)
+                        .unwrap_or(best.len());
+                    best.insert(place, (entry.frequency, word.clone()));
+                    best.truncate(count);
+                }
+            }
+        }
+        best.into_iter()
+            .filter_map(|(_, word)| String::from_utf8(word).ok())
+            .collect()
+    }
+}
+
+impl<T: Deref<Target=[u8]>> Completions for Dictionary<T> {
+    fn complete(&self, prefix: &str, count: usize) -> Vec<String> {
+        Dictionary::complete(self, prefix, count)
+    }
+}
+
+fn is_word_char(c: char) -> bool {
+    c.is_alphanumeric() || c == '\''
+}
+
+/// Returns the part of the word which ends at the cursor.
+/// `cursor` is a byte offset, as in the text-input protocol.
+pub fn word_before_cursor(text: &str, cursor: usize) -> &str {
+    let mut cursor = cursor.min(text.len());
+    while !text.is_char_boundary(cursor) {
+        cursor -= 1;
+    }
+    let before = &text[..cursor];
+    let start = before.char_indices()
+        .rev()
+        .take_while(|(_, c)| is_word_char(*c))
+        .last()
+        .map(|(i, _)| i)
+        .unwrap_or(cursor);
+    &before[start..]
+}
+
+/// Finds completions for the word being typed.
+/// Capitalization of the typed part is preserved.
+pub fn suggest<C: Completions>(
+    dictionary: &C,
+    typed: &str,
+    count: usize,
+) -> Vec<String> {
+    if typed.is_empty() {
+        return Vec::new();
+    }
+    let lower = typed.to_lowercase();
+    dictionary.complete(&lower, count)
+        .into_iter()
+        .filter_map(|word| {
+            // Lowercasing may change lengths, then there's no way to match
+            let rest = word.get(lower.len()..)?;
+            Some(format!("{}{}", typed, rest))
+        })
+        .collect()
+}
+
+#[cfg(test)]
+mod test {
+    use super::*;
+
+    fn make_dictionary(words: &[(&str, u64)]) -> Dictionary<Vec<u8>> {
+        let words: Vec<(String, u64)> = words.iter()
+            .map(|(w, c)| (w.to_string(), *c))
+            .collect();
+        Dictionary::new(build(&words)).unwrap()
+    }
+
+    #[test]
+    fn complete_by_frequency() {
+        let mut words = vec![("the", 1000), ("then", 50), ("there", 300), ("this", 200)];
+        // Enough words to fill several blocks
+        let filler: Vec<String> = (0..100).map(|i| format!("th{:03}", i)).collect();
+        words.extend(filler.iter().map(|w| (w.as_str(), 1)));
+        let dictionary = make_dictionary(&words);
+        assert_eq!(
+            dictionary.complete("the", 2),
+            vec!["there".to_string(), "then".to_string()],
+        );
+        assert_eq!(dictionary.complete("th", 1), vec!["the".to_string()]);
+        assert!(dictionary.complete("x", 3).is_empty());
+    }
+
+    #[test]
+    fn reject_corrupted() {
+        let mut data = build(&[("word".into(), 1)]);
+        let last = data.len() - 1;
+        data.truncate(last);
+        assert!(Dictionary::new(data).is_err());
+    }
+
+    #[test]
+    fn word_at_cursor() {
+        assert_eq!(word_before_cursor("Hello wor", 9), "wor");
+        assert_eq!(word_before_cursor("Hello wor", 5), "Hello");
+        assert_eq!(word_before_cursor("Hello ", 6), "");
+        assert_eq!(word_before_cursor("żółw", 7), "żółw");
+        // Not on a character boundary
+        assert_eq!(word_before_cursor("żółw", 5), "żó");
+    }
+
+    #[test]
+    fn suggest_keeps_case() {
+        let dictionary = make_dictionary(&[("hello", 5), ("help", 1)]);
+        assert_eq!(
+            suggest(&dictionary, "Hel", 2),
+            vec!["Hello".to_string(), "Help".to_string()],
+        );
+    }
+}
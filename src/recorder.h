@@ -0,0 +1,24 @@
+#ifndef __RECORDER_H
+#define __RECORDER_H
+
+#include "inttypes.h"
+
+/// Matches recorder::Kind
+enum squeek_touch_kind {
+    SQUEEK_TOUCH_PRESS = 0,
+    SQUEEK_TOUCH_DRAG = 1,
+    SQUEEK_TOUCH_RELEASE = 2,
+    SQUEEK_TOUCH_GEOMETRY = 3,
+};
+
+struct squeek_recorder;
+
+// Defined in Rust
+/// Returns NULL unless SQUEEKBOARD_RECORD_TOUCH names a file to record to.
+struct squeek_recorder *squeek_recorder_new_from_env(void);
+void squeek_recorder_free(struct squeek_recorder *recorder);
+/// `recorder` may be NULL. `sequence` is NULL for the pointer device.
+void squeek_recorder_record(struct squeek_recorder *recorder,
+                            uint8_t kind, const void *sequence,
+                            double x, double y, uint32_t time);
+#endif
@@ -0,0 +1,289 @@
+/* Copyright (C) 2026 Purism SPC
+ * SPDX-License-Identifier: GPL-3.0+
+ */
+
+/*! Recording of the raw touch stream.
+ *
+ * The recording contains the press, drag and release events
+ * exactly as the widget received them, in widget coordinates,
+ * together with the widget size needed to map them onto a layout.
+ *
+ * Recordings can be replayed without a compositor, see `replay`.
+ *
+ * The format is a 4-byte magic, a version byte,
+ * and then fixed-size little-endian records:
+ *
+ * ``
+ * kind: u8, sequence: u16, time: u32, x: f32, y: f32
+ * ``
+ *
+ * For `Kind::Geometry`, x and y carry the allocation width and height.
+ */
+
+use std::collections::HashMap;
+use std::env;
+use std::fs::File;
+use std::io;
+use std::io::{ BufReader, BufWriter, Read, Write };
+use std::path::Path;
+
+use crate::logging;
+
+// Traits
+use crate::logging::Warn;
+
+const MAGIC: &[u8; 4] = b"SQTR";
+const VERSION: u8 = 1;
+const RECORD_SIZE: usize = 15;
+
+pub static RECORD_ENV_VAR: &str = "SQUEEKBOARD_RECORD_TOUCH";
+
+/// Gathers stuff defined in C or called by C
+pub mod c {
+    use super::*;
+
+    /// Returns null when recording is not enabled.
+    #[no_mangle]
+    pub extern "C"
+    fn squeek_recorder_new_from_env() -> *mut Recorder {
+        match env::var_os(RECORD_ENV_VAR) {
+            Some(path) => Recorder::create(Path::new(&path))
+                .or_print(
+                    logging::Problem::Warning,
+                    &format!("Can't record touches into {:?}", path),
+                )
+                .map(|recorder| Box::into_raw(Box::new(recorder)))
+                .unwrap_or(std::ptr::null_mut()),
+            None => std::ptr::null_mut(),
+        }
+    }
+
+    #[no_mangle]
+    pub extern "C"
+    fn squeek_recorder_free(recorder: *mut Recorder) {
+        if !recorder.is_null() {
+            unsafe { Box::from_raw(recorder) };
+        }
+    }
+
+    /// `sequence` is an opaque pointer identifying the touch point.
+    /// It may be null for the pointer device.
+    #[no_mangle]
+    pub extern "C"
+    fn squeek_recorder_record(
+        recorder: *mut Recorder,
+        kind: u8,
+        sequence: *const std::os::raw::c_void,
+        x: f64, y: f64,
+        time: u32,
+    ) {
+        if recorder.is_null() {
+            return;
+        }
+        let recorder = unsafe { &mut *recorder };
+        let kind = match Kind::from_u8(kind) {
+            Some(kind) => kind,
+            None => {
+                log_print!(logging::Level::Bug, "Bad touch kind {}", kind);
+                return;
+            },
+        };
+        let sequence = recorder.sequence_id(kind, sequence as usize);
+        recorder.record(Event { kind, sequence, time, x: x as f32, y: y as f32 })
+            .or_print(logging::Problem::Warning, "Failed to record touch");
+    }
+}
+
+/// Matches `enum squeek_touch_kind` in recorder.h
+#[derive(Debug, Clone, Copy, PartialEq)]
+pub enum Kind {
+    Press = 0,
+    Drag = 1,
+    Release = 2,
+    /// The widget got resized
+    Geometry = 3,
+}
+
+impl Kind {
+    fn from_u8(v: u8) -> Option<Kind> {
+        match v {
+            0 => Some(Kind::Press),
+            1 => Some(Kind::Drag),
+            2 => Some(Kind::Release),
+            3 => Some(Kind::Geometry),
+            _ => None,
+        }
+    }
+}
+
+#[derive(Debug, Clone, PartialEq)]
+pub struct Event {
+    pub kind: Kind,
+    /// 0 is reserved for the pointer device
+    pub sequence: u16,
+    /// Milliseconds, as received from GDK
+    pub time: u32,
+    pub x: f32,
+    pub y: f32,
+}
+
+impl Event {
+    fn encode(&self) -> [u8; RECORD_SIZE] {
+        let mut out = [0; RECORD_SIZE];
+        out[0] = self.kind as u8;
+        out[1..3].copy_from_slice(&self.sequence.to_le_bytes());
+        out[3..7].copy_from_slice(&self.time.to_le_bytes());
+        out[7..11].copy_from_slice(&self.x.to_le_bytes());
+        out[11..15].copy_from_slice(&self.y.to_le_bytes());
+        out
+    }
+
+    fn decode(data: &[u8; RECORD_SIZE]) -> Result<Event, Error> {
+        let u16_at = |i: usize| u16::from_le_bytes([data[i], data[i + 1]]);
+        let u32_at = |i: usize| u32::from_le_bytes(
+            [data[i], data[i + 1], data[i + 2], data[i + 3]]
+        );
+        Ok(Event {
+            kind: Kind::from_u8(data[0]).ok_or(Error::BadKind(data[0]))?,
+            sequence: u16_at(1),
+            time: u32_at(3),
+            x: f32::from_bits(u32_at(7)),
+            y: f32::from_bits(u32_at(11)),
+        })
+    }
+}
+
+#[derive(Debug)]
+pub enum Error {
+    Io(io::Error),
+    BadHeader,
+    BadKind(u8),
+}
+
+impl std::fmt::Display for Error {
+    fn fmt(&self, f: &mut std::fmt::Formatter<'_>) -> std::fmt::Result {
+        match self {
+            Error::Io(e) => write!(f, "IO: {}", e),
+            Error::BadHeader => write!(f, "Not a touch recording"),
+            Error::BadKind(k) => write!(f, "Unknown event kind {}", k),
+        }
+    }
+}
+
+impl From<io::Error> for Error {
+    fn from(e: io::Error) -> Self {
+        Error::Io(e)
+    }
+}
+
+pub struct Recorder {
+    out: BufWriter<File>,
+    /// Maps opaque sequence pointers to compact ids.
+    sequences: HashMap<usize, u16>,
+    next_sequence: u16,
+}
+
+impl Recorder {
+    pub fn create(path: &Path) -> Result<Recorder, io::Error> {
+        let mut out = BufWriter::new(File::create(path)?);
+        out.write_all(MAGIC)?;
+        out.write_all(&[VERSION])?;
+        Ok(Recorder {
+            out,
+            sequences: HashMap::new(),
+            // 0 stays reserved for the pointer device
+            next_sequence: 1,
+        })
+    }
+
+    /// Pointers get reused by GDK, so every press starts a new id.
+    fn sequence_id(&mut self, kind: Kind, sequence: usize) -> u16 {
+        if sequence == 0 {
+            return 0;
+        }
+        match kind {
+            Kind::Press => {
+                let id = self.next_sequence;
+                self.next_sequence = self.next_sequence.wrapping_add(1).max(1);
+                self.sequences.insert(sequence, id);
+                id
+            },
+            Kind::Release => self.sequences.remove(&sequence).unwrap_or(0),
+            _ => self.sequences.get(&sequence).cloned().unwrap_or(0),
+        }
+    }
+
+    pub fn record(&mut self, event: Event) -> Result<(), io::Error> {
+        self.out.write_all(&event.encode())?;
+        // A stroke is complete, so don't lose it if the process dies.
+        if event.kind == Kind::Release {
+            self.out.flush()?;
+        }
+        Ok(())
+    }
+}
+
+/// Reads a whole recording.
+pub fn read<R: Read>(input: R) -> Result<Vec<Event>, Error> {
+    let mut input = BufReader::new(input);
+    let mut header = [0; 5];
+    input.read_exact(&mut header)
+        .map_err(|_| Error::BadHeader)?;
+    if &header[..4] != MAGIC || header[4] != VERSION {
+        return Err(Error::BadHeader);
+    }
+    let mut events = Vec::new();
+    let mut record = [0; RECORD_SIZE];
+    loop {
+        match input.read_exact(&mut record) {
+            Ok(()) => events.push(Event::decode(&record)?),
+            Err(e) if e.kind() == io::ErrorKind::UnexpectedEof => break,
+            Err(e) => return Err(e.into()),
+        }
+    }
+    Ok(events)
+}
+
+pub fn read_file(path: &Path) -> Result<Vec<Event>, Error> {
+    read(File::open(path)?)
+}
+
+#[cfg(test)]
+mod test {
+    use super::*;
+
+    #[test]
+    fn roundtrip() {
+        let event = Event {
+            kind: Kind::Drag,
+            sequence: 513,
+            time: 0xdead_beef,
+            x: 12.5,
+            y: -3.25,
+        };
+        assert_eq!(Event::decode(&event.encode()).unwrap(), event);
+    }
+
+    #[test]
+    fn read_truncated() {
+        let mut data = Vec::from(&MAGIC[..]);
+        data.push(VERSION);
+        data.extend_from_slice(&Event {
+            kind: Kind::Press,
+            sequence: 1,
+            time: 5,
+            x: 1.0,
+            y: 2.0,
+        }.encode());
+        // A partial record from an interrupted write is dropped
+        data.extend_from_slice(&[2, 1]);
+        let events = read(&data[..]).unwrap();
+        assert_eq!(events.len(), 1);
+        assert_eq!(events[0].kind, Kind::Press);
+    }
+
+    #[test]
+    fn read_bad_header() {
+        assert!(read(&b"SQTX\x01"[..]).is_err());
+    }
+}
@@ -0,0 +1,301 @@
+/* Copyright (C) 2026 Purism SPC
+ * SPDX-License-Identifier: GPL-3.0+
+ */
+
+/*! Auto-repeat of held buttons.
+ *
+ * Erasing and moving the cursor get repeated while the button is held:
+ * first after a delay, and then at a steady rate.
+ *
+ * A single timer drives the repeats.
+ * It fires once after the delay, and then periodically,
+ * so that holding a button costs no allocations per repeat.
+ * When the main loop falls behind, the repeats due in the meantime
+ * get submitted together instead of piling up.
+ */
+
+use std::cell::RefCell;
+use std::env;
+use std::rc::Rc;
+use std::time::{ Duration, Instant };
+
+use crate::keyboard::KeyStateId;
+use crate::logging;
+use crate::submission::{ Submission, Timestamp };
+
+// Traits
+use crate::logging::Warn;
+
+const DEFAULT_DELAY_MS: u32 = 500;
+/// Repeats per second
+const DEFAULT_RATE: u32 = 25;
+/// A late timer doesn't catch up with more repeats than that.
+const MAX_BATCH: u32 = 50;
+
+/// In milliseconds
+pub static DELAY_ENV_VAR: &str = "SQUEEKBOARD_REPEAT_DELAY";
+/// Repeats per second. 0 disables repeating.
+pub static RATE_ENV_VAR: &str = "SQUEEKBOARD_REPEAT_RATE";
+
+#[derive(Debug, Clone, Copy, PartialEq)]
+pub struct Config {
+    pub delay: Duration,
+    /// None when repeating is disabled
+    pub interval: Option<Duration>,
+}
+
+impl Config {
+    pub fn new(delay_ms: u32, rate: u32) -> Config {
+        Config {
+            delay: Duration::from_millis(delay_ms as u64),
+            interval: match rate {
+                0 => None,
+                rate => Some(Duration::from_secs(1) / rate),
+            },
+        }
+    }
+
+    /// Falls back to defaults for anything not set.
+    pub fn from_env() -> Config {
+        fn read(name: &str, default: u32) -> u32 {
+            match env::var(name) {
+                Ok(value) => value.parse::<u32>()
+                    .or_print(
+                        logging::Problem::Warning,
+                        &format!("{} is not a number", name),
+                    )
+                    .unwrap_or(default),
+                Err(_) => default,
+            }
+        }
+        Config::new(
+            read(DELAY_ENV_VAR, DEFAULT_DELAY_MS),
+            read(RATE_ENV_VAR, DEFAULT_RATE),
+        )
+    }
+}
+
+impl Default for Config {
+    fn default() -> Config {
+        Config::new(DEFAULT_DELAY_MS, DEFAULT_RATE)
+    }
+}
+
+/// Repeats to submit in one go
+pub struct Due {
+    pub key_id: KeyStateId,
+    pub erases: bool,
+    pub count: u32,
+    /// Event time of the last repeat
+    pub time: Timestamp,
+}
+
+struct Held {
+    key_id: KeyStateId,
+    erases: bool,
+    pressed_at: Instant,
+    press_time: Timestamp,
+    next: Instant,
+}
+
+pub struct Repeater {
+    config: Config,
+    /// Only the last pressed button repeats
+    held: Option<Held>,
+}
+
+impl Repeater {
+    pub fn new(config: Config) -> Repeater {
+        Repeater { config, held: None }
+    }
+
+    pub fn get_interval(&self) -> Option<Duration> {
+        self.config.interval
+    }
+
+    pub fn press(
+        &mut self,
+        key_id: KeyStateId,
+        erases: bool,
+        time: Timestamp,
+        now: Instant,
+    ) {
+        self.held = match self.config.interval {
+            Some(_) => Some(Held {
+                key_id,
+                erases,
+                pressed_at: now,
+                press_time: time,
+                next: now + self.config.delay,
+            }),
+            None => None,
+        };
+    }
+
+    /// Pressing another button also stops repeating.
+    pub fn release(&mut self, key_id: &KeyStateId) {
+        if let Some(held) = &self.held {
+            if held.key_id == *key_id {
+                self.held = None;
+            }
+        }
+    }
+
+    pub fn cancel(&mut self) {
+        self.held = None;
+    }
+
+    pub fn next_wake(&self) -> Option<Instant> {
+        self.held.as_ref().map(|held| held.next)
+    }
+
+    /// Takes the repeats due by `now`.
+    pub fn take_due(&mut self, now: Instant) -> Option<Due> {
+        let interval = self.config.interval?;
+        let held = self.held.as_mut()?;
+        if now < held.next {
+            return None;
+        }
+        let late = now - held.next;
+        let count = (late.as_nanos() / interval.as_nanos()) as u32 + 1;
+        let count = match count > MAX_BATCH {
+            true => {
+                // Too far behind, give up on the missed ones
+                held.next = now + interval;
+                MAX_BATCH
+            },
+            false => {
+                // Keep to the schedule, so that repeats don't drift
+                held.next += interval * count;
+                count
+            },
+        };
+        let elapsed = (now - held.pressed_at).as_millis() as u32;
+        Some(Due {
+            key_id: held.key_id.clone(),
+            erases: held.erases,
+            count,
+            time: Timestamp(held.press_time.0.wrapping_add(elapsed)),
+        })
+    }
+}
+
+thread_local! {
+    /// The only repeat timer
+    static TIMER: RefCell<Option<glib::SourceId>> = RefCell::new(None);
+}
+
+fn remove_source(id: glib::SourceId) {
+    #[cfg(feature = "glib_v0_14")]
+    id.remove();
+    #[cfg(not(feature = "glib_v0_14"))]
+    glib::source_remove(id);
+}
+
+pub fn add_timeout<F: FnMut() -> glib::Continue + 'static>(
+    interval: Duration,
+    callback: F,
+) -> glib::SourceId {
+    #[cfg(feature = "glib_v0_14")]
+    return glib::timeout_add_local(interval, callback);
+    #[cfg(not(feature = "glib_v0_14"))]
+    return glib::timeout_add_local(interval.as_millis() as u32, callback);
+}
+
+/// Replaces the timer to match the held button.
+/// Call after pressing and releasing buttons.
+pub fn arm_timer(submission: &Rc<RefCell<Submission>>) {
+    let wake = submission.borrow().get_next_repeat();
+    TIMER.with(|timer| {
+        if let Some(id) = timer.borrow_mut().take() {
+            remove_source(id);
+        }
+        if let Some(wake) = wake {
+            let delay = wake.saturating_duration_since(Instant::now());
+            let submission = submission.clone();
+            let id = add_timeout(delay, move || {
+                submission.borrow_mut().handle_repeat(Instant::now());
+                let interval = {
+                    let submission = submission.borrow();
+                    submission.get_next_repeat()
+                        .and(submission.get_repeat_interval())
+                };
+                TIMER.with(|timer| {
+                    // This source is done after returning
+                    timer.borrow_mut().take();
+                    if let Some(interval) = interval {
+                        let submission = submission.clone();
+                        let id = add_timeout(interval, move || {
+                            let mut submission = submission.borrow_mut();
+                            submission.handle_repeat(Instant::now());
+                            match submission.get_next_repeat() {
+                                Some(_) => glib::Continue(true),
+                                None => {
+                                    TIMER.with(|timer| timer.borrow_mut().take());
+                                    glib::Continue(false)
+                                },
+                            }
+                        });
+                        *timer.borrow_mut() = Some(id);
+                    }
+                });
+                glib::Continue(false)
+            });
+            *timer.borrow_mut() = Some(id);
+        }
+    });
+}
+
+#[cfg(test)]
+mod test {
+    use super::*;
+
+    use crate::layout::ButtonPosition;
+
+    fn key() -> KeyStateId {
+        (&ButtonPosition {
+            view: "base".into(),
+            row: 0,
+            position_in_row: 0,
+        }).into()
+    }
+
+    #[test]
+    fn repeats_after_delay() {
+        let mut repeater = Repeater::new(Config::new(500, 25));
+        let start = Instant::now();
+        repeater.press(key(), true, Timestamp(1000), start);
+        assert!(repeater.take_due(start + Duration::from_millis(499)).is_none());
+        let due = repeater.take_due(start + Duration::from_millis(500)).unwrap();
+        assert_eq!(due.count, 1);
+        assert_eq!(due.time.0, 1500);
+        assert_eq!(
+            repeater.next_wake(),
+            Some(start + Duration::from_millis(540)),
+        );
+    }
+
+    #[test]
+    fn late_repeats_batched() {
+        let mut repeater = Repeater::new(Config::new(500, 25));
+        let start = Instant::now();
+        repeater.press(key(), true, Timestamp(0), start);
+        // Two intervals late
+        let due = repeater.take_due(start + Duration::from_millis(590)).unwrap();
+        assert_eq!(due.count, 3);
+        assert_eq!(
+            repeater.next_wake(),
+            Some(start + Duration::from_millis(620)),
+        );
+    }
+
+    #[test]
+    fn release_stops() {
+        let mut repeater = Repeater::new(Config::new(500, 25));
+        let start = Instant::now();
+        repeater.press(key(), false, Timestamp(0), start);
+        repeater.release(&key());
+        assert!(repeater.next_wake().is_none());
+        assert!(repeater.take_due(start + Duration::from_secs(1)).is_none());
+    }
+}
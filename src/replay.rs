@@ -0,0 +1,713 @@
+/* Copyright (C) 2026 Purism SPC
+ * SPDX-License-Identifier: GPL-3.0+
+ */
+
+/*! Offline replay of recorded touch streams.
+ *
+ * Recordings made with `recorder` are fed through the same layout logic
+ * as live input, but submitted into a log instead of a compositor.
+ * The log can then be compared between versions,
+ * or used to measure how quickly input gets processed.
+ */
+
+use std::cell::RefCell;
+use std::collections::HashMap;
+use std::ffi::CStr;
+use std::fmt;
+use std::fs::File;
+use std::path::Path;
+use std::rc::Rc;
+use std::time::{ Duration, Instant };
+
+use crate::action::Action;
+use crate::batch;
+use crate::data::loading;
+use crate::imservice;
+use crate::imservice::{ ContentPurpose, IMService };
+use crate::keyboard::{ Modifiers, PressType };
+use crate::layout;
+use crate::layout::Layout;
+use crate::layout::c::{ Point, Transformation };
+use crate::layout::seat;
+use crate::recorder;
+use crate::recorder::Kind;
+use crate::submission::{ Submission, Timestamp };
+use crate::vkeyboard;
+use crate::vkeyboard::VirtualKeyboard;
+
+pub use crate::layout::ArrangementKind;
+
+// Traits
+use std::os::unix::io::AsRawFd;
+
+/// Whatever left squeekboard towards the compositor
+#[derive(Debug, Clone, PartialEq)]
+pub enum Emitted {
+    /// Keycode in the xkb space, and the keymap it refers to
+    Key { code: u32, keymap_idx: Option<usize>, pressed: bool },
+    Modifiers(u8),
+    Keymap(Option<usize>),
+    Text(String),
+    Delete { before: u32, after: u32 },
+    /// Text and cursor
+    Preedit(String, i32),
+    Commit,
+}
+
+#[derive(Default)]
+struct LogState {
+    events: Vec<Emitted>,
+    /// Raw fds of the loaded keymaps, in the order of keymap indices
+    keymap_fds: Vec<i32>,
+    /// Keymaps are loaded all together, and then one gets selected.
+    /// A load after a selection means a new layout.
+    loading: bool,
+    current_keymap: Option<usize>,
+}
+
+/// Stands in for the Wayland protocols, writing down everything.
+#[derive(Clone, Default)]
+pub struct Log(Rc<RefCell<LogState>>);
+
+impl Log {
+    fn push(&self, event: Emitted) {
+        self.0.borrow_mut().events.push(event);
+    }
+
+    pub fn take(&self) -> Vec<Emitted> {
+        std::mem::replace(&mut self.0.borrow_mut().events, Vec::new())
+    }
+}
+
+impl vkeyboard::Backend for Log {
+    fn key(&self, keycode: u32, action: PressType, _timestamp: Timestamp) {
+        let keymap_idx = self.0.borrow().current_keymap;
+        self.push(Emitted::Key {
+            // Undo the protocol offset
+            code: keycode + 8,
+            keymap_idx,
+            pressed: action == PressType::Pressed,
+        });
+    }
+
+    fn set_modifiers(&self, modifiers: Modifiers) {
+        self.push(Emitted::Modifiers(modifiers.bits()));
+    }
+
+    fn load_keymap(&self, keymap: &CStr) -> vkeyboard::c::KeyMap {
+        // The contents don't matter, the fd only serves as an identifier.
+        let file = File::open("/dev/null")
+            .expect("Can't open /dev/null");
+        let keymap = vkeyboard::c::KeyMap::from_file(
+            file,
+            keymap.to_bytes_with_nul().len(),
+        );
+        let mut state = self.0.borrow_mut();
+        if !state.loading {
+            state.keymap_fds.clear();
+            state.loading = true;
+        }
+        state.keymap_fds.push(keymap.as_raw_fd());
+        keymap
+    }
+
+    fn update_keymap(&self, keymap: &vkeyboard::c::KeyMap) {
+        let idx = {
+            let mut state = self.0.borrow_mut();
+            let fd = keymap.as_raw_fd();
+            state.loading = false;
+            state.current_keymap = state.keymap_fds.iter()
+                .position(|f| *f == fd);
+            state.current_keymap
+        };
+        self.push(Emitted::Keymap(idx));
+    }
+}
+
+impl imservice::Backend for Log {
+    fn commit_string(&self, text: &CStr) {
+        self.push(Emitted::Text(text.to_string_lossy().into()));
+    }
+
+    fn delete_surrounding_text(&self, before: u32, after: u32) {
+        self.push(Emitted::Delete { before, after });
+    }
+
+    fn set_preedit_string(&self, text: &CStr, _cursor_begin: i32, cursor_end: i32) {
+        self.push(Emitted::Preedit(text.to_string_lossy().into(), cursor_end));
+    }
+
+    fn commit(&self, _serial: u32) {
+        self.push(Emitted::Commit);
+    }
+
+    fn destroy(&self) {}
+}
+
+/// Drives a layout the same way `eek-gtk-keyboard.c` does.
+pub struct Replay {
+    layout: Layout,
+    submission: Submission,
+    log: Log,
+    /// Same as the initial geometry in the widget.
+    widget_to_layout: Transformation,
+    /// The touch point which is allowed to move
+    current_sequence: Option<u16>,
+}
+
+impl Replay {
+    pub fn new(layout: Layout, im_active: bool) -> Replay {
+        let log = Log::default();
+        let imservice = match im_active {
+            true => Some(IMService::new_detached(Box::new(log.clone()), true)),
+            false => None,
+        };
+        let mut submission = Submission::new(
+            VirtualKeyboard::new(Box::new(log.clone())),
+            imservice,
+        );
+        // Without timers, batched text could never get sent
+        submission.set_batch_config(batch::Config::new(0));
+        submission.use_layout(&layout.shape, Timestamp(0));
+        Replay {
+            layout,
+            submission,
+            log,
+            widget_to_layout: Transformation {
+                origin_x: 0.0,
+                origin_y: 0.0,
+                scale_x: 1.0,
+                scale_y: 1.0,
+            },
+            current_sequence: None,
+        }
+    }
+
+    fn press(&mut self, x: f32, y: f32, time: Timestamp) {
+        let point = self.to_layout(x, y);
+        seat::handle_press_at(&mut self.layout, &mut self.submission, time, point);
+    }
+
+    fn drag(&mut self, x: f32, y: f32, time: Timestamp) {
+        let point = self.to_layout(x, y);
+        seat::handle_drag_to(
+            &mut self.layout,
+            &mut self.submission,
+            None,
+            time,
+            None,
+            point,
+        );
+    }
+
+    fn release(&mut self, time: Timestamp) {
+        seat::handle_release_all(
+            &mut self.layout,
+            &mut self.submission,
+            None,
+            time,
+            None,
+        );
+    }
+
+    fn to_layout(&self, x: f32, y: f32) -> Point {
+        self.widget_to_layout.forward(Point { x: x as f64, y: y as f64 })
+    }
+
+    /// Applies the same filtering as the touch handler in the widget:
+    /// a new touch releases the previous one,
+    /// and only the latest touch point is followed.
+    pub fn apply(&mut self, event: &recorder::Event) {
+        let time = Timestamp(event.time);
+        let touch = event.sequence != 0;
+        if event.kind != Kind::Geometry {
+            self.check_long_press(time);
+        }
+        match event.kind {
+            Kind::Geometry => {
+                self.widget_to_layout = self.layout.shape.calculate_transformation(
+                    layout::Size {
+                        width: event.x as f64,
+                        height: event.y as f64,
+                    }
+                );
+            },
+            Kind::Press => {
+                if touch {
+                    self.release(time);
+                    self.current_sequence = Some(event.sequence);
+                }
+                self.press(event.x, event.y, time);
+            },
+            Kind::Drag => {
+                if !touch || self.current_sequence == Some(event.sequence) {
+                    self.drag(event.x, event.y, time);
+                }
+            },
+            Kind::Release => {
+                if !touch {
+                    self.release(time);
+                } else if self.current_sequence == Some(event.sequence) {
+                    self.release(time);
+                    self.current_sequence = None;
+                }
+            },
+        }
+    }
+
+    /// Stands in for the widget's long press timer
+    fn check_long_press(&mut self, time: Timestamp) {
+        if let Some(due) = self.layout.get_long_press_due() {
+            if time.0.wrapping_sub(due.0) as i32 >= 0 {
+                seat::handle_long_press(&mut self.layout);
+            }
+        }
+    }
+
+    pub fn take_emitted(&self) -> Vec<Emitted> {
+        self.log.take()
+    }
+
+    /// Maps (keymap, keycode) back to keysym names for readable reports
+    fn keysym_names(&self) -> HashMap<(usize, u32), String> {
+        let mut names = HashMap::new();
+        for (_offset, view) in self.layout.shape.views.values() {
+            for (_y, row) in view.get_rows() {
+                for (_x, button) in row.get_buttons() {
+                    let syms = match &button.action {
+                        Action::Submit { keys, .. } => keys.iter()
+                            .map(|k| k.0.clone())
+                            .collect(),
+                        Action::Erase => vec!["BackSpace".into()],
+                        _ => Vec::new(),
+                    };
+                    for (keycode, sym) in button.keycodes.iter().zip(syms) {
+                        names.insert((keycode.keymap_idx, keycode.code), sym);
+                    }
+                }
+            }
+        }
+        names
+    }
+}
+
+pub struct Report {
+    pub emitted: Vec<Emitted>,
+    keysym_names: HashMap<(usize, u32), String>,
+    pub touch_events: usize,
+    /// Time between the first and the last recorded event
+    pub recorded: Duration,
+    /// Time needed to process the events
+    pub processing: Duration,
+}
+
+impl fmt::Display for Report {
+    fn fmt(&self, f: &mut fmt::Formatter<'_>) -> fmt::Result {
+        for event in &self.emitted {
+            match event {
+                Emitted::Key { code, keymap_idx, pressed } => {
+                    let name = keymap_idx
+                        .and_then(|idx| self.keysym_names.get(&(idx, *code)))
+                        .map(String::as_str)
+                        .unwrap_or("?");
+                    writeln!(
+                        f,
+                        "key {} {} ({:?}:{})",
+                        if *pressed { "press" } else { "release" },
+                        name, keymap_idx, code,
+                    )?
+                },
+                Emitted::Modifiers(m) => writeln!(f, "modifiers {:#04x}", m)?,
+                Emitted::Keymap(idx) => writeln!(f, "keymap {:?}", idx)?,
+                Emitted::Text(text) => writeln!(f, "text {:?}", text)?,
+                Emitted::Delete { before, after }
+                    => writeln!(f, "delete {} {}", before, after)?,
+                Emitted::Preedit(text, cursor)
+                    => writeln!(f, "preedit {:?} {}", text, cursor)?,
+                Emitted::Commit => writeln!(f, "commit")?,
+            }
+        }
+        let per_second = |count: usize, d: Duration| {
+            count as f64 / d.as_secs_f64().max(1e-9)
+        };
+        writeln!(
+            f,
+            "{} touch events, {} emitted, recorded over {:.3}s ({:.1} events/s)",
+            self.touch_events,
+            self.emitted.len(),
+            self.recorded.as_secs_f64(),
+            per_second(self.touch_events, self.recorded),
+        )?;
+        write!(
+            f,
+            "processed in {:.3}ms ({:.0} events/s)",
+            self.processing.as_secs_f64() * 1000.0,
+            per_second(self.touch_events, self.processing),
+        )
+    }
+}
+
+/// Replays the whole recording against the named builtin or user layout.
+pub fn run(
+    layout_name: &str,
+    kind: ArrangementKind,
+    events: &[recorder::Event],
+    im_active: bool,
+) -> Report {
+    let layout = loading::load_layout(
+        &layout_name.into(),
+        kind,
+        ContentPurpose::Normal,
+        &None,
+    );
+    let mut replay = Replay::new(layout, im_active);
+    // Setup noise is not interesting
+    replay.take_emitted();
+
+    let start = Instant::now();
+    for event in events {
+        replay.apply(event);
+    }
+    let processing = start.elapsed();
+
+    let recorded = match (events.first(), events.last()) {
+        (Some(first), Some(last)) => Duration::from_millis(
+            last.time.wrapping_sub(first.time) as u64
+        ),
+        _ => Duration::from_secs(0),
+    };
+
+    Report {
+        emitted: replay.take_emitted(),
+        keysym_names: replay.keysym_names(),
+        touch_events: events.iter()
+            .filter(|e| e.kind != Kind::Geometry)
+            .count(),
+        recorded,
+        processing,
+    }
+}
+
+pub fn run_file(
+    layout_name: &str,
+    kind: ArrangementKind,
+    path: &Path,
+    im_active: bool,
+) -> Result<Report, recorder::Error> {
+    let events = recorder::read_file(path)?;
+    Ok(run(layout_name, kind, &events, im_active))
+}
+
+#[cfg(test)]
+mod test {
+    use super::*;
+
+    use std::ffi::CString;
+
+    use crate::data::parsing;
+    use crate::logging::ProblemPanic;
+    use crate::ngram::CharModel;
+    use crate::swipe;
+    use crate::touch_model;
+    use crate::touch_model::TouchModel;
+
+    fn make_layout() -> Layout {
+        let data: parsing::Layout = serde_yaml::from_str("
+views:
+    base:
+        - \"a b\"
+outlines:
+    default: { width: 1, height: 1 }
+").unwrap();
+        Layout::new(
+            data.build(ProblemPanic).0.unwrap(),
+            ArrangementKind::Base,
+            ContentPurpose::Normal,
+        )
+    }
+
+    fn find_center(layout: &Layout, name: &str) -> (f32, f32) {
+        let mut found = None;
+        layout.foreach_visible_button(|offset, button, _idx| {
+            if button.name.to_str() == Ok(name) {
+                found = Some((
+                    (offset.x + button.size.width / 2.0) as f32,
+                    (offset.y + button.size.height / 2.0) as f32,
+                ));
+            }
+        });
+        found.unwrap()
+    }
+
+    fn event(kind: Kind, sequence: u16, x: f32) -> recorder::Event {
+        recorder::Event { kind, sequence, time: 0, x, y: 0.5 }
+    }
+
+    #[test]
+    fn replay_tap_keycodes() {
+        let mut replay = Replay::new(make_layout(), false);
+        replay.take_emitted();
+        replay.apply(&event(Kind::Press, 0, 0.5));
+        replay.apply(&event(Kind::Release, 0, 0.5));
+        let emitted = replay.take_emitted();
+        assert_matches!(
+            emitted.as_slice(),
+            [
+                Emitted::Key { pressed: true, .. },
+                Emitted::Key { pressed: false, .. },
+            ]
+        );
+    }
+
+    #[test]
+    fn replay_drag_text() {
+        let mut replay = Replay::new(make_layout(), true);
+        replay.take_emitted();
+        replay.apply(&event(Kind::Press, 1, 0.5));
+        replay.apply(&event(Kind::Drag, 1, 1.5));
+        // Not the latest touch point, ignored
+        replay.apply(&event(Kind::Drag, 2, 0.5));
+        replay.apply(&event(Kind::Release, 1, 1.5));
+        assert_eq!(
+            replay.take_emitted(),
+            vec![
+                Emitted::Text("a".into()),
+                Emitted::Commit,
+                Emitted::Text("b".into()),
+                Emitted::Commit,
+            ],
+        );
+    }
+
+    #[test]
+    fn replay_text_batched() {
+        let mut replay = Replay::new(make_layout(), true);
+        replay.submission.set_batch_config(batch::Config::new(60_000));
+        replay.take_emitted();
+        replay.apply(&event(Kind::Press, 1, 0.5));
+        replay.apply(&event(Kind::Release, 1, 0.5));
+        replay.apply(&event(Kind::Press, 1, 1.5));
+        replay.apply(&event(Kind::Release, 1, 1.5));
+        assert_eq!(replay.take_emitted(), vec![]);
+        // Keymap changes must not overtake the text
+        replay.submission.use_layout(&replay.layout.shape, Timestamp(0));
+        assert_eq!(
+            replay.take_emitted(),
+            vec![
+                Emitted::Text("ab".into()),
+                Emitted::Commit,
+                Emitted::Keymap(Some(0)),
+            ],
+        );
+    }
+
+    #[test]
+    fn replay_erase_grapheme() {
+        let data: parsing::Layout = serde_yaml::from_str("
+views:
+    base:
+        - \"BackSpace a\"
+outlines:
+    default: { width: 1, height: 1 }
+buttons:
+    BackSpace:
+        action: erase
+").unwrap();
+        let layout = Layout::new(
+            data.build(ProblemPanic).0.unwrap(),
+            ArrangementKind::Base,
+            ContentPurpose::Normal,
+        );
+        let mut replay = Replay::new(layout, true);
+        replay.take_emitted();
+        // Nothing known about the text, so the application has to erase
+        replay.apply(&event(Kind::Press, 1, 0.5));
+        replay.apply(&event(Kind::Release, 1, 0.5));
+        assert_matches!(
+            replay.take_emitted().as_slice(),
+            [
+                Emitted::Key { pressed: true, .. },
+                Emitted::Key { pressed: false, .. },
+            ]
+        );
+        // e with a combining accent takes 3 bytes
+        replay.submission.get_imservice_mut().unwrap()
+            .set_detached_surrounding_text(CString::new("ae\u{301}").unwrap(), 4);
+        replay.apply(&event(Kind::Press, 1, 0.5));
+        replay.apply(&event(Kind::Release, 1, 0.5));
+        // The application didn't report the change yet
+        replay.apply(&event(Kind::Press, 1, 0.5));
+        replay.apply(&event(Kind::Release, 1, 0.5));
+        assert_eq!(
+            replay.take_emitted(),
+            vec![
+                Emitted::Delete { before: 3, after: 0 },
+                Emitted::Commit,
+                Emitted::Delete { before: 1, after: 0 },
+                Emitted::Commit,
+            ],
+        );
+    }
+
+    #[test]
+    fn replay_swipe_word() {
+        let data: parsing::Layout = serde_yaml::from_str("
+views:
+    base:
+        - \"q w e r t y\"
+outlines:
+    default: { width: 10, height: 10 }
+").unwrap();
+        let layout = Layout::new(
+            data.build(ProblemPanic).0.unwrap(),
+            ArrangementKind::Base,
+            ContentPurpose::Normal,
+        );
+        let path: Vec<_> = ["w", "e", "r", "t"].iter()
+            .map(|name| find_center(&layout, name))
+            .collect();
+        let mut replay = Replay::new(layout, true);
+        replay.submission.set_swipe_lexicon(Some(
+            swipe::Lexicon::from_reader("we 10\nwet 5\n".as_bytes()).unwrap()
+        ));
+        replay.take_emitted();
+
+        let at = |kind, (x, y): (f32, f32)| recorder::Event {
+            kind, sequence: 1, time: 0, x, y,
+        };
+        replay.apply(&at(Kind::Press, path[0]));
+        for point in &path[1..] {
+            replay.apply(&at(Kind::Drag, *point));
+        }
+        replay.apply(&at(Kind::Release, path[3]));
+        assert_eq!(
+            replay.take_emitted(),
+            vec![
+                Emitted::Text("w".into()),
+                Emitted::Commit,
+                Emitted::Text("et ".into()),
+                Emitted::Commit,
+            ],
+        );
+    }
+
+    #[test]
+    fn replay_touch_correction() {
+        let mut model = TouchModel::new();
+        // "a" always gets touched on its right edge
+        for _ in 0..50 {
+            model.handle_touch("a", touch_model::Offset { x: 0.45, y: 0.0 });
+            model.handle_touch("b", touch_model::Offset { x: 0.0, y: 0.0 });
+        }
+        let mut replay = Replay::new(make_layout(), true);
+        replay.submission.set_touch_model(Some(model));
+        replay.take_emitted();
+        // Just within "b"
+        replay.apply(&event(Kind::Press, 1, 1.05));
+        replay.apply(&event(Kind::Release, 1, 1.05));
+        assert_eq!(
+            replay.take_emitted(),
+            vec![Emitted::Text("a".into()), Emitted::Commit],
+        );
+    }
+
+    #[test]
+    fn replay_letter_prediction() {
+        let mut model = CharModel::new();
+        model.learn_text("aaa aaa aaa");
+        let mut replay = Replay::new(make_layout(), true);
+        replay.submission.set_char_model(Some(model));
+        replay.take_emitted();
+        // Just within "b", but "b" never comes up
+        replay.apply(&event(Kind::Press, 1, 1.05));
+        replay.apply(&event(Kind::Release, 1, 1.05));
+        assert_eq!(
+            replay.take_emitted(),
+            vec![Emitted::Text("a".into()), Emitted::Commit],
+        );
+    }
+
+    fn make_alternates_layout() -> Layout {
+        let data: parsing::Layout = serde_yaml::from_str("
+views:
+    base:
+        - \"e x\"
+outlines:
+    default: { width: 1, height: 1 }
+buttons:
+    e:
+        alternates: [\"é\", \"è\", \"ê\"]
+").unwrap();
+        Layout::new(
+            data.build(ProblemPanic).0.unwrap(),
+            ArrangementKind::Base,
+            ContentPurpose::Normal,
+        )
+    }
+
+    #[test]
+    fn replay_alternates_tap() {
+        let mut replay = Replay::new(make_alternates_layout(), true);
+        replay.take_emitted();
+        replay.apply(&event(Kind::Press, 1, 0.5));
+        // Nothing until it's known that it's not a long press
+        assert_eq!(replay.take_emitted(), vec![]);
+        replay.apply(&event(Kind::Release, 1, 0.5));
+        assert_eq!(
+            replay.take_emitted(),
+            vec![Emitted::Text("e".into()), Emitted::Commit],
+        );
+    }
+
+    #[test]
+    fn replay_alternates_long_press() {
+        let mut replay = Replay::new(make_alternates_layout(), true);
+        replay.take_emitted();
+        let at = |kind, time, x| recorder::Event {
+            kind, sequence: 1, time, x, y: 0.5,
+        };
+        replay.apply(&at(Kind::Press, 0, 0.5));
+        // The popup covers "x" now
+        replay.apply(&at(Kind::Drag, 1000, 1.5));
+        replay.apply(&at(Kind::Release, 1010, 1.5));
+        assert_eq!(
+            replay.take_emitted(),
+            vec![Emitted::Text("è".into()), Emitted::Commit],
+        );
+    }
+
+    #[test]
+    fn replay_erase_repeats() {
+        let data: parsing::Layout = serde_yaml::from_str("
+views:
+    base:
+        - \"BackSpace a\"
+outlines:
+    default: { width: 1, height: 1 }
+buttons:
+    BackSpace:
+        action: erase
+").unwrap();
+        let layout = Layout::new(
+            data.build(ProblemPanic).0.unwrap(),
+            ArrangementKind::Base,
+            ContentPurpose::Normal,
+        );
+        let mut replay = Replay::new(layout, false);
+        replay.take_emitted();
+        replay.apply(&event(Kind::Press, 1, 0.5));
+        let wake = replay.submission.get_next_repeat().unwrap();
+        let interval = replay.submission.get_repeat_interval().unwrap();
+        // The timer came late, so two repeats are due
+        replay.submission.handle_repeat(wake + interval);
+        replay.apply(&event(Kind::Release, 1, 0.5));
+        assert!(replay.submission.get_next_repeat().is_none());
+        let presses: Vec<bool> = replay.take_emitted().into_iter()
+            .filter_map(|e| match e {
+                Emitted::Key { pressed, .. } => Some(pressed),
+                _ => None,
+            })
+            .collect();
+        assert_eq!(presses, vec![true, false, true, false, true, false]);
+    }
+}
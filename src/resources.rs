@@ -125,6 +125,10 @@ pub fn get_keyboard(needle: &str) -> Option<&'static str> {
     KEYBOARDS.iter().find(|(name, _)| *name == needle).map(|(_, layout)| *layout)
 }
 
+pub fn get_keyboards() -> Vec<&'static str> {
+    KEYBOARDS.iter().map(|(name, _)| *name).collect()
+}
+
 static OVERLAY_NAMES: &[&'static str] = &[
     "emoji",
     "terminal",
@@ -98,6 +98,20 @@ on_name_lost (GDBusConnection *connection,
 
 // Wayland
 
+static void
+presentation_handle_clock_id (void *data,
+                              struct wp_presentation *presentation,
+                              uint32_t clk_id)
+{
+    (void)presentation;
+    struct squeek_wayland *wayland = data;
+    wayland->presentation_clock_id = clk_id;
+}
+
+static const struct wp_presentation_listener presentation_listener = {
+    presentation_handle_clock_id
+};
+
 static void
 registry_handle_global (void *data,
                         struct wl_registry *registry,
@@ -128,6 +142,11 @@ registry_handle_global (void *data,
     } else if (!strcmp(interface, "wl_seat")) {
         wayland->seat = wl_registry_bind(registry, name,
             &wl_seat_interface, 1);
+    } else if (!strcmp(interface, wp_presentation_interface.name)) {
+        wayland->presentation = wl_registry_bind(registry, name,
+            &wp_presentation_interface, 1);
+        wp_presentation_add_listener(wayland->presentation,
+            &presentation_listener, wayland);
     }
 }
 
@@ -193,6 +212,8 @@ void init_wayland(struct squeek_wayland *wayland) {
             wayland->seat);
     }
 
+    wayland->display = display;
+
     // initialize global
     squeek_wayland = wayland;
 }
@@ -415,7 +436,7 @@ main (int argc, char **argv)
     guint owner_id = 0;
     DBusHandler *service = NULL;
     if (connection) {
-        service = dbus_handler_new(connection, DBUS_SERVICE_PATH, rsobjects.state_manager);
+        service = dbus_handler_new(connection, DBUS_SERVICE_PATH, rsobjects.state_manager, rsobjects.submission, instance.settings_context);
 
         if (service == NULL) {
             g_printerr ("Can't create dbus server\n");
@@ -11,4 +11,8 @@ struct submission;
 // Defined in Rust
 uint8_t submission_hint_available(struct submission *self);
 void submission_use_layout(struct submission *self, struct squeek_layout *layout, uint32_t time);
+/// Returns newline-separated words. Free with submission_free_suggestions.
+char *submission_get_suggestions(struct submission *self, uint32_t count);
+void submission_accept_suggestion(struct submission *self, const char *word);
+void submission_free_suggestions(char *suggestions);
 #endif
@@ -18,14 +18,30 @@
  * */
 
 use std::collections::HashSet;
-use std::ffi::CString;
+use std::ffi::{ CStr, CString };
+use std::rc::Rc;
+use std::sync::atomic::{ AtomicU64, Ordering };
+use std::time::{ Duration, Instant };
 
-use crate::vkeyboard::c::ZwpVirtualKeyboardV1;
-use crate::action::Modifier;
+use crate::action::{ Action, Modifier };
+use crate::batch;
+use crate::compose;
+use crate::grapheme;
 use crate::imservice;
 use crate::imservice::IMService;
+use crate::kanji;
+use crate::keyboard;
 use crate::keyboard::{ KeyCode, KeyStateId, Modifiers, PressType };
 use crate::layout;
+use crate::logging;
+use crate::ngram;
+use crate::ngram::CharModel;
+use crate::predict;
+use crate::repeat;
+use crate::swipe;
+use crate::touch_model;
+use crate::touch_model::TouchModel;
+use crate::userdict;
 use crate::util::vec_remove;
 use crate::vkeyboard;
 use crate::vkeyboard::VirtualKeyboard;
@@ -37,7 +53,9 @@ use std::iter::FromIterator;
 pub mod c {
     use super::*;
 
-    use crate::util::c::Wrapped;
+    use std::os::raw::c_char;
+
+    use crate::util::c::{ as_str, Wrapped };
 
     pub type Submission = Wrapped<super::Submission>;
     
@@ -64,8 +82,58 @@ pub mod c {
             .map(|imservice| imservice.is_active());
         (Some(true) == active) as u8
     }
+
+    #[no_mangle]
+    pub extern "C"
+    fn submission_get_suggestions(
+        submission: Submission,
+        count: u32,
+    ) -> *mut c_char {
+        let submission = submission.clone_ref();
+        let submission = submission.borrow();
+        let words = submission.get_suggestions(count as usize).join("\n");
+        CString::new(words)
+            .unwrap_or_default()
+            .into_raw()
+    }
+
+    #[no_mangle]
+    pub extern "C"
+    fn submission_free_suggestions(suggestions: *mut c_char) {
+        if !suggestions.is_null() {
+            unsafe { CString::from_raw(suggestions) };
+        }
+    }
+
+    #[no_mangle]
+    pub extern "C"
+    fn submission_accept_suggestion(
+        submission: Submission,
+        word: *const c_char,
+    ) {
+        let submission = submission.clone_ref();
+        let mut submission = submission.borrow_mut();
+        match as_str(&word) {
+            Ok(Some(word)) => submission.handle_accept_suggestion(word),
+            _ => log_print!(
+                logging::Level::Warning,
+                "Suggestion is not a valid string",
+            ),
+        }
+    }
 }
 
+/// Keys submitted as keycodes.
+/// Shared by all submissions, readable from any thread.
+pub static KEYCODE_PRESSES: AtomicU64 = AtomicU64::new(0);
+/// Keymap switches needed to submit keys
+pub static KEYMAP_SWAPS: AtomicU64 = AtomicU64::new(0);
+/// Keymaps sent to the compositor for any reason, including new layouts.
+/// Each one gets compiled again by every application in focus.
+pub static KEYMAP_UPDATES: AtomicU64 = AtomicU64::new(0);
+/// Batches of text changes committed with the input method
+pub static TEXT_COMMITS: AtomicU64 = AtomicU64::new(0);
+
 #[derive(Clone, Copy)]
 pub struct Timestamp(pub u32);
 
@@ -81,25 +149,387 @@ pub struct Submission {
     virtual_keyboard: VirtualKeyboard,
     modifiers_active: Vec<(KeyStateId, Modifier)>,
     pressed: Vec<(KeyStateId, SubmittedAction)>,
-    keymap_fds: Vec<vkeyboard::c::KeyMap>,
+    /// Shared with the keymap cache
+    keymap_fds: Vec<Rc<vkeyboard::c::KeyMap>>,
+    /// Name of the layout owning the keymaps
+    layout_name: String,
+    keymap_churn: Option<vkeyboard::ChurnStats>,
     keymap_idx: Option<usize>,
+    /// Present when swipe typing is available
+    swipe: Option<swipe::Engine>,
+    /// Present when word prediction is available
+    dictionary: Option<predict::Dictionary>,
+    /// Present when the words picked by the user are remembered
+    learned: Option<userdict::Store>,
+    /// Present when kana can be converted into kanji
+    kanji: Option<kanji::Dictionary>,
+    /// Kana waiting for conversion, shown as preedit text
+    reading: String,
+    /// Accent waiting for the next letter, shown as preedit text
+    dead_key: Option<&'static compose::DeadKey>,
+    /// Present when touch correction is enabled
+    touch_model: Option<TouchModel>,
+    /// Present when letter prediction should adjust touch targets
+    char_model: Option<CharModel>,
+    repeater: repeat::Repeater,
+    /// Changes sent since the last surrounding text update,
+    /// together with the input method serial of that update
+    unreported: Option<(u32, Unreported)>,
+    /// Text changes waiting to get committed together
+    batch: batch::Batch,
+}
+
+/// Bytes of text kept for erasing before it's reported
+const UNREPORTED_KEPT: usize = 256;
+
+/// What the application should have done with the changes
+/// it hasn't reported yet
+enum Unreported {
+    /// The end of the text before the cursor after the changes
+    Text(String),
+    /// Key presses went through, with unknown effect on the text
+    Unknown,
+}
+
+/// The text before the cursor as the application should have it now.
+/// None when that's unknown.
+fn text_before_cursor<'a>(
+    imservice: &'a IMService,
+    unreported: &'a Option<(u32, Unreported)>,
+) -> Option<&'a str> {
+    match unreported {
+        Some((serial, unreported)) if *serial == imservice.get_serial() => {
+            match unreported {
+                Unreported::Text(before) => Some(before.as_str()),
+                Unreported::Unknown => None,
+            }
+        },
+        _ => Some(imservice.surrounding_text().before_cursor()),
+    }
+}
+
+/// The end of the text, cut at a character boundary
+fn text_tail(text: &str) -> &str {
+    let mut start = text.len().saturating_sub(UNREPORTED_KEPT);
+    while !text.is_char_boundary(start) {
+        start += 1;
+    }
+    &text[start..]
 }
 
 pub enum SubmitData<'a> {
     Text(&'a CString),
     Erase,
     Keycodes,
+    /// Combines with the text typed next
+    DeadKey(&'static compose::DeadKey),
 }
 
 impl Submission {
-    pub fn new(vk: ZwpVirtualKeyboardV1, imservice: Option<Box<IMService>>) -> Self {
+    pub fn new(vk: VirtualKeyboard, imservice: Option<Box<IMService>>) -> Self {
         Submission {
             imservice,
             modifiers_active: Vec::new(),
-            virtual_keyboard: VirtualKeyboard(vk),
+            virtual_keyboard: vk,
             pressed: Vec::new(),
             keymap_fds: Vec::new(),
+            layout_name: String::new(),
+            keymap_churn: None,
             keymap_idx: None,
+            swipe: None,
+            dictionary: None,
+            learned: None,
+            kanji: None,
+            reading: String::new(),
+            dead_key: None,
+            touch_model: None,
+            char_model: None,
+            repeater: repeat::Repeater::new(repeat::Config::default()),
+            unreported: None,
+            batch: batch::Batch::new(batch::Config::default()),
+        }
+    }
+
+    pub fn get_imservice_mut(&mut self) -> Option<&mut IMService> {
+        self.imservice.as_deref_mut()
+    }
+
+    /// Keymap activity gets recorded there
+    pub fn set_keymap_churn(&mut self, stats: vkeyboard::ChurnStats) {
+        self.keymap_churn = Some(stats);
+    }
+
+    fn record_churn<F: FnOnce(&mut vkeyboard::Churn)>(&self, record: F) {
+        if let Some(stats) = &self.keymap_churn {
+            if let Ok(mut stats) = stats.lock() {
+                // The name only gets copied for the first record
+                match stats.get_mut(self.layout_name.as_str()) {
+                    Some(churn) => record(churn),
+                    None => record(
+                        stats.entry(self.layout_name.clone())
+                            .or_insert_with(vkeyboard::Churn::default)
+                    ),
+                }
+            }
+        }
+    }
+
+    pub fn set_touch_model(&mut self, model: Option<TouchModel>) {
+        self.touch_model = model;
+    }
+
+    pub fn set_char_model(&mut self, model: Option<CharModel>) {
+        self.char_model = model;
+    }
+
+    pub fn set_repeat_config(&mut self, config: repeat::Config) {
+        self.repeater = repeat::Repeater::new(config);
+    }
+
+    pub fn set_batch_config(&mut self, config: batch::Config) {
+        self.flush_text();
+        self.batch = batch::Batch::new(config);
+    }
+
+    /// The two characters before the cursor
+    fn get_typing_context(&self) -> ngram::Context {
+        let imservice = self.imservice.as_ref()
+            .filter(|imservice| imservice.is_active());
+        match imservice {
+            Some(imservice) => {
+                let text = imservice.surrounding_text();
+                ngram::context_before(text.text(), text.cursor())
+            },
+            None => (' ', ' '),
+        }
+    }
+
+    /// Scores how likely the touch at the offset was meant for the button.
+    /// Returns None when there's nothing to improve on plain hit testing.
+    pub fn get_touch_scorer(&self)
+        -> Option<impl Fn(&layout::Button, touch_model::Offset) -> f32 + '_>
+    {
+        if self.touch_model.is_none() && self.char_model.is_none() {
+            return None;
+        }
+        // Only computed once for all buttons
+        let context = self.get_typing_context();
+        Some(move |button: &layout::Button, offset: touch_model::Offset| {
+            let placement = match &self.touch_model {
+                Some(model) => model.log_likelihood(
+                    button.name.to_str().unwrap_or(""),
+                    offset,
+                ),
+                None => touch_model::default_log_likelihood(offset),
+            };
+            let letter = match (&self.char_model, button.get_letter()) {
+                (Some(model), Some(letter)) => model.log_odds(context, letter),
+                _ => 0.0,
+            };
+            placement + letter
+        })
+    }
+
+    /// Teaches the models about the key which got touched.
+    pub fn handle_touch(
+        &mut self,
+        button: &layout::Button,
+        offset: touch_model::Offset,
+    ) {
+        let erases = matches!(button.action, Action::Erase);
+        if let Some(model) = &mut self.touch_model {
+            if erases {
+                model.handle_erase();
+            }
+            model.handle_touch(button.name.to_str().unwrap_or(""), offset);
+        }
+        // Passwords must not end up in the saved model
+        if self.char_model.is_some() && !self.is_text_sensitive() {
+            let context = self.get_typing_context();
+            if let Some(model) = &mut self.char_model {
+                match (erases, button.get_letter()) {
+                    (true, _) => model.handle_erase(),
+                    (false, Some(letter)) => model.handle_letter(context, letter),
+                    (false, None) => model.handle_other(),
+                }
+            }
+        }
+    }
+
+    pub fn set_dictionary(&mut self, dictionary: Option<predict::Dictionary>) {
+        self.dictionary = dictionary;
+    }
+
+    pub fn set_learned_words(&mut self, learned: Option<userdict::Store>) {
+        self.learned = learned;
+    }
+
+    pub fn set_kanji_dictionary(&mut self, dictionary: Option<kanji::Dictionary>) {
+        self.flush_text();
+        self.kanji = dictionary;
+    }
+
+    /// Whether the focused text must not be predicted or remembered
+    fn is_text_sensitive(&self) -> bool {
+        self.imservice.as_ref()
+            .map(|imservice| imservice.is_active() && imservice.is_sensitive())
+            .unwrap_or(false)
+    }
+
+    /// The part of the word before the cursor,
+    /// in text fields taking words.
+    /// Includes text committed but not reported yet.
+    fn typed_word(&self) -> Option<&str> {
+        let imservice = self.imservice.as_ref()?;
+        if !imservice.is_active() || !imservice.accepts_words() {
+            return None;
+        }
+        let before = text_before_cursor(imservice, &self.unreported)?;
+        Some(predict::word_before_cursor(before, before.len()))
+    }
+
+    /// Completions of the word being typed, most likely first.
+    /// While composing kana, conversions of the reading instead.
+    /// Nothing for passwords and other sensitive text.
+    pub fn get_suggestions(&self, count: usize) -> Vec<String> {
+        if self.is_text_sensitive() {
+            return Vec::new();
+        }
+        if !self.reading.is_empty() {
+            return match &self.kanji {
+                Some(kanji) => kanji.convert(&self.reading, count),
+                None => Vec::new(),
+            };
+        }
+        let typed = match self.typed_word() {
+            Some(typed) => typed,
+            None => return Vec::new(),
+        };
+        // Words picked before come first
+        let mut words = match &self.learned {
+            Some(learned) => predict::suggest(learned, typed, count),
+            None => Vec::new(),
+        };
+        if let Some(dictionary) = &self.dictionary {
+            for word in predict::suggest(dictionary, typed, count) {
+                if !words.contains(&word) {
+                    words.push(word);
+                }
+            }
+        }
+        words.truncate(count);
+        words
+    }
+
+    /// Replaces the word being typed with `word`, followed by a space.
+    /// While composing kana, replaces the reading with `word` alone.
+    pub fn handle_accept_suggestion(&mut self, word: &str) {
+        if !self.reading.is_empty() {
+            self.reading.clear();
+            self.batch.push_text(word, Instant::now());
+            self.flush_text();
+            return;
+        }
+        self.flush_text();
+        let typed = match self.typed_word() {
+            Some(typed) => typed.to_owned(),
+            None => return,
+        };
+        if let Some(learned) = &mut self.learned {
+            learned.learn(&word.to_lowercase());
+        }
+        // Completions only need the rest of the word,
+        // anything else needs the typed part removed.
+        let (delete, text) = match word.strip_prefix(typed.as_str()) {
+            Some(rest) => (0, rest),
+            None => (typed.len() as u32, word),
+        };
+        let text = match CString::new(format!("{} ", text)) {
+            Ok(text) => text,
+            Err(_) => return,
+        };
+        if let Some(imservice) = &mut self.imservice {
+            let deleted = match delete {
+                0 => Ok(()),
+                delete => imservice.delete_surrounding_text(delete, 0),
+            };
+            let serial = imservice.get_serial();
+            let result = deleted
+                .and_then(|()| imservice.commit_string(&text))
+                .and_then(|()| imservice.commit());
+            match result {
+                Ok(()) => self.record_unreported(
+                    serial,
+                    delete as usize,
+                    text.to_str().unwrap_or(""),
+                ),
+                Err(imservice::SubmitError::NotActive) => log_print!(
+                    logging::Level::Debug,
+                    "Input method went away, suggestion dropped",
+                ),
+            }
+        }
+    }
+
+    pub fn set_swipe_lexicon(&mut self, lexicon: Option<swipe::Lexicon>) {
+        self.swipe = lexicon.map(swipe::Engine::new);
+    }
+
+    /// Swiped words can only be submitted as text,
+    /// and only into fields taking words
+    pub fn can_swipe(&self) -> bool {
+        let takes_words = self.imservice.as_ref()
+            .map(|imservice| imservice.is_active() && imservice.accepts_words())
+            .unwrap_or(false);
+        self.swipe.is_some() && takes_words && self.modifiers_active.is_empty()
+    }
+
+    /// Starts swiping if the trace started on a letter
+    pub fn handle_swipe_begin(
+        &mut self,
+        layout: &layout::LayoutData,
+        trace: &mut swipe::Trace,
+    ) -> bool {
+        match &mut self.swipe {
+            Some(engine) => engine.begin(layout, trace),
+            None => false,
+        }
+    }
+
+    /// Submits the word best matching the trace.
+    /// The first letter was already submitted when the swipe started,
+    /// so only the rest of the word is sent.
+    pub fn handle_swipe_end(
+        &mut self,
+        layout: &layout::LayoutData,
+        trace: &swipe::Trace,
+        _time: Timestamp,
+    ) {
+        let word = match &mut self.swipe {
+            Some(engine) => engine.decode(layout, trace),
+            None => None,
+        };
+        let rest = match word {
+            Some(word) => {
+                let mut chars = word.chars();
+                chars.next();
+                format!("{} ", chars.as_str())
+            },
+            None => return,
+        };
+        let active = self.imservice.as_ref()
+            .map(|imservice| imservice.is_active());
+        match active {
+            Some(true) => {
+                let now = Instant::now();
+                self.batch.push_text(&rest, now);
+                self.handle_commit_due(now);
+            },
+            Some(false) => log_print!(
+                logging::Level::Debug,
+                "Input method went away, swiped word dropped",
+            ),
+            None => {},
         }
     }
 
@@ -113,8 +543,47 @@ impl Submission {
         time: Timestamp,
     ) {
         let mods_are_on = !self.modifiers_active.is_empty();
+        let now = Instant::now();
+        // Text gets the accent of the dead key typed before
+        let accented;
+        let data = match (data, self.dead_key.take()) {
+            (SubmitData::Text(text), Some(dead_key)) => match text.to_str() {
+                Ok(text) => {
+                    accented = CString::new(dead_key.apply(text))
+                        .unwrap_or_default();
+                    SubmitData::Text(&accented)
+                },
+                Err(_) => SubmitData::Text(text),
+            },
+            (data, dead_key) => {
+                self.dead_key = dead_key;
+                data
+            },
+        };
+        let was_dead_key = match data {
+            SubmitData::DeadKey(dead_key) => self.press_dead_key(dead_key, now),
+            _ => false,
+        };
+        // Other keys forget the dead key
+        let was_dead_key_cancelled = match data {
+            SubmitData::DeadKey(_) => false,
+            _ => self.cancel_dead_key(),
+        };
+        // Key presses only when the surrounding text can't tell
+        // how many bytes make the last character
+        let was_erased_as_text = match data {
+            // Erasing the dead key is enough
+            SubmitData::Erase => was_dead_key_cancelled || self.erase_as_text(1),
+            _ => false,
+        };
+        let was_composed = match data {
+            SubmitData::Text(text) => self.compose(text, now),
+            _ => false,
+        };
+        let batch = &mut self.batch;
 
         let was_committed_as_text = match (&mut self.imservice, mods_are_on) {
+            _ if was_erased_as_text || was_composed || was_dead_key => true,
             (Some(imservice), false) => {
                 enum Outcome {
                     Submitted(Result<(), imservice::SubmitError>),
@@ -123,22 +592,27 @@ impl Submission {
 
                 let submit_outcome = match data {
                     SubmitData::Text(text) => {
-                        Outcome::Submitted(imservice.commit_string(text))
-                    },
-                    SubmitData::Erase => {
-                        /* Delete_surrounding_text takes byte offsets,
-                         * so cannot work without get_surrounding_text.
-                         * This is a bug in the protocol.
-                         */
-                        // imservice.delete_surrounding_text(1, 0),
-                        Outcome::NotSubmitted
+                        match (imservice.is_active(), text.to_str()) {
+                            // Committed together with any text
+                            // typed shortly before or after
+                            (true, Ok(text)) => {
+                                batch.push_text(text, now);
+                                Outcome::Submitted(Ok(()))
+                            },
+                            (false, _) => Outcome::Submitted(
+                                Err(imservice::SubmitError::NotActive)
+                            ),
+                            (true, Err(_)) => Outcome::NotSubmitted,
+                        }
                     },
+                    SubmitData::Erase => Outcome::NotSubmitted,
                     SubmitData::Keycodes => Outcome::NotSubmitted,
+                    SubmitData::DeadKey(_) => Outcome::NotSubmitted,
                 };
 
                 match submit_outcome {
                     Outcome::Submitted(result) => {
-                        match result.and_then(|()| imservice.commit()) {
+                        match result {
                             Ok(()) => true,
                             Err(imservice::SubmitError::NotActive) => false,
                         }
@@ -152,42 +626,44 @@ impl Submission {
         let submit_action = match was_committed_as_text {
             true => SubmittedAction::IMService,
             false => {
-                let keycodes_count = keycodes.len();
-                for keycode in keycodes.iter() {
-                    self.select_keymap(keycode.keymap_idx, time);
-                    let keycode = keycode.code;
-                    match keycodes_count {
-                        // Pressing a key made out of a single keycode is simple:
-                        // press on press, release on release.
-                        1 => self.virtual_keyboard.switch(
-                            keycode,
+                // Text typed earlier goes first
+                self.flush_text();
+                if let Some(imservice) = &self.imservice {
+                    self.unreported = Some((imservice.get_serial(), Unreported::Unknown));
+                }
+                KEYCODE_PRESSES.fetch_add(1, Ordering::Relaxed);
+                match keycodes.as_slice() {
+                    // Pressing a key made out of a single keycode is simple:
+                    // press on press, release on release.
+                    [keycode] if !keycode.shifted => {
+                        self.select_keymap_for_key(keycode.keymap_idx, time);
+                        self.virtual_keyboard.switch(
+                            keycode.code,
                             PressType::Pressed,
                             time,
-                        ),
-                        // A key made of multiple keycodes
-                        // has to submit them one after the other.
-                        _ => {
-                            self.virtual_keyboard.switch(
-                                keycode.clone(),
-                                PressType::Pressed,
-                                time,
-                            );
-                            self.virtual_keyboard.switch(
-                                keycode.clone(),
-                                PressType::Released,
-                                time,
-                            );
-                        },
-                    };
+                        );
+                    },
+                    // A key made of multiple keycodes
+                    // has to submit them one after the other.
+                    // Switching keymaps releases keys and modifiers,
+                    // so it happens once per run of keycodes from one keymap
+                    keycodes => for run in keyboard::plan_keymap_runs(keycodes) {
+                        self.select_keymap_for_key(run[0].keymap_idx, time);
+                        for keycode in run {
+                            self.tap_keycode(keycode, time);
+                        }
+                    },
                 }
                 SubmittedAction::VirtualKeyboard(keycodes.clone())
             },
         };
         
         self.pressed.push((key_id, submit_action));
+        self.handle_commit_due(now);
     }
     
     pub fn handle_release(&mut self, key_id: KeyStateId, time: Timestamp) {
+        self.repeater.release(&key_id);
         let index = self.pressed.iter().position(|(id, _)| *id == key_id);
         if let Some(index) = index {
             let (_id, action) = self.pressed.remove(index);
@@ -197,11 +673,10 @@ impl Submission {
                 // no matter if the imservice got activated,
                 // keys must be released
                 SubmittedAction::VirtualKeyboard(keycodes) => {
-                    let keycodes_count = keycodes.len();
-                    match keycodes_count {
-                        1 => {
-                            let keycode = &keycodes[0];
-                            self.select_keymap(keycode.keymap_idx, time);
+                    match keycodes.as_slice() {
+                        [keycode] if !keycode.shifted => {
+                            self.flush_text();
+                            self.select_keymap_for_key(keycode.keymap_idx, time);
                             self.virtual_keyboard.switch(
                                 keycode.code,
                                 PressType::Released,
@@ -217,6 +692,350 @@ impl Submission {
         };
     }
     
+    /// Starts repeating the pressed key after a delay.
+    /// Only one key repeats at a time.
+    pub fn handle_repeat_start(
+        &mut self,
+        key_id: KeyStateId,
+        erases: bool,
+        time: Timestamp,
+    ) {
+        self.repeater.press(key_id, erases, time, Instant::now());
+    }
+
+    pub fn handle_repeat_cancel(&mut self) {
+        self.repeater.cancel();
+    }
+
+    /// When the next repeat is due
+    pub fn get_next_repeat(&self) -> Option<Instant> {
+        self.repeater.next_wake()
+    }
+
+    pub fn get_repeat_interval(&self) -> Option<Duration> {
+        self.repeater.get_interval()
+    }
+
+    /// Submits the repeats due by `now`, all at once.
+    pub fn handle_repeat(&mut self, now: Instant) {
+        let due = match self.repeater.take_due(now) {
+            Some(due) => due,
+            None => return,
+        };
+        let index = self.pressed.iter().position(|(id, _)| *id == due.key_id);
+        let index = match index {
+            Some(index) => index,
+            None => {
+                self.repeater.cancel();
+                return;
+            },
+        };
+        if due.erases && self.erase_as_text(due.count) {
+            // Repeats are already batched by the repeater.
+            // Flushing would end the composition.
+            if self.reading.is_empty() {
+                self.flush_text();
+            }
+            // The held key would get repeated by the application too
+            let (_id, action) = self.pressed.remove(index);
+            if let SubmittedAction::VirtualKeyboard(keycodes) = action {
+                match keycodes.as_slice() {
+                    [keycode] if !keycode.shifted => {
+                        self.select_keymap_for_key(keycode.keymap_idx, due.time);
+                        self.virtual_keyboard.switch(
+                            keycode.code,
+                            PressType::Released,
+                            due.time,
+                        );
+                    },
+                    // Already released when pressed
+                    _ => {},
+                }
+            }
+            self.pressed.push((due.key_id, SubmittedAction::IMService));
+            return;
+        }
+        let keycodes = match &self.pressed[index].1 {
+            SubmittedAction::VirtualKeyboard(keycodes) => keycodes.clone(),
+            // Already erasing with the input method,
+            // which has gone away now.
+            SubmittedAction::IMService => return,
+        };
+        self.flush_text();
+        match keycodes.as_slice() {
+            // A held key gets tapped again and stays held.
+            [keycode] if !keycode.shifted => {
+                // Switching keymaps releases held keys
+                if self.keymap_idx != Some(keycode.keymap_idx) {
+                    self.repeater.cancel();
+                    return;
+                }
+                for _ in 0..due.count {
+                    self.virtual_keyboard.switch(
+                        keycode.code,
+                        PressType::Released,
+                        due.time,
+                    );
+                    self.virtual_keyboard.switch(
+                        keycode.code,
+                        PressType::Pressed,
+                        due.time,
+                    );
+                }
+            },
+            // Others get submitted whole, like when pressed.
+            keycodes => {
+                let runs = keyboard::plan_keymap_runs(keycodes);
+                for _ in 0..due.count {
+                    for run in &runs {
+                        self.select_keymap_for_key(run[0].keymap_idx, due.time);
+                        for keycode in run.iter() {
+                            self.tap_keycode(keycode, due.time);
+                        }
+                    }
+                }
+            },
+        }
+    }
+
+    /// Collects kana into the reading, when a kanji dictionary is present.
+    /// White space converts the reading.
+    /// Returns false if the text didn't go to the reading.
+    fn compose(&mut self, text: &CStr, now: Instant) -> bool {
+        if self.kanji.is_none() || !self.modifiers_active.is_empty() {
+            return false;
+        }
+        let active = self.imservice.as_ref()
+            .map(|imservice| imservice.is_active())
+            .unwrap_or(false);
+        if !active {
+            self.reading.clear();
+            return false;
+        }
+        let text = match text.to_str() {
+            Ok(text) if !text.is_empty() => text,
+            _ => return false,
+        };
+        if text.chars().all(kanji::is_kana) {
+            if self.reading.is_empty() {
+                // Text typed earlier goes first
+                self.flush_text();
+            }
+            self.reading.push_str(text);
+            self.show_reading();
+            true
+        } else if !self.reading.is_empty() && text.trim().is_empty() {
+            let converted = self.get_suggestions(1).pop()
+                .unwrap_or_else(|| self.reading.clone());
+            self.reading.clear();
+            self.batch.push_text(&converted, now);
+            self.flush_text();
+            true
+        } else {
+            self.end_composition(now);
+            false
+        }
+    }
+
+    /// Keeps the dead key until the next text, showing its accent.
+    /// Pressing it again types the accent alone.
+    /// Returns false if the dead key must go to the application instead.
+    fn press_dead_key(
+        &mut self,
+        dead_key: &'static compose::DeadKey,
+        now: Instant,
+    ) -> bool {
+        let active = self.imservice.as_ref()
+            .map(|imservice| imservice.is_active())
+            .unwrap_or(false);
+        if !active || !self.modifiers_active.is_empty() {
+            self.cancel_dead_key();
+            return false;
+        }
+        // Text typed earlier goes first
+        let pending = self.dead_key.take();
+        if let Some(pending) = pending {
+            self.batch.push_text(&pending.spacing.to_string(), now);
+        }
+        self.flush_text();
+        match pending {
+            Some(pending) if std::ptr::eq(pending, dead_key) => {},
+            _ => {
+                self.dead_key = Some(dead_key);
+                self.show_preedit(&dead_key.spacing.to_string());
+            },
+        }
+        true
+    }
+
+    /// Drops the dead key typed before, together with its accent.
+    /// Returns false if there was none.
+    fn cancel_dead_key(&mut self) -> bool {
+        match self.dead_key.take() {
+            // A commit without preedit text removes it
+            Some(_) => {
+                self.show_preedit("");
+                true
+            },
+            None => false,
+        }
+    }
+
+    /// Leaves the kana as typed, to get committed with the next batch.
+    /// That commit also removes the preedit text.
+    fn end_composition(&mut self, now: Instant) {
+        if !self.reading.is_empty() {
+            let reading = std::mem::take(&mut self.reading);
+            self.batch.push_text(&reading, now);
+        }
+    }
+
+    fn show_reading(&mut self) {
+        let reading = self.reading.clone();
+        self.show_preedit(&reading);
+    }
+
+    fn show_preedit(&mut self, text: &str) {
+        if let Some(imservice) = &mut self.imservice {
+            imservice.set_preedit_string(text);
+            if let Err(imservice::SubmitError::NotActive) = imservice.commit() {
+                log_print!(
+                    logging::Level::Debug,
+                    "Input method went away, preedit text dropped",
+                );
+            }
+        }
+    }
+
+    /// Erases `count` grapheme clusters before the cursor,
+    /// batched with other text changes.
+    /// Returns false if the input method can't do that.
+    fn erase_as_text(&mut self, count: u32) -> bool {
+        if !self.modifiers_active.is_empty() {
+            return false;
+        }
+        if !self.reading.is_empty() {
+            let length = grapheme::erase_length(&self.reading, self.reading.len(), count);
+            self.reading.truncate(self.reading.len() - length);
+            self.show_reading();
+            return true;
+        }
+        let imservice = match &self.imservice {
+            Some(imservice) if imservice.is_active() => imservice,
+            _ => return false,
+        };
+        // The application may not have reported the earlier changes yet
+        let before = match text_before_cursor(imservice, &self.unreported) {
+            Some(before) => before,
+            None => return false,
+        };
+        // Nothing known before the cursor: let the application decide
+        self.batch.erase(count, before, Instant::now())
+    }
+
+    /// Remembers what the application should do with a commit
+    /// made with the surrounding text of `serial`.
+    fn record_unreported(&mut self, serial: u32, delete: usize, text: &str) {
+        let imservice = match &self.imservice {
+            Some(imservice) => imservice,
+            None => return,
+        };
+        let mut before = match self.unreported.take() {
+            Some((unreported_serial, unreported)) if unreported_serial == serial => {
+                match unreported {
+                    Unreported::Text(before) => before,
+                    Unreported::Unknown => {
+                        self.unreported = Some((serial, Unreported::Unknown));
+                        return;
+                    },
+                }
+            },
+            _ => text_tail(imservice.surrounding_text().before_cursor()).to_owned(),
+        };
+        let mut cut = before.len().saturating_sub(delete);
+        while !before.is_char_boundary(cut) {
+            cut -= 1;
+        }
+        before.truncate(cut);
+        before.push_str(text);
+        let before = text_tail(&before).to_owned();
+        self.unreported = Some((serial, Unreported::Text(before)));
+    }
+
+    /// When the batched text changes should get committed
+    pub fn get_next_commit(&self) -> Option<Instant> {
+        self.batch.next_due()
+    }
+
+    /// Commits the batched text changes if they are due by `now`.
+    pub fn handle_commit_due(&mut self, now: Instant) {
+        if let Some(due) = self.batch.next_due() {
+            if due <= now {
+                self.flush_text();
+            }
+        }
+    }
+
+    /// Commits the batched text changes right away.
+    pub fn flush_text(&mut self) {
+        self.end_composition(Instant::now());
+        self.send_batch();
+    }
+
+    /// The input method state is about to change,
+    /// so text typed for the old state must go now.
+    /// When the focus changes, text still being composed gets dropped,
+    /// so that it doesn't end up in another text field.
+    pub fn handle_input_method_change(&mut self, focus_changes: bool) {
+        if focus_changes {
+            let composing = !self.reading.is_empty() || self.dead_key.is_some();
+            self.reading.clear();
+            self.dead_key = None;
+            if composing {
+                self.show_preedit("");
+            }
+        }
+        self.send_batch();
+    }
+
+    fn send_batch(&mut self) {
+        let commit = match self.batch.take() {
+            Some(commit) => commit,
+            None => return,
+        };
+        let imservice = match &mut self.imservice {
+            Some(imservice) => imservice,
+            None => return,
+        };
+        let serial = imservice.get_serial();
+        let deleted = match commit.delete {
+            0 => Ok(()),
+            delete => imservice.delete_surrounding_text(delete as u32, 0),
+        };
+        // Came from C strings, so there's no nul inside
+        let text = CString::new(commit.text).unwrap_or_default();
+        let result = deleted
+            .and_then(|()| match text.as_bytes().is_empty() {
+                true => Ok(()),
+                false => imservice.commit_string(&text),
+            })
+            .and_then(|()| imservice.commit());
+        match result {
+            Ok(()) => {
+                TEXT_COMMITS.fetch_add(1, Ordering::Relaxed);
+                self.record_unreported(
+                    serial,
+                    commit.delete,
+                    text.to_str().unwrap_or(""),
+                );
+            },
+            Err(imservice::SubmitError::NotActive) => log_print!(
+                logging::Level::Debug,
+                "Input method went away, text dropped",
+            ),
+        }
+    }
+
     pub fn handle_add_modifier(
         &mut self,
         key_id: KeyStateId,
@@ -236,14 +1055,34 @@ impl Submission {
     }
 
     fn update_modifiers(&mut self) {
-        let raw_modifiers = self.modifiers_active.iter()
+        self.flush_text();
+        self.virtual_keyboard.set_modifiers_state(self.raw_modifiers());
+    }
+
+    fn raw_modifiers(&self) -> Modifiers {
+        self.modifiers_active.iter()
             .map(|(_id, m)| match m {
                 Modifier::Control => Modifiers::CONTROL,
                 Modifier::Alt => Modifiers::MOD1,
                 Modifier::Mod4 => Modifiers::MOD4,
             })
-            .fold(Modifiers::empty(), |m, n| m | n);
-        self.virtual_keyboard.set_modifiers_state(raw_modifiers);
+            .fold(Modifiers::empty(), |m, n| m | n)
+    }
+
+    /// Presses and releases a keycode from the current keymap.
+    /// Symbols on the Shift level get Shift only for that moment,
+    /// so that it doesn't leak into other keys.
+    fn tap_keycode(&self, keycode: &KeyCode, time: Timestamp) {
+        if keycode.shifted {
+            self.virtual_keyboard.set_modifiers_state(
+                self.raw_modifiers() | Modifiers::SHIFT
+            );
+        }
+        self.virtual_keyboard.switch(keycode.code, PressType::Pressed, time);
+        self.virtual_keyboard.switch(keycode.code, PressType::Released, time);
+        if keycode.shifted {
+            self.virtual_keyboard.set_modifiers_state(self.raw_modifiers());
+        }
     }
 
     pub fn is_modifier_active(&self, modifier: Modifier) -> bool {
@@ -265,6 +1104,7 @@ impl Submission {
         if self.modifiers_active.is_empty() {
             return;
         }
+        self.flush_text();
         self.modifiers_active = Vec::new();
         self.virtual_keyboard.set_modifiers_state(Modifiers::empty())
     }
@@ -284,6 +1124,15 @@ impl Submission {
     }
 
 
+    /// Like `select_keymap`, counting the switches caused by keys.
+    fn select_keymap_for_key(&mut self, idx: usize, time: Timestamp) {
+        if self.keymap_idx != Some(idx) {
+            KEYMAP_SWAPS.fetch_add(1, Ordering::Relaxed);
+            self.record_churn(|churn| churn.swaps += 1);
+        }
+        self.select_keymap(idx, time);
+    }
+
     /// Changes keymap and clears pressed keys and modifiers.
     ///
     /// It's not obvious if clearing is the right thing to do, 
@@ -295,20 +1144,45 @@ impl Submission {
     /// due to modifiers meaning different things in different keymaps.
     fn select_keymap(&mut self, idx: usize, time: Timestamp) {
         if self.keymap_idx != Some(idx) {
+            self.flush_text();
             self.keymap_idx = Some(idx);
             self.clear_all_modifiers();
             self.release_all_virtual_keys(time);
             let keymap = &self.keymap_fds[idx];
             self.virtual_keyboard.update_keymap(keymap);
+            KEYMAP_UPDATES.fetch_add(1, Ordering::Relaxed);
+            let size = keymap.size() as u64;
+            self.record_churn(|churn| {
+                churn.updates += 1;
+                churn.bytes += size;
+            });
         }
     }
     
     pub fn use_layout(&mut self, layout: &layout::LayoutData, time: Timestamp) {
-        self.keymap_fds = layout.keymaps.iter()
-            .map(|keymap_str| vkeyboard::c::KeyMap::from_cstr(
-                keymap_str.as_c_str()
-            ))
-            .collect();
+        let start = Instant::now();
+        let keymap_fds = self.virtual_keyboard.load_keymaps(&layout.keymaps);
+        // Loaded keymaps are reused for the same text,
+        // e.g. for layouts sharing a keymap.
+        let same_keymaps = keymap_fds.len() == self.keymap_fds.len()
+            && keymap_fds.iter().zip(self.keymap_fds.iter())
+                .all(|(new, old)| Rc::ptr_eq(new, old));
+        self.keymap_fds = keymap_fds;
+        self.layout_name = layout.name.clone();
+        let elapsed = start.elapsed();
+        self.record_churn(|churn| churn.time += elapsed);
+        if let Some(engine) = &mut self.swipe {
+            engine.reset();
+        }
+
+        if same_keymaps && self.keymap_idx.is_some() {
+            // Applications have nothing to compile,
+            // but the keys of the previous layout are gone.
+            self.flush_text();
+            self.clear_all_modifiers();
+            self.release_all_virtual_keys(time);
+            return;
+        }
         self.keymap_idx = None;
 
         // This can probably be eliminated,
@@ -0,0 +1,197 @@
+/* Copyright (C) 2026 Purism SPC
+ * SPDX-License-Identifier: GPL-3.0+
+ */
+
+/*! The text around the cursor, as reported by the application.
+ *
+ * Applications send the whole surrounding text after every change,
+ * up to a few kilobytes at a time, even though typing only changes
+ * a few bytes next to the cursor.
+ * Instead of replacing the stored copy, the update gets compared
+ * against it, and only the span which differs is replaced in place.
+ *
+ * Queries only look at the text close to the cursor,
+ * so they stay cheap however long the text is.
+ */
+
+use crate::grapheme;
+use crate::predict;
+
+/// Bytes, as in the text-input protocol
+#[derive(Debug, Clone, Copy, PartialEq)]
+pub struct Change {
+    pub start: usize,
+    pub removed: usize,
+    pub inserted: usize,
+}
+
+#[derive(Debug, Clone, Default, PartialEq)]
+pub struct SurroundingText {
+    text: String,
+    /// Byte offset, always on a character boundary
+    cursor: usize,
+}
+
+fn is_continuation(byte: u8) -> bool {
+    byte & 0b1100_0000 == 0b1000_0000
+}
+
+impl SurroundingText {
+    pub fn new() -> SurroundingText {
+        SurroundingText::default()
+    }
+
+    /// Applies a new state of the text.
+    /// Returns the span which changed, or None if the text is the same.
+    pub fn update(&mut self, text: &[u8], cursor: u32) -> Option<Change> {
+        let lossy;
+        let text = match std::str::from_utf8(text) {
+            Ok(text) => text,
+            Err(_) => {
+                lossy = String::from_utf8_lossy(text);
+                lossy.as_ref()
+            },
+        };
+        let old = self.text.as_bytes();
+        let new = text.as_bytes();
+        let mut prefix = old.iter().zip(new)
+            .take_while(|(a, b)| a == b)
+            .count();
+        let max_suffix = old.len().min(new.len()) - prefix;
+        let mut suffix = old.iter().rev().zip(new.iter().rev())
+            .take(max_suffix)
+            .take_while(|(a, b)| a == b)
+            .count();
+        // Only whole characters get replaced.
+        // The bytes are the same in both, so the boundaries are too.
+        while prefix < new.len() && is_continuation(new[prefix]) {
+            prefix -= 1;
+        }
+        while suffix > 0 && is_continuation(new[new.len() - suffix]) {
+            suffix -= 1;
+        }
+
+        let change = match old.len() == new.len() && prefix == new.len() {
+            true => None,
+            false => {
+                let removed = old.len() - suffix - prefix;
+                let inserted = &text[prefix..(new.len() - suffix)];
+                self.text.replace_range(prefix..(prefix + removed), inserted);
+                Some(Change { start: prefix, removed, inserted: inserted.len() })
+            },
+        };
+        let mut cursor = (cursor as usize).min(self.text.len());
+        while !self.text.is_char_boundary(cursor) {
+            cursor -= 1;
+        }
+        self.cursor = cursor;
+        change
+    }
+
+    pub fn text(&self) -> &str {
+        &self.text
+    }
+
+    pub fn cursor(&self) -> usize {
+        self.cursor
+    }
+
+    pub fn before_cursor(&self) -> &str {
+        &self.text[..self.cursor]
+    }
+
+    /// The part of the word before the cursor
+    pub fn current_word(&self) -> &str {
+        let before = self.before_cursor();
+        predict::word_before_cursor(before, before.len())
+    }
+
+    /// The last user-perceived character before the cursor
+    pub fn previous_grapheme(&self) -> &str {
+        let before = self.before_cursor();
+        &before[(before.len() - grapheme::len_before(before, before.len()))..]
+    }
+
+    /// Byte offset where the sentence with the cursor starts.
+    /// A sentence ends with a full stop, a question or exclamation mark,
+    /// followed by white space, or with a line break.
+    pub fn sentence_start(&self) -> usize {
+        let before = self.before_cursor();
+        let mut start = 0;
+        let mut space_seen = false;
+        for (idx, c) in before.char_indices().rev() {
+            match c {
+                '\n' => {
+                    start = idx + 1;
+                    break;
+                },
+                '.' | '!' | '?' if space_seen => {
+                    start = idx + 1;
+                    break;
+                },
+                c if c.is_whitespace() => space_seen = true,
+                _ => space_seen = false,
+            }
+        }
+        // Leading white space is not part of the sentence
+        start + (before[start..].len() - before[start..].trim_start().len())
+    }
+}
+
+#[cfg(test)]
+mod test {
+    use super::*;
+
+    #[test]
+    fn typing_changes_little() {
+        let mut text = SurroundingText::new();
+        assert_eq!(
+            text.update(b"Hello world", 11),
+            Some(Change { start: 0, removed: 0, inserted: 11 }),
+        );
+        assert_eq!(
+            text.update(b"Hello world!", 12),
+            Some(Change { start: 11, removed: 0, inserted: 1 }),
+        );
+        // Inserted in the middle
+        assert_eq!(
+            text.update(b"Hello, world!", 6),
+            Some(Change { start: 5, removed: 0, inserted: 1 }),
+        );
+        assert_eq!(text.text(), "Hello, world!");
+        // Only the cursor moved
+        assert_eq!(text.update(b"Hello, world!", 0), None);
+        assert_eq!(text.cursor(), 0);
+    }
+
+    #[test]
+    fn replaces_whole_chars() {
+        let mut text = SurroundingText::new();
+        text.update("zaż".as_bytes(), 4);
+        // ż and ź share the first byte
+        let change = text.update("zaź".as_bytes(), 4);
+        assert_eq!(change, Some(Change { start: 2, removed: 2, inserted: 2 }));
+        assert_eq!(text.text(), "zaź");
+        // Repeated letters at the edge of the change
+        text.update(b"aaa", 3);
+        text.update(b"aa", 2);
+        assert_eq!(text.text(), "aa");
+    }
+
+    #[test]
+    fn queries() {
+        let mut text = SurroundingText::new();
+        let s = "One. Two thrée";
+        text.update(s.as_bytes(), s.len() as u32);
+        assert_eq!(text.current_word(), "thrée");
+        assert_eq!(text.previous_grapheme(), "e");
+        assert_eq!(text.sentence_start(), 5);
+        // e with a combining accent
+        text.update("Two cafe\u{301}s".as_bytes(), 10);
+        assert_eq!(text.previous_grapheme(), "e\u{301}");
+        text.update(b"Line\n  next", 11);
+        assert_eq!(text.sentence_start(), 7);
+        text.update(b"e.g. this", 9);
+        assert_eq!(text.sentence_start(), 5);
+    }
+}
@@ -0,0 +1,501 @@
+/* Copyright (C) 2026 Purism SPC
+ * SPDX-License-Identifier: GPL-3.0+
+ */
+
+/*! Swipe (gesture) typing.
+ *
+ * A continuous drag over the keys is compared against the ideal paths
+ * of words from a lexicon, drawn between the centers of their keys.
+ *
+ * Paths are resampled to a fixed number of points,
+ * so that comparing a gesture to a word is a fixed amount of work.
+ * The ideal path of every word is computed once per view.
+ * Only words starting on the pressed key and ending near the release point
+ * are compared at all, and a comparison is abandoned
+ * as soon as it can't beat the best candidates any more.
+ *
+ * The lexicon is a plain text file with one word per line,
+ * optionally followed by its frequency.
+ */
+
+use std::collections::HashMap;
+use std::env;
+use std::fs::File;
+use std::io;
+use std::io::{ BufRead, BufReader };
+use std::path::PathBuf;
+
+use crate::layout::{ ButtonPosition, LayoutData, View };
+use crate::layout::c::Point;
+use crate::logging;
+use crate::xdg;
+
+// Traits
+use crate::logging::Warn;
+
+/// Number of points every path gets resampled to
+const SAMPLES: usize = 24;
+/// How many candidates are kept while searching
+const CANDIDATES: usize = 3;
+/// Cost of the least frequent word, in units of average distance per key size
+const FREQUENCY_WEIGHT: f32 = 0.3;
+
+pub static LEXICON_ENV_VAR: &str = "SQUEEKBOARD_SWIPE_LEXICON";
+
+#[derive(Clone, Copy, Debug, PartialEq)]
+struct P {
+    x: f32,
+    y: f32,
+}
+
+impl P {
+    fn distance(self, other: P) -> f32 {
+        let (dx, dy) = (self.x - other.x, self.y - other.y);
+        (dx * dx + dy * dy).sqrt()
+    }
+
+    fn lerp(self, other: P, t: f32) -> P {
+        P {
+            x: self.x + (other.x - self.x) * t,
+            y: self.y + (other.y - self.y) * t,
+        }
+    }
+}
+
+impl From<&Point> for P {
+    fn from(p: &Point) -> P {
+        P { x: p.x as f32, y: p.y as f32 }
+    }
+}
+
+/// Returns SAMPLES points spaced equally along the path,
+/// and the length of the path.
+fn resample(points: &[P]) -> ([P; SAMPLES], f32) {
+    let length: f32 = points.windows(2)
+        .map(|w| w[0].distance(w[1]))
+        .sum();
+    let mut out = [points[0]; SAMPLES];
+    if length == 0.0 {
+        return (out, length);
+    }
+    let step = length / (SAMPLES - 1) as f32;
+    let mut segment = 0;
+    // Distance along the path to the start of the segment
+    let mut walked = 0.0;
+    for i in 1..(SAMPLES - 1) {
+        let target = step * i as f32;
+        while segment + 2 < points.len()
+            && walked + points[segment].distance(points[segment + 1]) < target
+        {
+            walked += points[segment].distance(points[segment + 1]);
+            segment += 1;
+        }
+        let (a, b) = (points[segment], points[segment + 1]);
+        let segment_length = a.distance(b);
+        let t = match segment_length > 0.0 {
+            true => ((target - walked) / segment_length).min(1.0),
+            false => 0.0,
+        };
+        out[i] = a.lerp(b, t);
+    }
+    out[SAMPLES - 1] = points[points.len() - 1];
+    (out, length)
+}
+
+pub struct Lexicon {
+    words: Vec<String>,
+    /// Between 0 for the rarest and 1 for the most frequent word
+    frequencies: Vec<f32>,
+}
+
+impl Lexicon {
+    /// Reads lines of `word [count]`. Missing counts are 1.
+    pub fn from_reader<R: BufRead>(input: R) -> Result<Lexicon, io::Error> {
+        let mut words = Vec::new();
+        let mut counts = Vec::new();
+        for line in input.lines() {
+            let line = line?;
+            let mut fields = line.split_whitespace();
+            if let Some(word) = fields.next() {
+                let count = fields.next()
+                    .and_then(|c| c.parse::<u64>().ok())
+                    .unwrap_or(1);
+                words.push(word.to_owned());
+                counts.push(count);
+            }
+        }
+        let max = counts.iter().cloned().max().unwrap_or(1) as f32;
+        let frequencies = counts.into_iter()
+            .map(|c| (1.0 + c as f32).ln() / (1.0 + max).ln())
+            .collect();
+        Ok(Lexicon { words, frequencies })
+    }
+
+    fn path() -> Option<PathBuf> {
+        env::var_os(LEXICON_ENV_VAR)
+            .map(PathBuf::from)
+            .or_else(|| xdg::data_path("squeekboard/swipe/words.txt"))
+    }
+
+    /// Swipe typing is disabled when there's no lexicon.
+    pub fn load_default() -> Option<Lexicon> {
+        let path = Lexicon::path()?;
+        let file = match File::open(&path) {
+            Ok(file) => file,
+            Err(e) => {
+                log_print!(
+                    logging::Level::Debug,
+                    "No swipe lexicon at {:?}: {}", path, e,
+                );
+                return None;
+            },
+        };
+        Lexicon::from_reader(BufReader::new(file))
+            .or_print(
+                logging::Problem::Warning,
+                &format!("Can't read swipe lexicon {:?}", path),
+            )
+    }
+}
+
+struct Key {
+    center: P,
+    position: (usize, usize),
+}
+
+struct Template {
+    word: u32,
+    points: [P; SAMPLES],
+    length: f32,
+}
+
+/// Word paths laid out over the keys of a single view
+pub struct Decoder {
+    keys: Vec<Key>,
+    /// Typical key size, the unit of distance
+    key_size: f32,
+    templates: Vec<Template>,
+    /// Templates by the keys of the first and the last letter
+    by_ends: HashMap<(u16, u16), Vec<u32>>,
+}
+
+impl Decoder {
+    pub fn new(lexicon: &Lexicon, view_offset: &Point, view: &View) -> Decoder {
+        let mut keys = Vec::new();
+        let mut key_by_letter = HashMap::new();
+        let mut size_sum = 0.0;
+        for (row_idx, (row_offset, row)) in view.get_rows().iter().enumerate() {
+            let buttons = row.get_buttons().iter().enumerate();
+            for (button_idx, (x_offset, button)) in buttons {
+                if let Some(letter) = button.get_letter() {
+                    let center = Point {
+                        x: view_offset.x + row_offset.x + x_offset
+                            + button.size.width / 2.0,
+                        y: view_offset.y + row_offset.y
+                            + button.size.height / 2.0,
+                    };
+                    size_sum += button.size.width.min(button.size.height);
+                    key_by_letter.entry(letter).or_insert(keys.len());
+                    keys.push(Key {
+                        center: P::from(&center),
+                        position: (row_idx, button_idx),
+                    });
+                }
+            }
+        }
+        let key_size = match keys.len() {
+            0 => 1.0,
+            count => (size_sum / count as f64) as f32,
+        };
+
+        let mut templates = Vec::new();
+        let mut by_ends = HashMap::new();
+        let mut path = Vec::new();
+        for (word_idx, word) in lexicon.words.iter().enumerate() {
+            path.clear();
+            let letters = word.chars().flat_map(char::to_lowercase);
+            let complete = letters
+                .map(|c| key_by_letter.get(&c).map(|idx| {
+                    // Double letters don't change the path
+                    if path.last() != Some(idx) {
+                        path.push(*idx);
+                    }
+                }))
+                .all(|found| found.is_some());
+            // A single key is a tap, not a swipe
+            if !complete || path.len() < 2 {
+                continue;
+            }
+            let centers: Vec<P> = path.iter().map(|idx| keys[*idx].center).collect();
+            let (points, length) = resample(&centers);
+            let ends = (path[0] as u16, path[path.len() - 1] as u16);
+            by_ends.entry(ends)
+                .or_insert_with(Vec::new)
+                .push(templates.len() as u32);
+            templates.push(Template { word: word_idx as u32, points, length });
+        }
+        Decoder { keys, key_size, templates, by_ends }
+    }
+
+    /// Returns the key index if the button types a letter
+    fn find_key(&self, position: (usize, usize)) -> Option<u16> {
+        self.keys.iter()
+            .position(|key| key.position == position)
+            .map(|idx| idx as u16)
+    }
+
+    pub fn has_key(&self, position: (usize, usize)) -> bool {
+        self.find_key(position).is_some()
+    }
+
+    /// Keys whose centers are within a key size of the point,
+    /// or the closest key when there are none.
+    fn keys_near(&self, point: P) -> Vec<u16> {
+        let near: Vec<u16> = self.keys.iter().enumerate()
+            .filter(|(_idx, key)| key.center.distance(point) < self.key_size)
+            .map(|(idx, _key)| idx as u16)
+            .collect();
+        if !near.is_empty() {
+            return near;
+        }
+        self.keys.iter().enumerate()
+            .min_by(|(_, a), (_, b)| {
+                a.center.distance(point)
+                    .partial_cmp(&b.center.distance(point))
+                    .unwrap_or(std::cmp::Ordering::Equal)
+            })
+            .map(|(idx, _key)| vec![idx as u16])
+            .unwrap_or_else(Vec::new)
+    }
+
+    /// Returns indices of lexicon words, best first, with their costs.
+    fn decode(
+        &self,
+        lexicon: &Lexicon,
+        start: (usize, usize),
+        trace: &[Point],
+    ) -> Vec<(u32, f32)> {
+        let start = match (self.find_key(start), trace.is_empty()) {
+            (Some(key), false) => key,
+            _ => return Vec::new(),
+        };
+        let trace: Vec<P> = trace.iter().map(P::from).collect();
+        let (points, length) = resample(&trace);
+        let length_tolerance = self.key_size + length * 0.4;
+
+        // Sorted by cost
+        let mut best: Vec<(u32, f32)> = Vec::with_capacity(CANDIDATES + 1);
+        for end in self.keys_near(points[SAMPLES - 1]) {
+            let candidates = match self.by_ends.get(&(start, end)) {
+                Some(c) => c,
+                None => continue,
+            };
+            for template in candidates.iter().map(|i| &self.templates[*i as usize]) {
+                if (template.length - length).abs() > length_tolerance {
+                    continue;
+                }
+                let word_cost = FREQUENCY_WEIGHT
+                    * (1.0 - lexicon.frequencies[template.word as usize]);
+                // Largest sum of distances which still makes the cut
+                let limit = match best.len() {
+                    CANDIDATES => {
+                        (best[CANDIDATES - 1].1 - word_cost)
+                            * self.key_size * SAMPLES as f32
+                    },
+                    _ => f32::INFINITY,
+                };
+                let mut distance = 0.0;
+                for (a, b) in points.iter().zip(template.points.iter()) {
+                    distance += a.distance(*b);
+                    if distance > limit {
+                        break;
+                    }
+                }
+                if distance > limit {
+                    continue;
+                }
+                let cost = distance / (self.key_size * SAMPLES as f32) + word_cost;
+                let place = best.iter()
+                    .position(|(_, c)| *c > cost)
+                    .unwrap_or(best.len());
+                best.insert(place, (template.word, cost));
+                best.truncate(CANDIDATES);
+            }
+        }
+        best
+    }
+}
+
+/// The path of a single touch point
+pub struct Trace {
+    /// The button where the touch started
+    pub start: ButtonPosition,
+    points: Vec<Point>,
+    swiping: bool,
+}
+
+impl Trace {
+    pub fn new(start: ButtonPosition, point: Point) -> Trace {
+        Trace {
+            start,
+            points: vec![point],
+            swiping: false,
+        }
+    }
+
+    pub fn push(&mut self, point: Point) {
+        self.points.push(point);
+    }
+
+    /// The touch left the starting button and is not typing keys any more
+    pub fn is_swiping(&self) -> bool {
+        self.swiping
+    }
+}
+
+/// Lexicon together with decoders for the views of the current layout
+pub struct Engine {
+    lexicon: Lexicon,
+    decoders: HashMap<String, Decoder>,
+}
+
+impl Engine {
+    pub fn new(lexicon: Lexicon) -> Engine {
+        Engine {
+            lexicon,
+            decoders: HashMap::new(),
+        }
+    }
+
+    /// Geometry changed, so all paths are stale
+    pub fn reset(&mut self) {
+        self.decoders.clear();
+    }
+
+    /// Builds decoders on first use, because that's slow
+    fn decoder<'a>(
+        decoders: &'a mut HashMap<String, Decoder>,
+        lexicon: &Lexicon,
+        layout: &LayoutData,
+        view: &str,
+    ) -> Option<&'a Decoder> {
+        if !decoders.contains_key(view) {
+            let (offset, view_data) = layout.views.get(view)?;
+            decoders.insert(view.into(), Decoder::new(lexicon, offset, view_data));
+        }
+        decoders.get(view)
+    }
+
+    /// Turns the trace into a swipe if it starts on a letter.
+    /// Returns whether the trace is now swiping.
+    pub fn begin(&mut self, layout: &LayoutData, trace: &mut Trace) -> bool {
+        let start = (trace.start.row, trace.start.position_in_row);
+        let decoder = Engine::decoder(
+            &mut self.decoders,
+            &self.lexicon,
+            layout,
+            &trace.start.view,
+        );
+        trace.swiping = decoder
+            .map(|decoder| decoder.has_key(start))
+            .unwrap_or(false);
+        trace.swiping
+    }
+
+    /// Returns the best matching word
+    pub fn decode(&mut self, layout: &LayoutData, trace: &Trace) -> Option<&str> {
+        let start = (trace.start.row, trace.start.position_in_row);
+        let decoder = Engine::decoder(
+            &mut self.decoders,
+            &self.lexicon,
+            layout,
+            &trace.start.view,
+        );
+        let best = decoder?
+            .decode(&self.lexicon, start, &trace.points)
+            .first()
+            .map(|(word, _cost)| *word as usize)?;
+        Some(&self.lexicon.words[best])
+    }
+}
+
+#[cfg(test)]
+mod test {
+    use super::*;
+
+    use crate::data::parsing;
+    use crate::layout::{ ArrangementKind, Label, Layout };
+    use crate::imservice::ContentPurpose;
+    use crate::logging::ProblemPanic;
+
+    fn make_layout() -> Layout {
+        let data: parsing::Layout = serde_yaml::from_str("
+views:
+    base:
+        - \"q w e r t y\"
+        - \"a s d f g h\"
+outlines:
+    default: { width: 10, height: 10 }
+").unwrap();
+        Layout::new(
+            data.build(ProblemPanic).0.unwrap(),
+            ArrangementKind::Base,
+            ContentPurpose::Normal,
+        )
+    }
+
+    fn center_of(layout: &Layout, letter: &str) -> Point {
+        let mut found = None;
+        layout.foreach_visible_button(|offset, button, _idx| {
+            if button.label == Label::Text(std::ffi::CString::new(letter).unwrap()) {
+                found = Some(Point {
+                    x: offset.x + button.size.width / 2.0,
+                    y: offset.y + button.size.height / 2.0,
+                });
+            }
+        });
+        found.unwrap()
+    }
+
+    fn lexicon(words: &str) -> Lexicon {
+        Lexicon::from_reader(words.as_bytes()).unwrap()
+    }
+
+    #[test]
+    fn resample_straight() {
+        let (points, length) = resample(&[P { x: 0.0, y: 0.0 }, P { x: 23.0, y: 0.0 }]);
+        assert_eq!(length, 23.0);
+        for (i, p) in points.iter().enumerate() {
+            assert!((p.x - i as f32).abs() < 0.001);
+        }
+    }
+
+    #[test]
+    fn decode_prefers_matching_path() {
+        let layout = make_layout();
+        let (offset, view) = layout.shape.views.get("base").unwrap();
+        let lexicon = lexicon("wet 5\nwe 100\nwry 1\nsad 3\n");
+        let decoder = Decoder::new(&lexicon, offset, view);
+        let trace: Vec<Point> = ["w", "e", "r", "t"].iter()
+            .map(|l| center_of(&layout, l))
+            .collect();
+        let found = decoder.decode(&lexicon, (0, 1), &trace);
+        assert_eq!(lexicon.words[found[0].0 as usize], "wet");
+        // Starts elsewhere, never compared
+        assert!(found.iter().all(|(w, _)| lexicon.words[*w as usize] != "sad"));
+    }
+
+    #[test]
+    fn decode_frequency_breaks_ties() {
+        let layout = make_layout();
+        let (offset, view) = layout.shape.views.get("base").unwrap();
+        // Same path
+        let lexicon = lexicon("weet 1\nwet 50\n");
+        let decoder = Decoder::new(&lexicon, offset, view);
+        let trace: Vec<Point> = ["w", "e", "t"].iter()
+            .map(|l| center_of(&layout, l))
+            .collect();
+        let found = decoder.decode(&lexicon, (0, 1), &trace);
+        assert_eq!(lexicon.words[found[0].0 as usize], "wet");
+    }
+}
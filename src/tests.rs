@@ -1,7 +1,13 @@
 /*! Testing functionality */
 
-use crate::data::parsing::Layout;
+use crate::action::Action;
+use crate::data::loading;
+use crate::data::parsing::{ Layout, SymbolSet };
+use crate::keyboard;
+use crate::keyboard::{ KeyCode, KeymapStyle, Packing };
+use crate::layout;
 use crate::logging;
+use std::collections::HashMap;
 use xkbcommon::xkb;
 
 
@@ -26,16 +32,35 @@ impl CountAndPrint {
     }
 }
 
+/// Keymaps of built-in layouts don't get compiled at runtime,
+/// so every packing and set of shared symbols they can get
+/// must be checked here.
 pub fn check_builtin_layout(name: &str, missing_return: bool) {
-    check_layout(
-        Layout::from_resource(name).expect("Invalid layout data"),
-        missing_return,
-    )
+    // Accented letters become dead keys with SQUEEKBOARD_DEAD_KEYS
+    for dead_keys in [false, true] {
+        let packing = Packing { dead_keys, ..Packing::for_layouts() };
+        check_layout(
+            Layout::from_resource(name).expect("Invalid layout data"),
+            &packing,
+            &SymbolSet::default(),
+            missing_return,
+        );
+        if let Some(shared) = loading::builtin_shared_symbols(name, &packing) {
+            check_layout(
+                Layout::from_resource(name).expect("Invalid layout data"),
+                &packing,
+                &shared,
+                missing_return,
+            );
+        }
+    }
 }
 
 pub fn check_layout_file(path: &str) {
     check_layout(
         Layout::from_file(path.into()).expect("Invalid layout file"),
+        &Packing::for_layouts(),
+        &SymbolSet::default(),
         false,
     )
 }
@@ -46,10 +71,14 @@ fn check_sym_in_keymap(state: &xkb::State, sym_name: &str) -> bool {
         panic!("Entered invalid keysym: {}", sym_name);
     }
     let map = state.get_keymap();
-    let range = map.min_keycode()..=map.max_keycode();
-    range.flat_map(|code| state.key_get_syms(code))
-        .find(|s| **s == sym)
-        .is_some()
+    for code in map.min_keycode()..=map.max_keycode() {
+        for level in 0..map.num_levels_for_key(code, 0) {
+            if map.key_get_syms_by_level(code, 0, level).contains(&sym) {
+                return true;
+            }
+        }
+    }
+    false
 }
 
 fn check_sym_presence(
@@ -70,9 +99,14 @@ fn check_sym_presence(
     }
 }
 
-fn check_layout(layout: Layout, allow_missing_return: bool) {
+fn check_layout(
+    layout: Layout,
+    packing: &Packing,
+    shared: &SymbolSet,
+    allow_missing_return: bool,
+) {
     let handler = CountAndPrint::new();
-    let (layout, mut handler) = layout.build(handler);
+    let (layout, mut handler) = layout.build_with_packing(packing, shared, handler);
 
     if handler.0 > 0 {
         println!("{} problems while parsing layout", handler.0)
@@ -110,8 +144,14 @@ fn check_layout(layout: Layout, allow_missing_return: bool) {
         for (_y, row) in view.get_rows() {
             for (_x, button) in row.get_buttons() {
                 for keycode in &button.keycodes {
-                    match xkb_states[keycode.keymap_idx].key_get_one_sym(keycode.code) {
-                        xkb::KEY_NoSymbol => {
+                    let keymap = xkb_states[keycode.keymap_idx].get_keymap();
+                    let syms = keymap.key_get_syms_by_level(
+                        keycode.code,
+                        0,
+                        keycode.shifted as u32,
+                    );
+                    match syms {
+                        [] | [xkb::KEY_NoSymbol] => {
                             eprintln!(
                                 "keymap {}: {}",
                                 keycode.keymap_idx,
@@ -135,3 +175,140 @@ fn check_layout(layout: Layout, allow_missing_return: bool) {
         panic!("Layout contains mistakes");
     }
 }
+
+/// How the symbols of a layout are spread over keymaps
+pub struct KeymapReport {
+    pub symbols: usize,
+    pub keymaps: usize,
+    /// The share of typed symbols needing Shift
+    pub shifted: f64,
+    /// Expected keymap swaps per 1000 typed symbols
+    pub swaps_per_1000: f64,
+}
+
+/// Builds a built-in layout, and finds the keycodes of its symbols
+fn build_builtin_layout(name: &str, packing: &Packing)
+    -> (layout::LayoutParseData, HashMap<String, KeyCode>)
+{
+    let layout = Layout::from_resource(name).expect("Invalid layout data");
+    let (layout, _handler) = layout.build_with_packing(
+        packing,
+        &SymbolSet::default(),
+        logging::Print,
+    );
+    let layout = layout.expect("layout broken");
+
+    fn collect(button: &layout::Button, symbols: &mut HashMap<String, KeyCode>) {
+        let names = match &button.action {
+            Action::Submit { text: _, keys } => keys.iter()
+                .map(|key| key.0.clone())
+                .collect(),
+            Action::Erase => vec!["BackSpace".into()],
+            _ => Vec::new(),
+        };
+        for (name, keycode) in names.into_iter().zip(&button.keycodes) {
+            symbols.insert(name, keycode.clone());
+        }
+        for alternate in &button.alternates {
+            collect(alternate, symbols);
+        }
+    }
+    let mut symbols = HashMap::new();
+    for (_pos, view) in layout.views.values() {
+        for (_y, row) in view.get_rows() {
+            for (_x, button) in row.get_buttons() {
+                collect(button, &mut symbols);
+            }
+        }
+    }
+    (layout, symbols)
+}
+
+/// Packs the symbols of a built-in layout.
+/// With frequencies of typed characters,
+/// frequent symbols are preferred and count more in the results.
+pub fn report_builtin_layout_keymaps(
+    name: &str,
+    shift_level: bool,
+    frequencies: Option<&HashMap<char, f64>>,
+) -> KeymapReport {
+    let packing = Packing { shift_level, frequencies, dead_keys: false };
+    let (layout, symbols) = build_builtin_layout(name, &packing);
+    KeymapReport {
+        symbols: symbols.len(),
+        keymaps: layout.keymaps.len(),
+        shifted: keyboard::shifted_share(&symbols, frequencies),
+        swaps_per_1000: keyboard::expected_swaps(&symbols, frequencies),
+    }
+}
+
+/// Keymaps of a built-in layout, in the readable and in the compact style
+pub fn builtin_layout_keymap_texts(name: &str) -> (Vec<String>, Vec<String>) {
+    let (_layout, symbols) = build_builtin_layout(name, &Packing::for_layouts());
+    let generate = |style| {
+        keyboard::generate_keymaps(symbols.clone(), style)
+            .expect("Keymap can't be formatted")
+    };
+    (generate(KeymapStyle::Readable), generate(KeymapStyle::Compact))
+}
+
+/// What it takes to type a text through the keycodes of a layout
+pub struct TypingReport {
+    /// Characters with a key in the layout
+    pub typed: u64,
+    /// Characters without one
+    pub missing: u64,
+    /// Keymap switches. Each one resets modifiers too.
+    pub swaps: u64,
+    /// Shift presses and releases around symbols on the Shift level
+    pub shift_changes: u64,
+}
+
+/// Types the text with the keycodes of a built-in layout,
+/// as for applications without text input support.
+pub fn type_through_builtin_layout(name: &str, text: &str) -> TypingReport {
+    let (_layout, symbols) = build_builtin_layout(name, &Packing::for_layouts());
+    let mut keys = HashMap::<char, KeyCode>::new();
+    for (name, keycode) in symbols {
+        let c = match name.as_str() {
+            "Return" => Some('\n'),
+            "Tab" => Some('\t'),
+            name => keyboard::symbol_char(name),
+        };
+        if let Some(c) = c {
+            let better = match keys.get(&c) {
+                Some(other) => (keycode.keymap_idx, keycode.shifted)
+                    < (other.keymap_idx, other.shifted),
+                None => true,
+            };
+            if better {
+                keys.insert(c, keycode);
+            }
+        }
+    }
+
+    let mut report = TypingReport {
+        typed: 0,
+        missing: 0,
+        swaps: 0,
+        shift_changes: 0,
+    };
+    // Using a layout selects its first keymap
+    let mut keymap_idx = 0;
+    for c in text.chars() {
+        match keys.get(&c) {
+            Some(keycode) => {
+                report.typed += 1;
+                if keycode.keymap_idx != keymap_idx {
+                    report.swaps += 1;
+                    keymap_idx = keycode.keymap_idx;
+                }
+                if keycode.shifted {
+                    report.shift_changes += 2;
+                }
+            },
+            None => report.missing += 1,
+        }
+    }
+    report
+}
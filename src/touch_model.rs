@@ -0,0 +1,322 @@
+/* Copyright (C) 2026 Purism SPC
+ * SPDX-License-Identifier: GPL-3.0+
+ */
+
+/*! Learned touch offsets for resolving touches near key edges.
+ *
+ * People don't hit the centers of keys, but they miss them consistently.
+ * For every key, the model keeps the running mean and variance
+ * of where it was touched, relative to the key's center
+ * and in units of the key's size.
+ * When a touch lands close to several keys,
+ * the key most likely to have been meant wins.
+ *
+ * A touch counts as accepted once the next key is pressed,
+ * unless that key erases.
+ *
+ * The model is stored as a 4-byte magic, a version byte,
+ * and then a record for every key:
+ *
+ * ``
+ * name_len: u8, name, count: u16, mean_x: f32, mean_y: f32, m2_x: f32, m2_y: f32
+ * ``
+ */
+
+use std::collections::HashMap;
+use std::env;
+use std::fs;
+use std::fs::File;
+use std::io;
+use std::io::{ BufReader, Read, Write };
+use std::path::{ Path, PathBuf };
+use std::sync::mpsc;
+use std::thread;
+
+use crate::logging;
+
+// Traits
+use crate::logging::Warn;
+
+const MAGIC: &[u8; 4] = b"SQTM";
+const VERSION: u8 = 1;
+/// Older touches get forgotten beyond that many.
+const MAX_COUNT: u16 = 200;
+/// The prior is worth that many touches at the center
+const PRIOR_COUNT: f32 = 10.0;
+/// Variance of the prior, in key sizes squared
+const PRIOR_VARIANCE: f32 = 0.25 * 0.25;
+/// How many accepted touches before saving
+const SAVE_INTERVAL: u32 = 64;
+
+pub static MODEL_ENV_VAR: &str = "SQUEEKBOARD_TOUCH_MODEL";
+
+/// Offset from the key center in units of key width and height
+#[derive(Debug, Clone, Copy, PartialEq)]
+pub struct Offset {
+    pub x: f32,
+    pub y: f32,
+}
+
+#[derive(Debug, Clone, Default, PartialEq)]
+struct KeyStats {
+    count: u16,
+    mean_x: f32,
+    mean_y: f32,
+    /// Sums of squared differences from the mean
+    m2_x: f32,
+    m2_y: f32,
+}
+
+impl KeyStats {
+    /// Welford's update. Past the maximum count,
+    /// the count stays put so that old touches slowly fade.
+    fn add(&mut self, offset: Offset) {
+        let n = match self.count < MAX_COUNT {
+            true => {
+                self.count += 1;
+                self.count as f32
+            },
+            false => {
+                let n = self.count as f32;
+                let keep = (n - 1.0) / n;
+                self.m2_x *= keep;
+                self.m2_y *= keep;
+                n
+            },
+        };
+        let dx = offset.x - self.mean_x;
+        let dy = offset.y - self.mean_y;
+        self.mean_x += dx / n;
+        self.mean_y += dy / n;
+        self.m2_x += dx * (offset.x - self.mean_x);
+        self.m2_y += dy * (offset.y - self.mean_y);
+    }
+
+    /// Log of the Gaussian density, up to a constant,
+    /// with the prior blended in.
+    fn log_likelihood(&self, offset: Offset) -> f32 {
+        let n = self.count as f32;
+        let total = n + PRIOR_COUNT;
+        let mean_x = self.mean_x * n / total;
+        let mean_y = self.mean_y * n / total;
+        let var_x = (self.m2_x + PRIOR_VARIANCE * PRIOR_COUNT) / total;
+        let var_y = (self.m2_y + PRIOR_VARIANCE * PRIOR_COUNT) / total;
+        let dx = offset.x - mean_x;
+        let dy = offset.y - mean_y;
+        -0.5 * (dx * dx / var_x + dy * dy / var_y + var_x.ln() + var_y.ln())
+    }
+}
+
+/// Likelihood of the offset on a key with nothing learned
+pub fn default_log_likelihood(offset: Offset) -> f32 {
+    KeyStats::default().log_likelihood(offset)
+}
+
+pub struct TouchModel {
+    keys: HashMap<String, KeyStats>,
+    /// The last touch, until it's known whether it was right
+    pending: Option<(String, Offset)>,
+    unsaved: u32,
+    path: Option<PathBuf>,
+    /// The thread writing the file, started on the first save
+    saver: Option<mpsc::Sender<Vec<u8>>>,
+}
+
+impl TouchModel {
+    pub fn new() -> TouchModel {
+        TouchModel {
+            keys: HashMap::new(),
+            pending: None,
+            unsaved: 0,
+            path: None,
+            saver: None,
+        }
+    }
+
+    /// Returns None unless enabled.
+    pub fn load_from_env() -> Option<TouchModel> {
+        let path = PathBuf::from(env::var_os(MODEL_ENV_VAR)?);
+        let mut model = match File::open(&path) {
+            Ok(file) => TouchModel::read(BufReader::new(file))
+                .or_print(
+                    logging::Problem::Warning,
+                    &format!("Touch model {:?} is broken, starting anew", path),
+                )
+                .unwrap_or_else(TouchModel::new),
+            Err(_) => TouchModel::new(),
+        };
+        model.path = Some(path);
+        Some(model)
+    }
+
+    pub fn log_likelihood(&self, key: &str, offset: Offset) -> f32 {
+        match self.keys.get(key) {
+            Some(stats) => stats.log_likelihood(offset),
+            None => default_log_likelihood(offset),
+        }
+    }
+
+    /// Records a touch. The previous one is accepted.
+    pub fn handle_touch(&mut self, key: &str, offset: Offset) {
+        if let Some((key, offset)) = self.pending.take() {
+            self.keys.entry(key).or_insert_with(KeyStats::default).add(offset);
+            self.unsaved += 1;
+            if self.unsaved >= SAVE_INTERVAL {
+                self.save();
+            }
+        }
+        self.pending = Some((key.into(), offset));
+    }
+
+    /// The previous touch got erased, so it doesn't teach anything.
+    pub fn handle_erase(&mut self) {
+        self.pending = None;
+    }
+
+    /// Writes in the background, to keep touch handling fast.
+    /// All saves go through one thread, so they never overlap.
+    fn save(&mut self) {
+        self.unsaved = 0;
+        let path = match &self.path {
+            Some(path) => path.clone(),
+            None => return,
+        };
+        let mut data = Vec::new();
+        self.write(&mut data)
+            .expect("Writing to memory failed");
+        let saver = self.saver.get_or_insert_with(|| spawn_saver(path));
+        if saver.send(data).is_err() {
+            log_print!(logging::Level::Bug, "The touch model saving thread is gone");
+            self.saver = None;
+        }
+    }
+
+    fn write<W: Write>(&self, out: &mut W) -> Result<(), io::Error> {
+        out.write_all(MAGIC)?;
+        out.write_all(&[VERSION])?;
+        for (name, stats) in &self.keys {
+            let name = name.as_bytes();
+            if name.len() > u8::MAX as usize {
+                continue;
+            }
+            out.write_all(&[name.len() as u8])?;
+            out.write_all(name)?;
+            out.write_all(&stats.count.to_le_bytes())?;
+            for v in &[stats.mean_x, stats.mean_y, stats.m2_x, stats.m2_y] {
+                out.write_all(&v.to_le_bytes())?;
+            }
+        }
+        Ok(())
+    }
+
+    fn read<R: Read>(mut input: R) -> Result<TouchModel, io::Error> {
+        let bad_data = || io::Error::new(io::ErrorKind::InvalidData, "Bad touch model");
+        let mut header = [0; 5];
+        input.read_exact(&mut header)?;
+        if &header[..4] != MAGIC || header[4] != VERSION {
+            return Err(bad_data());
+        }
+        let mut model = TouchModel::new();
+        let mut len = [0; 1];
+        loop {
+            match input.read_exact(&mut len) {
+                Ok(()) => {},
+                Err(e) if e.kind() == io::ErrorKind::UnexpectedEof => break,
+                Err(e) => return Err(e),
+            };
+            let mut name = vec![0; len[0] as usize];
+            input.read_exact(&mut name)?;
+            let name = String::from_utf8(name).map_err(|_| bad_data())?;
+            let mut record = [0; 18];
+            input.read_exact(&mut record)?;
+            let f32_at = |i: usize| f32::from_le_bytes(
+                [record[i], record[i + 1], record[i + 2], record[i + 3]]
+            );
+            let stats = KeyStats {
+                count: u16::from_le_bytes([record[0], record[1]]).min(MAX_COUNT),
+                mean_x: f32_at(2),
+                mean_y: f32_at(6),
+                m2_x: f32_at(10),
+                m2_y: f32_at(14),
+            };
+            if !(stats.m2_x >= 0.0 && stats.m2_y >= 0.0) {
+                return Err(bad_data());
+            }
+            model.keys.insert(name, stats);
+        }
+        Ok(model)
+    }
+}
+
+/// Only the newest of the models waiting gets written.
+fn spawn_saver(path: PathBuf) -> mpsc::Sender<Vec<u8>> {
+    let (sender, receiver) = mpsc::channel::<Vec<u8>>();
+    thread::Builder::new()
+        .name("touch model".into())
+        .spawn(move || {
+            while let Ok(data) = receiver.recv() {
+                let data = receiver.try_iter().last().unwrap_or(data);
+                save_atomically(&path, &data)
+                    .or_print(
+                        logging::Problem::Warning,
+                        &format!("Can't save touch model to {:?}", path),
+                    );
+            }
+        })
+        .expect("Can't start the touch model saving thread");
+    sender
+}
+
+/// Never leaves a half-written file behind
+fn save_atomically(path: &Path, data: &[u8]) -> Result<(), io::Error> {
+    if let Some(dir) = path.parent() {
+        fs::create_dir_all(dir)?;
+    }
+    let temp = path.with_extension("tmp");
+    {
+        let mut file = File::create(&temp)?;
+        file.write_all(data)?;
+        file.sync_all()?;
+    }
+    fs::rename(&temp, path)
+}
+
+#[cfg(test)]
+mod test {
+    use super::*;
+
+    #[test]
+    fn learns_offset() {
+        let mut model = TouchModel::new();
+        // Always hitting "a" on its right edge, "s" in the center
+        for _ in 0..50 {
+            model.handle_touch("a", Offset { x: 0.4, y: 0.0 });
+            model.handle_touch("s", Offset { x: 0.0, y: 0.0 });
+        }
+        // Right at the border between them
+        let on_a = model.log_likelihood("a", Offset { x: 0.5, y: 0.0 });
+        let on_s = model.log_likelihood("s", Offset { x: -0.5, y: 0.0 });
+        assert!(on_a > on_s);
+    }
+
+    #[test]
+    fn erased_touch_ignored() {
+        let mut model = TouchModel::new();
+        model.handle_touch("a", Offset { x: 0.4, y: 0.0 });
+        model.handle_erase();
+        model.handle_touch("BackSpace", Offset { x: 0.0, y: 0.0 });
+        assert!(model.keys.get("a").is_none());
+    }
+
+    #[test]
+    fn roundtrip() {
+        let mut model = TouchModel::new();
+        for i in 0..5 {
+            model.handle_touch("a", Offset { x: 0.1 * i as f32, y: -0.2 });
+        }
+        let mut data = Vec::new();
+        model.write(&mut data).unwrap();
+        let read = TouchModel::read(&data[..]).unwrap();
+        assert_eq!(read.keys, model.keys);
+    }
+}
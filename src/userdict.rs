@@ -0,0 +1,612 @@
+/* Copyright (C) 2026 Purism SPC
+ * SPDX-License-Identifier: GPL-3.0+
+ */
+
+/*! Words learned from the user.
+ *
+ * Learning a word must not stall typing, so it only appends a line
+ * to a journal. Once the journal holds enough words, it gets renamed
+ * to a numbered generation, and a background thread merges it
+ * into a snapshot, which is sorted and memory-mapped for lookups.
+ * Words learned in the meantime go to a new journal.
+ *
+ * Every file gets replaced by renaming, so a crash leaves
+ * either the old or the new snapshot behind.
+ * The snapshot records the last generation merged into it,
+ * and journals of older generations get removed on startup,
+ * so that no word gets counted twice.
+ * An unfinished line at the end of the journal gets dropped,
+ * which loses at most the last word.
+ *
+ * The journal never grows beyond `COMPACT_WORDS` lines,
+ * and the snapshot keeps up to `MAX_WORDS` of the most used words.
+ *
+ * Snapshot layout, integers are little-endian:
+ *
+ * ``
+ * header: magic "SQUD", version: u8, padding: [u8; 3],
+ *         entry_count: u32, generation: u32
+ * index: entry_count * offset: u32
+ * entries, sorted: (word_len: u8, word, count: u32)
+ * ``
+ */
+
+use std::collections::HashMap;
+use std::fs;
+use std::fs::{ File, OpenOptions };
+use std::io;
+use std::io::Write;
+use std::ops::Deref;
+use std::path::{ Path, PathBuf };
+use std::sync::mpsc;
+use std::thread;
+
+use crate::logging;
+use crate::predict::{ Completions, Error, Mapped };
+use crate::xdg;
+
+// Traits
+use crate::logging::Warn;
+
+const MAGIC: &[u8; 4] = b"SQUD";
+const VERSION: u8 = 1;
+const HEADER_SIZE: usize = 16;
+const INDEX_ENTRY_SIZE: usize = 4;
+/// Longer words don't get learned
+const MAX_WORD: usize = 64;
+/// Words in the snapshot
+const MAX_WORDS: usize = 10000;
+/// Journal lines which trigger compaction
+const COMPACT_WORDS: usize = 256;
+
+const SNAPSHOT: &str = "words.snapshot";
+const JOURNAL: &str = "words.journal";
+
+fn u32_at(data: &[u8], offset: usize) -> u32 {
+    u32::from_le_bytes([
+        data[offset], data[offset + 1], data[offset + 2], data[offset + 3],
+    ])
+}
+
+/// Turns word counts into the snapshot format.
+fn build(counts: &HashMap<String, u32>, generation: u32) -> Vec<u8> {
+    let mut words: Vec<(&String, &u32)> = counts.iter()
+        .filter(|(word, _)| !word.is_empty() && word.len() <= MAX_WORD)
+        .collect();
+    if words.len() > MAX_WORDS {
+        // The least used words go first
+        words.sort_by(|(w1, c1), (w2, c2)| c2.cmp(c1).then(w1.cmp(w2)));
+        words.truncate(MAX_WORDS);
+    }
+    words.sort_by(|(w1, _), (w2, _)| w1.as_bytes().cmp(w2.as_bytes()));
+
+    let mut out = Vec::from(&MAGIC[..]);
+    out.extend_from_slice(&[VERSION, 0, 0, 0]);
+    out.extend_from_slice(&(words.len() as u32).to_le_bytes());
+    out.extend_from_slice(&generation.to_le_bytes());
+    let mut offset = HEADER_SIZE + words.len() * INDEX_ENTRY_SIZE;
+    for (word, _) in &words {
+        out.extend_from_slice(&(offset as u32).to_le_bytes());
+        offset += 1 + word.len() + 4;
+    }
+    for (word, count) in &words {
+        out.push(word.len() as u8);
+        out.extend_from_slice(word.as_bytes());
+        out.extend_from_slice(&count.to_le_bytes());
+    }
+    out
+}
+
+/// Merged words, read in place
+struct Snapshot<T: Deref<Target=[u8]> = Mapped> {
+    data: T,
+    entry_count: usize,
+    generation: u32,
+}
+
+impl Snapshot<Mapped> {
+    /// None when there's no snapshot yet
+    fn open(path: &Path) -> Result<Option<Self>, Error> {
+        match Mapped::open(path) {
+            Ok(data) => Snapshot::new(data).map(Some),
+            Err(e) if e.kind() == io::ErrorKind::NotFound => Ok(None),
+            Err(e) => Err(e.into()),
+        }
+    }
+}
+
+impl<T: Deref<Target=[u8]>> Snapshot<T> {
+    fn new(data: T) -> Result<Self, Error> {
+        if data.len() < HEADER_SIZE || &data[..4] != MAGIC || data[4] != VERSION {
+            return Err(Error::BadHeader);
+        }
+        let entry_count = u32_at(&data, 8) as usize;
+        let generation = u32_at(&data, 12);
+        let entries_start = entry_count.checked_mul(INDEX_ENTRY_SIZE)
+            .and_then(|size| size.checked_add(HEADER_SIZE));
+        let entries_start = match entries_start {
+            Some(start) if start <= data.len() => start,
+            _ => return Err(Error::BadHeader),
+        };
+        let snapshot = Snapshot { data, entry_count, generation };
+        for entry in 0..entry_count {
+            let offset = snapshot.entry_offset(entry);
+            if offset < entries_start || offset >= snapshot.data.len() {
+                return Err(Error::BadHeader);
+            }
+        }
+        Ok(snapshot)
+    }
+
+    fn entry_offset(&self, entry: usize) -> usize {
+        u32_at(&self.data, HEADER_SIZE + entry * INDEX_ENTRY_SIZE) as usize
+    }
+
+    /// Entries cut short read as empty
+    fn entry(&self, entry: usize) -> (&[u8], u32) {
+        let offset = self.entry_offset(entry);
+        let len = self.data.get(offset).copied().unwrap_or(0) as usize;
+        let word = self.data.get(offset + 1..offset + 1 + len);
+        let count = self.data.get(offset + 1 + len..offset + 5 + len);
+        match (word, count) {
+            (Some(word), Some(count)) => {
+                (word, u32_at(count, 0))
+            },
+            _ => (&[], 0),
+        }
+    }
+
+    /// First entry not before the prefix
+    fn lower_bound(&self, prefix: &[u8]) -> usize {
+        let (mut low, mut high) = (0, self.entry_count);
+        while low < high {
+            let mid = (low + high) / 2;
+            match self.entry(mid).0 < prefix {
+                true => low = mid + 1,
+                false => high = mid,
+            }
+        }
+        low
+    }
+
+    fn count(&self, word: &str) -> u32 {
+        let entry = self.lower_bound(word.as_bytes());
+        match entry < self.entry_count {
+            true => match self.entry(entry) {
+                (found, count) if found == word.as_bytes() => count,
+                _ => 0,
+            },
+            false => 0,
+        }
+    }
+
+    /// Words starting with the prefix
+    fn with_prefix<'a>(&'a self, prefix: &'a str)
+        -> impl Iterator<Item=(&'a str, u32)> + 'a
+    {
+        (self.lower_bound(prefix.as_bytes())..self.entry_count)
+            .map(move |entry| self.entry(entry))
+            .take_while(move |(word, _)| word.starts_with(prefix.as_bytes()))
+            .filter_map(|(word, count)| {
+                std::str::from_utf8(word).ok().map(|word| (word, count))
+            })
+    }
+
+    fn all(&self) -> impl Iterator<Item=(&str, u32)> + '_ {
+        self.with_prefix("")
+    }
+}
+
+fn journal_path(dir: &Path, generation: u32) -> PathBuf {
+    dir.join(format!("{}.{}", JOURNAL, generation))
+}
+
+/// Counts the complete lines of a journal
+fn read_journal(path: &Path, counts: &mut HashMap<String, u32>) -> io::Result<()> {
+    let data = fs::read(path)?;
+    let complete = match data.iter().rposition(|b| *b == b'\n') {
+        Some(end) => &data[..end],
+        None => return Ok(()),
+    };
+    for word in String::from_utf8_lossy(complete).lines() {
+        if !word.is_empty() {
+            add(counts, word, 1);
+        }
+    }
+    Ok(())
+}
+
+/// Merges the journals into a new snapshot, and removes them.
+/// Runs in the background.
+fn compact(dir: &Path, journals: &[(u32, PathBuf)]) -> Result<(), Error> {
+    let snapshot_path = dir.join(SNAPSHOT);
+    let mut counts = HashMap::new();
+    if let Some(snapshot) = Snapshot::open(&snapshot_path)? {
+        counts.extend(snapshot.all().map(|(word, count)| (word.into(), count)));
+    }
+    for (_generation, path) in journals {
+        read_journal(path, &mut counts)?;
+    }
+    let generation = journals.iter().map(|(g, _)| *g).max().unwrap_or(0);
+    let temporary = dir.join(format!("{}.new", SNAPSHOT));
+    {
+        let mut file = File::create(&temporary)?;
+        file.write_all(&build(&counts, generation))?;
+        file.sync_all()?;
+    }
+    fs::rename(&temporary, &snapshot_path)?;
+    // The snapshot is in place, the journals are not needed any more
+    for (_generation, path) in journals {
+        fs::remove_file(path)?;
+    }
+    Ok(())
+}
+
+fn crashed() -> Error {
+    Error::Io(io::Error::new(io::ErrorKind::Other, "Compaction crashed"))
+}
+
+/// Adds a word to a list of counts
+fn open_journal(dir: &Path) -> io::Result<File> {
+    OpenOptions::new()
+        .create(true)
+        .append(true)
+        .open(dir.join(JOURNAL))
+}
+
+fn add(counts: &mut HashMap<String, u32>, word: &str, count: u32) {
+    let total = counts.entry(word.into()).or_insert(0);
+    *total = total.saturating_add(count);
+}
+
+struct Compaction {
+    done: mpsc::Receiver<Result<(), Error>>,
+    journals: Vec<(u32, PathBuf)>,
+    /// The words being compacted, until they reach the snapshot
+    counts: HashMap<String, u32>,
+}
+
+/// Learned words, with the number of times each was used.
+pub struct Store {
+    dir: PathBuf,
+    snapshot: Option<Snapshot>,
+    /// Missing after failing to create a new one.
+    /// Learning stops until it can be created.
+    journal: Option<File>,
+    /// Words in the current journal
+    recent: HashMap<String, u32>,
+    journal_lines: usize,
+    /// Journals waiting to get compacted, after a failure
+    leftover: Vec<(u32, PathBuf)>,
+    leftover_counts: HashMap<String, u32>,
+    /// Generation of the last journal set aside
+    generation: u32,
+    compaction: Option<Compaction>,
+}
+
+impl Store {
+    /// Uses the files in `dir`, creating it if needed.
+    pub fn open(dir: &Path) -> Result<Store, Error> {
+        fs::create_dir_all(dir)?;
+        let snapshot = Snapshot::open(&dir.join(SNAPSHOT))?;
+        let merged = snapshot.as_ref().map(|s| s.generation).unwrap_or(0);
+
+        // Journals set aside before the last exit
+        let mut leftover = Vec::new();
+        let prefix = format!("{}.", JOURNAL);
+        for entry in fs::read_dir(dir)? {
+            let entry = entry?;
+            let name = entry.file_name();
+            let generation = name.to_str()
+                .and_then(|name| name.strip_prefix(&prefix))
+                .and_then(|generation| generation.parse::<u32>().ok());
+            match generation {
+                // Already in the snapshot
+                Some(generation) if generation <= merged => {
+                    fs::remove_file(entry.path())?;
+                },
+                Some(generation) => leftover.push((generation, entry.path())),
+                None => {},
+            }
+        }
+        leftover.sort();
+        let mut leftover_counts = HashMap::new();
+        for (_generation, path) in &leftover {
+            read_journal(path, &mut leftover_counts)?;
+        }
+
+        let journal_path = dir.join(JOURNAL);
+        let journal = open_journal(dir)?;
+        let mut recent = HashMap::new();
+        read_journal(&journal_path, &mut recent)?;
+        // Drop the unfinished line, so that the next one starts clean
+        let data = fs::read(&journal_path)?;
+        let complete = data.iter().rposition(|b| *b == b'\n')
+            .map(|end| end + 1)
+            .unwrap_or(0);
+        if complete < data.len() {
+            journal.set_len(complete as u64)?;
+        }
+        let journal_lines = recent.values().map(|c| *c as usize).sum();
+
+        let generation = leftover.iter()
+            .map(|(g, _)| *g)
+            .max()
+            .unwrap_or(0)
+            .max(merged);
+        let mut store = Store {
+            dir: dir.into(),
+            snapshot,
+            journal: Some(journal),
+            recent,
+            journal_lines,
+            leftover,
+            leftover_counts,
+            generation,
+            compaction: None,
+        };
+        if !store.leftover.is_empty() {
+            store.start_compaction(Vec::new(), HashMap::new());
+        }
+        Ok(store)
+    }
+
+    /// Learning is disabled without a data directory.
+    pub fn load_default() -> Option<Store> {
+        let dir = xdg::data_path("squeekboard/learned")?;
+        Store::open(&dir)
+            .or_print(
+                logging::Problem::Warning,
+                &format!("Can't open learned words in {:?}", dir),
+            )
+    }
+
+    /// Counts one more use of the word.
+    pub fn learn(&mut self, word: &str) {
+        self.poll();
+        if word.is_empty() || word.len() > MAX_WORD || word.contains('\n') {
+            return;
+        }
+        if self.journal.is_none() {
+            self.journal = open_journal(&self.dir)
+                .or_print(logging::Problem::Warning, "Can't create a journal");
+        }
+        let journal = match &mut self.journal {
+            Some(journal) => journal,
+            None => return,
+        };
+        // A single write, so that lines don't get torn apart
+        let line = format!("{}\n", word);
+        let written = journal.write_all(line.as_bytes())
+            .or_print(logging::Problem::Warning, "Can't write learned word");
+        if written.is_none() {
+            return;
+        }
+        add(&mut self.recent, word, 1);
+        self.journal_lines += 1;
+        if self.journal_lines >= COMPACT_WORDS && self.compaction.is_none() {
+            self.set_journal_aside();
+        }
+    }
+
+    /// Starts a new journal, and compacts the old one.
+    fn set_journal_aside(&mut self) {
+        let generation = self.generation + 1;
+        let aside = journal_path(&self.dir, generation);
+        let renamed = fs::rename(self.dir.join(JOURNAL), &aside)
+            .or_print(logging::Problem::Warning, "Can't set the journal aside");
+        if renamed.is_none() {
+            return;
+        }
+        // The old handle would write into the journal being compacted,
+        // so it gets dropped even if the new journal can't be created.
+        self.journal = open_journal(&self.dir)
+            .or_print(logging::Problem::Warning, "Can't create a journal");
+        self.generation = generation;
+        self.journal_lines = 0;
+        let counts = std::mem::take(&mut self.recent);
+        self.start_compaction(vec![(generation, aside)], counts);
+    }
+
+    fn start_compaction(
+        &mut self,
+        mut journals: Vec<(u32, PathBuf)>,
+        mut counts: HashMap<String, u32>,
+    ) {
+        // Whatever failed before gets another try
+        journals.extend(self.leftover.drain(..));
+        for (word, count) in self.leftover_counts.drain() {
+            add(&mut counts, &word, count);
+        }
+        let (sender, done) = mpsc::channel();
+        let dir = self.dir.clone();
+        let to_compact = journals.clone();
+        let spawned = thread::Builder::new()
+            .name("compaction".into())
+            .spawn(move || {
+                // The receiver may be gone when exiting
+                let _ = sender.send(compact(&dir, &to_compact));
+            });
+        match spawned {
+            Ok(_) => self.compaction = Some(Compaction { done, journals, counts }),
+            Err(e) => {
+                log_print!(
+                    logging::Level::Warning,
+                    "Can't start compaction: {}", e,
+                );
+                self.leftover = journals;
+                self.leftover_counts = counts;
+            },
+        }
+    }
+
+    /// Picks up a finished compaction.
+    fn poll(&mut self) {
+        let result = match &self.compaction {
+            Some(compaction) => match compaction.done.try_recv() {
+                Ok(result) => result,
+                Err(mpsc::TryRecvError::Empty) => return,
+                Err(mpsc::TryRecvError::Disconnected) => Err(crashed()),
+            },
+            None => return,
+        };
+        self.finish_compaction(result);
+    }
+
+    /// Blocks until the background compaction is done.
+    #[cfg(test)]
+    fn wait(&mut self) {
+        let result = match &self.compaction {
+            Some(compaction) => compaction.done.recv().unwrap_or_else(|_| Err(crashed())),
+            None => return,
+        };
+        self.finish_compaction(result);
+    }
+
+    fn finish_compaction(&mut self, result: Result<(), Error>) {
+        let compaction = match self.compaction.take() {
+            Some(compaction) => compaction,
+            None => return,
+        };
+        let snapshot = result.and_then(|()| Snapshot::open(&self.dir.join(SNAPSHOT)));
+        match snapshot {
+            Ok(snapshot) => self.snapshot = snapshot,
+            Err(e) => {
+                log_print!(
+                    logging::Level::Warning,
+                    "Can't compact learned words: {}", e,
+                );
+                self.leftover = compaction.journals;
+                self.leftover_counts = compaction.counts;
+            },
+        }
+    }
+
+    /// Words not in the snapshot yet
+    fn in_memory(&self) -> impl Iterator<Item=&HashMap<String, u32>> {
+        vec![
+            Some(&self.recent),
+            Some(&self.leftover_counts),
+            self.compaction.as_ref().map(|c| &c.counts),
+        ].into_iter().flatten()
+    }
+
+    /// How many times the word was learned
+    pub fn count(&self, word: &str) -> u32 {
+        let stored = self.snapshot.as_ref().map(|s| s.count(word)).unwrap_or(0);
+        self.in_memory()
+            .filter_map(|counts| counts.get(word))
+            .fold(stored, |total, count| total.saturating_add(*count))
+    }
+}
+
+impl Completions for Store {
+    /// The most often learned words starting with the prefix
+    fn complete(&self, prefix: &str, count: usize) -> Vec<String> {
+        let mut found: HashMap<&str, u32> = HashMap::new();
+        if let Some(snapshot) = &self.snapshot {
+            for (word, count) in snapshot.with_prefix(prefix) {
+                found.insert(word, count);
+            }
+        }
+        for counts in self.in_memory() {
+            for (word, count) in counts.iter() {
+                if word.starts_with(prefix) {
+                    let total = found.entry(word.as_str()).or_insert(0);
+                    *total = total.saturating_add(*count);
+                }
+            }
+        }
+        let mut found: Vec<(&str, u32)> = found.into_iter()
+            .filter(|(word, _)| word.len() > prefix.len())
+            .collect();
+        found.sort_by(|(w1, c1), (w2, c2)| c2.cmp(c1).then(w1.cmp(w2)));
+        found.into_iter()
+            .take(count)
+            .map(|(word, _)| word.into())
+            .collect()
+    }
+}
+
+#[cfg(test)]
+mod test {
+    use super::*;
+
+    use std::time::{ SystemTime, UNIX_EPOCH };
+
+    fn temp_dir(name: &str) -> PathBuf {
+        let nanos = SystemTime::now().duration_since(UNIX_EPOCH)
+            .unwrap()
+            .as_nanos();
+        std::env::temp_dir()
+            .join(format!("squeekboard-{}-{}-{}", name, std::process::id(), nanos))
+    }
+
+    #[test]
+    fn snapshot_lookup() {
+        let counts: HashMap<String, u32> = [("hello", 3), ("help", 5), ("world", 1)]
+            .iter()
+            .map(|(w, c)| (w.to_string(), *c))
+            .collect();
+        let snapshot = Snapshot::new(build(&counts, 7)).unwrap();
+        assert_eq!(snapshot.generation, 7);
+        assert_eq!(snapshot.count("help"), 5);
+        assert_eq!(snapshot.count("hel"), 0);
+        let found: Vec<&str> = snapshot.with_prefix("hel").map(|(w, _)| w).collect();
+        assert_eq!(found, vec!["hello", "help"]);
+        assert!(Snapshot::new(b"SQUD".to_vec()).is_err());
+    }
+
+    #[test]
+    fn learn_and_compact() {
+        let dir = temp_dir("learn");
+        let mut store = Store::open(&dir).unwrap();
+        for _ in 0..COMPACT_WORDS {
+            store.learn("often");
+        }
+        store.learn("rarely");
+        store.wait();
+        assert!(store.compaction.is_none());
+        assert_eq!(store.snapshot.as_ref().unwrap().count("often"), COMPACT_WORDS as u32);
+        assert_eq!(store.count("often"), COMPACT_WORDS as u32);
+        assert_eq!(store.count("rarely"), 1);
+        assert_eq!(store.complete("o", 3), vec!["often".to_string()]);
+        drop(store);
+
+        // Everything is back after restarting
+        let store = Store::open(&dir).unwrap();
+        assert_eq!(store.count("often"), COMPACT_WORDS as u32);
+        assert_eq!(store.count("rarely"), 1);
+        fs::remove_dir_all(&dir).unwrap();
+    }
+
+    #[test]
+    fn recover_after_crash() {
+        let dir = temp_dir("recover");
+        fs::create_dir_all(&dir).unwrap();
+        // Already merged into the snapshot, and then not removed
+        let counts = [("merged".to_string(), 2)].iter().cloned().collect();
+        fs::write(dir.join(SNAPSHOT), build(&counts, 1)).unwrap();
+        fs::write(journal_path(&dir, 1), "merged\nmerged\n").unwrap();
+        // Set aside, but not merged
+        fs::write(journal_path(&dir, 2), "aside\n").unwrap();
+        // Torn last line
+        fs::write(dir.join(JOURNAL), "current\ncurr").unwrap();
+
+        let mut store = Store::open(&dir).unwrap();
+        assert!(!journal_path(&dir, 1).exists());
+        assert_eq!(store.count("merged"), 2);
+        assert_eq!(store.count("aside"), 1);
+        assert_eq!(store.count("current"), 1);
+        assert_eq!(store.count("curr"), 0);
+        store.wait();
+        assert!(!journal_path(&dir, 2).exists());
+        assert_eq!(store.count("aside"), 1);
+        store.learn("next");
+        assert_eq!(
+            fs::read_to_string(dir.join(JOURNAL)).unwrap(),
+            "current\nnext\n",
+        );
+        fs::remove_dir_all(&dir).unwrap();
+    }
+}
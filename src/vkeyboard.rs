@@ -1,6 +1,16 @@
 /*! Managing the events belonging to virtual-keyboard interface. */
 
+use std::collections::HashMap;
+use std::collections::hash_map::DefaultHasher;
+use std::ffi::{ CStr, CString };
+use std::hash::{ Hash, Hasher };
+use std::rc::Rc;
+use std::sync::{ Arc, Mutex };
+use std::thread;
+use std::time::Duration;
+
 use crate::keyboard::{ Modifiers, PressType };
+use crate::logging;
 use crate::submission::Timestamp;
 
 /// Standard xkb keycode
@@ -9,7 +19,10 @@ type KeyCode = u32;
 /// Gathers stuff defined in C or called by C
 pub mod c {
     use std::ffi::CStr;
+    use std::fs::File;
+    use std::io;
     use std::os::raw::{ c_char, c_void };
+    use std::os::unix::io::{ AsRawFd, IntoRawFd, RawFd };
     use std::ptr;
 
     #[repr(transparent)]
@@ -34,6 +47,38 @@ pub mod c {
                 squeek_key_map_from_str(s.as_ptr())
             }
         }
+
+        /// Takes ownership of an already prepared file.
+        pub fn from_file(file: File, fd_len: usize) -> KeyMap {
+            KeyMap {
+                fd: file.into_raw_fd() as u32,
+                fd_len,
+            }
+        }
+
+        /// Bytes, as sent to the compositor
+        pub fn size(&self) -> usize {
+            self.fd_len
+        }
+
+        /// Another handle to the same file,
+        /// for when the original may get closed before the keymap is sent.
+        pub fn try_clone(&self) -> Result<KeyMap, io::Error> {
+            let fd = unsafe { dup(self.fd as i32) };
+            match fd < 0 {
+                true => Err(io::Error::last_os_error()),
+                false => Ok(KeyMap {
+                    fd: fd as u32,
+                    fd_len: self.fd_len,
+                }),
+            }
+        }
+    }
+
+    impl AsRawFd for KeyMap {
+        fn as_raw_fd(&self) -> RawFd {
+            self.fd as RawFd
+        }
     }
 
     impl Drop for KeyMap {
@@ -47,6 +92,7 @@ pub mod c {
     extern "C" {
         // From libc, to let KeyMap get deallocated.
         fn close(fd: u32);
+        fn dup(fd: i32) -> i32;
 
         pub fn eek_virtual_keyboard_v1_key(
             virtual_keyboard: ZwpVirtualKeyboardV1,
@@ -69,10 +115,147 @@ pub mod c {
     }
 }
 
+/// Receives the virtual keyboard events.
+///
+/// The Wayland connection is the normal destination,
+/// but anything that can consume the events can stand in,
+/// e.g. when replaying recorded input without a compositor.
+pub trait Backend {
+    /// `keycode` is already translated to the protocol's keycode space.
+    fn key(&self, keycode: KeyCode, action: PressType, timestamp: Timestamp);
+    fn set_modifiers(&self, modifiers: Modifiers);
+    fn load_keymap(&self, keymap: &CStr) -> c::KeyMap;
+    /// Loads keymaps which aren't loaded yet, in order.
+    fn load_keymaps(&self, keymaps: &[&CStr]) -> Vec<c::KeyMap> {
+        keymaps.iter().map(|keymap| self.load_keymap(keymap)).collect()
+    }
+    fn update_keymap(&self, keymap: &c::KeyMap);
+}
+
+impl Backend for c::ZwpVirtualKeyboardV1 {
+    fn key(&self, keycode: KeyCode, action: PressType, timestamp: Timestamp) {
+        unsafe {
+            c::eek_virtual_keyboard_v1_key(
+                *self, timestamp.0, keycode, action as u32
+            );
+        }
+    }
+
+    fn set_modifiers(&self, modifiers: Modifiers) {
+        let modifiers = modifiers.bits() as u32;
+        unsafe {
+            c::eek_virtual_keyboard_set_modifiers(*self, modifiers);
+        }
+    }
+
+    fn load_keymap(&self, keymap: &CStr) -> c::KeyMap {
+        c::KeyMap::from_cstr(keymap)
+    }
+
+    fn load_keymaps(&self, keymaps: &[&CStr]) -> Vec<c::KeyMap> {
+        load_in_parallel(keymaps)
+    }
+
+    fn update_keymap(&self, keymap: &c::KeyMap) {
+        unsafe {
+            c::eek_virtual_keyboard_update_keymap(
+                *self,
+                keymap as *const c::KeyMap,
+            );
+        }
+    }
+}
+
+/// Keymap activity caused by one layout
+#[derive(Clone, Debug, Default, PartialEq)]
+pub struct Churn {
+    /// Keymaps sent to the compositor
+    pub updates: u64,
+    /// Of those, switches needed to submit keys
+    pub swaps: u64,
+    /// Sent to the compositor, and by it to every application in focus
+    pub bytes: u64,
+    /// Spent loading keymaps when the layout gets used.
+    /// Sending them happens on the wire thread, and is not included.
+    pub time: Duration,
+}
+
+/// Keymap activity by layout name, readable from any thread
+pub type ChurnStats = Arc<Mutex<HashMap<String, Churn>>>;
+
+/// Keymaps kept loaded, including those not used by the current layout
+const KEYMAP_CACHE_SIZE: usize = 16;
+
+/// Loaded keymaps, found by their text.
+///
+/// Loading compiles the keymap and copies it into a new shared memory file.
+/// The files never change afterwards, so switching back to a layout
+/// can send the same files again.
+struct KeymapCache {
+    capacity: usize,
+    /// Least recently used first.
+    /// The hash of the text only speeds up finding it.
+    entries: Vec<(u64, CString, Rc<c::KeyMap>)>,
+}
+
+impl KeymapCache {
+    fn new(capacity: usize) -> Self {
+        KeymapCache { capacity, entries: Vec::with_capacity(capacity) }
+    }
+
+    fn find(&self, keymap: &CStr) -> Option<usize> {
+        let hash = hash_keymap(keymap);
+        self.entries.iter()
+            .position(|(h, text, _)| *h == hash && text.as_c_str() == keymap)
+    }
+
+    fn contains(&self, keymap: &CStr) -> bool {
+        self.find(keymap).is_some()
+    }
+
+    fn get_or_load<F: FnOnce(&CStr) -> c::KeyMap>(
+        &mut self,
+        keymap: &CStr,
+        load: F,
+    ) -> Rc<c::KeyMap> {
+        if let Some(idx) = self.find(keymap) {
+            let entry = self.entries.remove(idx);
+            let loaded = entry.2.clone();
+            self.entries.push(entry);
+            return loaded;
+        }
+        let loaded = Rc::new(load(keymap));
+        if self.capacity > 0 {
+            if self.entries.len() == self.capacity {
+                // Layouts still using it keep it open
+                self.entries.remove(0);
+            }
+            self.entries.push((hash_keymap(keymap), keymap.to_owned(), loaded.clone()));
+        }
+        loaded
+    }
+}
+
+fn hash_keymap(keymap: &CStr) -> u64 {
+    let mut hasher = DefaultHasher::new();
+    keymap.to_bytes().hash(&mut hasher);
+    hasher.finish()
+}
+
 /// Layout-independent backend. TODO: Have one instance per program or seat
-pub struct VirtualKeyboard(pub c::ZwpVirtualKeyboardV1);
+pub struct VirtualKeyboard {
+    backend: Box<dyn Backend>,
+    keymaps: KeymapCache,
+}
 
 impl VirtualKeyboard {
+    pub fn new(backend: Box<dyn Backend>) -> Self {
+        VirtualKeyboard {
+            backend,
+            keymaps: KeymapCache::new(KEYMAP_CACHE_SIZE),
+        }
+    }
+
     // TODO: error out if keymap not set
     pub fn switch(
         &self,
@@ -81,26 +264,138 @@ impl VirtualKeyboard {
         timestamp: Timestamp,
     ) {
         let keycode = keycode - 8;
-        unsafe {
-            c::eek_virtual_keyboard_v1_key(
-                self.0, timestamp.0, keycode, action.clone() as u32
-            );
-        }
+        self.backend.key(keycode, action, timestamp);
     }
     
     pub fn set_modifiers_state(&self, modifiers: Modifiers) {
-        let modifiers = modifiers.bits() as u32;
-        unsafe {
-            c::eek_virtual_keyboard_set_modifiers(self.0, modifiers);
+        self.backend.set_modifiers(modifiers);
+    }
+
+    /// Keymaps loaded before are reused.
+    /// Only the others get loaded, all at once.
+    pub fn load_keymaps(&mut self, keymaps: &[CString]) -> Vec<Rc<c::KeyMap>> {
+        let mut missing: Vec<&CStr> = Vec::new();
+        for keymap in keymaps {
+            let keymap = keymap.as_c_str();
+            if !self.keymaps.contains(keymap) && !missing.contains(&keymap) {
+                missing.push(keymap);
+            }
         }
+        let loaded = self.backend.load_keymaps(&missing);
+        let mut loaded: Vec<_> = missing.into_iter().zip(loaded).collect();
+        let backend = &self.backend;
+        let cache = &mut self.keymaps;
+        keymaps.iter()
+            .map(|keymap| cache.get_or_load(keymap, |keymap| {
+                match loaded.iter().position(|(text, _)| *text == keymap) {
+                    Some(idx) => loaded.swap_remove(idx).1,
+                    // Pushed out of the cache by the other keymaps
+                    None => backend.load_keymap(keymap),
+                }
+            }))
+            .collect()
     }
     
     pub fn update_keymap(&self, keymap: &c::KeyMap) {
-        unsafe {
-            c::eek_virtual_keyboard_update_keymap(
-                self.0,
-                keymap as *const c::KeyMap,
+        self.backend.update_keymap(keymap);
+    }
+}
+
+/// Loads several keymaps into files at the same time,
+/// each on its own thread.
+/// A single keymap gets loaded right away.
+pub fn load_in_parallel(keymaps: &[&CStr]) -> Vec<c::KeyMap> {
+    if keymaps.len() < 2 {
+        return keymaps.iter().map(|keymap| c::KeyMap::from_cstr(keymap)).collect();
+    }
+    let workers: Vec<_> = keymaps.iter()
+        .map(|keymap| CString::from(*keymap))
+        .map(|keymap| thread::spawn(move || c::KeyMap::from_cstr(&keymap)))
+        .collect();
+    let loaded: Result<Vec<_>, _> = workers.into_iter()
+        .map(|worker| worker.join())
+        .collect();
+    match loaded {
+        Ok(loaded) => loaded,
+        Err(_) => {
+            log_print!(
+                logging::Level::Bug,
+                "Loading keymaps in parallel failed, loading one by one",
             );
+            keymaps.iter().map(|keymap| c::KeyMap::from_cstr(keymap)).collect()
+        },
+    }
+}
+
+#[cfg(test)]
+mod test {
+    use super::*;
+
+    use std::cell::Cell;
+    use std::ffi::CString;
+    use std::fs::File;
+
+    fn load(loads: &Cell<u32>) -> impl FnOnce(&CStr) -> c::KeyMap + '_ {
+        move |_keymap| {
+            loads.set(loads.get() + 1);
+            let file = File::open("/dev/null").unwrap();
+            c::KeyMap::from_file(file, 0)
         }
     }
+
+    #[test]
+    fn keymap_cache_reuses() {
+        let loads = Cell::new(0);
+        let mut cache = KeymapCache::new(2);
+        let (a, b, c) = (
+            CString::new("a").unwrap(),
+            CString::new("b").unwrap(),
+            CString::new("c").unwrap(),
+        );
+        let first = cache.get_or_load(&a, load(&loads));
+        let again = cache.get_or_load(&a, load(&loads));
+        assert!(Rc::ptr_eq(&first, &again));
+        assert_eq!(loads.get(), 1);
+        cache.get_or_load(&b, load(&loads));
+        // "a" was used more recently than "b", which goes
+        cache.get_or_load(&a, load(&loads));
+        cache.get_or_load(&c, load(&loads));
+        assert_eq!(loads.get(), 3);
+        cache.get_or_load(&a, load(&loads));
+        assert_eq!(loads.get(), 3);
+        cache.get_or_load(&b, load(&loads));
+        assert_eq!(loads.get(), 4);
+    }
+
+    struct CountingBackend(Rc<Cell<u32>>);
+
+    impl Backend for CountingBackend {
+        fn key(&self, _keycode: KeyCode, _action: PressType, _timestamp: Timestamp) {}
+        fn set_modifiers(&self, _modifiers: Modifiers) {}
+        fn load_keymap(&self, keymap: &CStr) -> c::KeyMap {
+            load(&self.0)(keymap)
+        }
+        fn update_keymap(&self, _keymap: &c::KeyMap) {}
+    }
+
+    #[test]
+    fn loads_missing_keymaps_only() {
+        let loads = Rc::new(Cell::new(0));
+        let mut keyboard = VirtualKeyboard::new(
+            Box::new(CountingBackend(loads.clone()))
+        );
+        let (a, b, c) = (
+            CString::new("a").unwrap(),
+            CString::new("b").unwrap(),
+            CString::new("c").unwrap(),
+        );
+        keyboard.load_keymaps(&[a.clone(), b.clone()]);
+        assert_eq!(loads.get(), 2);
+        let loaded = keyboard.load_keymaps(&[b, c.clone(), c]);
+        assert_eq!(loads.get(), 3);
+        assert!(Rc::ptr_eq(&loaded[1], &loaded[2]));
+        // Switching back loads nothing
+        keyboard.load_keymaps(&[a]);
+        assert_eq!(loads.get(), 3);
+    }
 }
@@ -1,3 +1,6 @@
+#include <errno.h>
+#include <poll.h>
+
 #include "eek/eek-keyboard.h"
 
 #include "wayland.h"
@@ -30,3 +33,66 @@ int squeek_output_add_listener(struct wl_output *wl_output,
                                 const struct wl_output_listener *listener, void *data) {
     return wl_output_add_listener(wl_output, listener, data);
 }
+
+/// Requests made from the submission thread.
+/// The queue only keeps the thread's proxies apart from the main queue,
+/// because the events they might receive are of no interest.
+struct squeek_wire {
+    struct wl_display *display;
+    struct wl_event_queue *queue;
+};
+
+struct squeek_wire *squeek_wire_new(struct wl_display *display) {
+    struct squeek_wire *wire = g_new0(struct squeek_wire, 1);
+    wire->display = display;
+    wire->queue = wl_display_create_queue(display);
+    return wire;
+}
+
+void squeek_wire_free(struct squeek_wire *wire) {
+    wl_event_queue_destroy(wire->queue);
+    g_free(wire);
+}
+
+/// Returns a proxy for the same object,
+/// usable from another thread than the original.
+static void *wire_wrap(struct squeek_wire *wire, void *proxy) {
+    void *wrapper = wl_proxy_create_wrapper(proxy);
+    wl_proxy_set_queue(wrapper, wire->queue);
+    return wrapper;
+}
+
+struct zwp_virtual_keyboard_v1 *squeek_wire_wrap_virtual_keyboard(struct squeek_wire *wire, struct zwp_virtual_keyboard_v1 *virtual_keyboard) {
+    return wire_wrap(wire, virtual_keyboard);
+}
+
+struct zwp_input_method_v2 *squeek_wire_wrap_input_method(struct squeek_wire *wire, struct zwp_input_method_v2 *input_method) {
+    return wire_wrap(wire, input_method);
+}
+
+void squeek_wire_unwrap_virtual_keyboard(struct zwp_virtual_keyboard_v1 *wrapper) {
+    wl_proxy_wrapper_destroy(wrapper);
+}
+
+void squeek_wire_unwrap_input_method(struct zwp_input_method_v2 *wrapper) {
+    wl_proxy_wrapper_destroy(wrapper);
+}
+
+/// Blocks until all requests are written to the socket.
+/// Returns 0 on success.
+int squeek_wire_flush(struct squeek_wire *wire) {
+    while (wl_display_flush(wire->display) < 0) {
+        if (errno != EAGAIN) {
+            return -1;
+        }
+        // The compositor is not reading fast enough
+        struct pollfd fd = {
+            .fd = wl_display_get_fd(wire->display),
+            .events = POLLOUT,
+        };
+        if (poll(&fd, 1, -1) < 0 && errno != EINTR) {
+            return -1;
+        }
+    }
+    return 0;
+}
@@ -6,6 +6,7 @@
 #include "wlr-layer-shell-unstable-v1-client-protocol.h"
 #include "virtual-keyboard-unstable-v1-client-protocol.h"
 #include "input-method-unstable-v2-client-protocol.h"
+#include "presentation-time-client-protocol.h"
 
 #include "outputs.h"
 
@@ -16,9 +17,12 @@ struct squeek_wayland {
     struct zwp_input_method_manager_v2 *input_method_manager;
     struct squeek_outputs *outputs;
     struct wl_seat *seat;
+    struct wp_presentation *presentation; // nullable
+    uint32_t presentation_clock_id;
     // objects
     struct zwp_input_method_v2 *input_method;
     struct zwp_virtual_keyboard_v1 *virtual_keyboard;
+    struct wl_display *display;
 };
 
 
@@ -0,0 +1,284 @@
+/* Copyright (C) 2026 Purism SPC
+ * SPDX-License-Identifier: GPL-3.0+
+ */
+
+/*! Sending requests to the compositor from a dedicated thread.
+ *
+ * Writing to the Wayland socket blocks when the compositor
+ * is slow to read, and that would stall touch handling.
+ * The submission state stays on the main thread,
+ * and only the finished requests get handed over to the wire thread.
+ *
+ * All requests go through one channel, so they reach the compositor
+ * in the order they were made, even when they are for different objects,
+ * like a modifier change followed by a key press,
+ * or a key press followed by committed text.
+ * The thread flushes the connection whenever it runs out of requests,
+ * so that a burst goes out in one write.
+ *
+ * The thread uses proxy wrappers assigned to a private event queue.
+ * Events keep arriving on the original objects on the main queue,
+ * where IMService handles them.
+ */
+
+use std::ffi::{ CStr, CString };
+use std::sync::mpsc;
+use std::thread;
+
+use crate::imservice;
+use crate::imservice::c::InputMethod;
+use crate::keyboard::{ Modifiers, PressType };
+use crate::logging;
+use crate::submission::Timestamp;
+use crate::vkeyboard;
+use crate::vkeyboard::c::{ KeyMap, ZwpVirtualKeyboardV1 };
+
+// Traits
+use crate::imservice::Backend as _;
+use crate::logging::Warn;
+use crate::vkeyboard::Backend as _;
+
+/// Gathers stuff defined in C or called by C
+pub mod c {
+    use std::os::raw::c_void;
+
+    use crate::imservice::c::InputMethod;
+    use crate::vkeyboard::c::ZwpVirtualKeyboardV1;
+
+    /// struct wl_display*
+    #[repr(transparent)]
+    #[derive(Clone, Copy)]
+    pub struct WlDisplay(*const c_void);
+
+    impl WlDisplay {
+        pub fn null() -> Self {
+            Self(std::ptr::null())
+        }
+    }
+
+    /// struct squeek_wire*
+    #[repr(transparent)]
+    #[derive(Clone, Copy)]
+    pub struct Wire(*const c_void);
+
+    extern "C" {
+        pub fn squeek_wire_new(display: WlDisplay) -> Wire;
+        pub fn squeek_wire_free(wire: Wire);
+        pub fn squeek_wire_wrap_virtual_keyboard(
+            wire: Wire,
+            virtual_keyboard: ZwpVirtualKeyboardV1,
+        ) -> ZwpVirtualKeyboardV1;
+        pub fn squeek_wire_wrap_input_method(
+            wire: Wire,
+            input_method: InputMethod,
+        ) -> InputMethod;
+        pub fn squeek_wire_unwrap_virtual_keyboard(wrapper: ZwpVirtualKeyboardV1);
+        pub fn squeek_wire_unwrap_input_method(wrapper: InputMethod);
+        pub fn squeek_wire_flush(wire: Wire) -> i32;
+    }
+}
+
+enum Request {
+    Key { keycode: u32, action: PressType, timestamp: Timestamp },
+    Modifiers(Modifiers),
+    /// A handle of its own, closed once sent
+    Keymap(KeyMap),
+    CommitString(CString),
+    DeleteSurroundingText { before: u32, after: u32 },
+    PreeditString { text: CString, cursor_begin: i32, cursor_end: i32 },
+    Commit(u32),
+    DestroyInputMethod,
+}
+
+/// Everything the thread owns
+struct Proxies {
+    wire: c::Wire,
+    virtual_keyboard: ZwpVirtualKeyboardV1,
+    /// The wrapper and the wrapped object
+    input_method: Option<(InputMethod, InputMethod)>,
+}
+
+// The proxy wrappers are only ever used from the wire thread.
+unsafe impl Send for Proxies {}
+
+impl Proxies {
+    fn new(
+        display: c::WlDisplay,
+        virtual_keyboard: ZwpVirtualKeyboardV1,
+        input_method: InputMethod,
+    ) -> Proxies {
+        unsafe {
+            let wire = c::squeek_wire_new(display);
+            Proxies {
+                wire,
+                virtual_keyboard: c::squeek_wire_wrap_virtual_keyboard(
+                    wire,
+                    virtual_keyboard,
+                ),
+                input_method: match input_method.is_null() {
+                    true => None,
+                    false => Some((
+                        c::squeek_wire_wrap_input_method(wire, input_method),
+                        input_method,
+                    )),
+                },
+            }
+        }
+    }
+
+    fn send(&mut self, request: Request) {
+        match request {
+            Request::Key { keycode, action, timestamp } => {
+                self.virtual_keyboard.key(keycode, action, timestamp)
+            },
+            Request::Modifiers(modifiers) => {
+                self.virtual_keyboard.set_modifiers(modifiers)
+            },
+            Request::Keymap(keymap) => {
+                self.virtual_keyboard.update_keymap(&keymap)
+            },
+            Request::CommitString(text) => if let Some((im, _)) = self.input_method {
+                im.commit_string(&text)
+            },
+            Request::DeleteSurroundingText { before, after } => {
+                if let Some((im, _)) = self.input_method {
+                    im.delete_surrounding_text(before, after)
+                }
+            },
+            Request::PreeditString { text, cursor_begin, cursor_end } => {
+                if let Some((im, _)) = self.input_method {
+                    im.set_preedit_string(&text, cursor_begin, cursor_end)
+                }
+            },
+            Request::Commit(serial) => if let Some((im, _)) = self.input_method {
+                im.commit(serial)
+            },
+            Request::DestroyInputMethod => {
+                if let Some((wrapper, im)) = self.input_method.take() {
+                    unsafe { c::squeek_wire_unwrap_input_method(wrapper) };
+                    // Safe to do here: the compositor sends no more events
+                    // to an unavailable input method.
+                    im.destroy();
+                }
+            },
+        }
+    }
+
+    fn flush(&self) {
+        if unsafe { c::squeek_wire_flush(self.wire) } != 0 {
+            log_print!(
+                logging::Level::Bug,
+                "Can't flush Wayland requests: {}",
+                std::io::Error::last_os_error(),
+            );
+        }
+    }
+
+    fn run(mut self, receiver: mpsc::Receiver<Request>) {
+        while let Ok(request) = receiver.recv() {
+            self.send(request);
+            for request in receiver.try_iter() {
+                self.send(request);
+            }
+            self.flush();
+        }
+    }
+}
+
+impl Drop for Proxies {
+    fn drop(&mut self) {
+        unsafe {
+            c::squeek_wire_unwrap_virtual_keyboard(self.virtual_keyboard);
+            if let Some((wrapper, _)) = self.input_method {
+                c::squeek_wire_unwrap_input_method(wrapper);
+            }
+            c::squeek_wire_free(self.wire);
+        }
+    }
+}
+
+/// The handle to the wire thread.
+/// The thread quits once all the handles are gone.
+#[derive(Clone)]
+pub struct Wire(mpsc::Sender<Request>);
+
+impl Wire {
+    pub fn spawn(
+        display: c::WlDisplay,
+        virtual_keyboard: ZwpVirtualKeyboardV1,
+        input_method: InputMethod,
+    ) -> Wire {
+        let proxies = Proxies::new(display, virtual_keyboard, input_method);
+        let (sender, receiver) = mpsc::channel();
+        thread::Builder::new()
+            .name("wire".into())
+            .spawn(move || proxies.run(receiver))
+            .expect("Can't start the Wayland thread");
+        Wire(sender)
+    }
+
+    fn send(&self, request: Request) {
+        self.0.send(request)
+            .or_print(logging::Problem::Bug, "The Wayland thread is gone");
+    }
+}
+
+/// Virtual keyboard requests, sent from the wire thread
+pub struct VirtualKeyboardRequests(pub Wire);
+
+impl vkeyboard::Backend for VirtualKeyboardRequests {
+    fn key(&self, keycode: u32, action: PressType, timestamp: Timestamp) {
+        self.0.send(Request::Key { keycode, action, timestamp });
+    }
+
+    fn set_modifiers(&self, modifiers: Modifiers) {
+        self.0.send(Request::Modifiers(modifiers));
+    }
+
+    fn load_keymap(&self, keymap: &CStr) -> KeyMap {
+        KeyMap::from_cstr(keymap)
+    }
+
+    fn load_keymaps(&self, keymaps: &[&CStr]) -> Vec<KeyMap> {
+        vkeyboard::load_in_parallel(keymaps)
+    }
+
+    fn update_keymap(&self, keymap: &KeyMap) {
+        // The keymap may get dropped before the thread sends it
+        if let Some(keymap) = keymap.try_clone()
+            .or_print(logging::Problem::Bug, "Can't duplicate the keymap")
+        {
+            self.0.send(Request::Keymap(keymap));
+        }
+    }
+}
+
+/// Input method requests, sent from the wire thread
+pub struct InputMethodRequests(pub Wire);
+
+impl imservice::Backend for InputMethodRequests {
+    fn commit_string(&self, text: &CStr) {
+        self.0.send(Request::CommitString(text.into()));
+    }
+
+    fn delete_surrounding_text(&self, before: u32, after: u32) {
+        self.0.send(Request::DeleteSurroundingText { before, after });
+    }
+
+    fn set_preedit_string(&self, text: &CStr, cursor_begin: i32, cursor_end: i32) {
+        self.0.send(Request::PreeditString {
+            text: text.into(),
+            cursor_begin,
+            cursor_end,
+        });
+    }
+
+    fn commit(&self, serial: u32) {
+        self.0.send(Request::Commit(serial));
+    }
+
+    fn destroy(&self) {
+        // Goes through the thread, to come after the requests already queued.
+        self.0.send(Request::DestroyInputMethod);
+    }
+}